@@ -2,6 +2,7 @@
 #include "hlsl/shaders/source.hpp"
 #include "hlsl/pp/lex.hpp"
 #include "hlsl/pp/parse.hpp"
+#include "hlsl/pp/frozen_tree.hpp"
 #include <jsonpp/jsonpp.hpp>
 #include <fstream>
 
@@ -58,6 +59,8 @@ inline json::value to_json( const gld::hlsl::token_value& t ) {
 		return json::value( to_string( t.unsafe_get<inclusion_style>() ) );
 	case token_value::index<code_point>::value:
 		return json::value( t.unsafe_get<code_point>() );
+	case token_value::index<hlsl::identifier_id>::value:
+		return json::value( t.unsafe_get<hlsl::identifier_id>().index );
 	case token_value::index<unit>::value:
 	default:
 		break;
@@ -65,13 +68,22 @@ inline json::value to_json( const gld::hlsl::token_value& t ) {
 	return json::null();
 }
 
-inline json::value to_json( const gld::hlsl::token& t ) {
+// Tokens only carry a compact location; line and column
+// are resolved through the source manager when dumping
+struct located_token {
+	const gld::hlsl::token& t;
+	const gld::hlsl::source_manager& sources;
+};
+
+inline json::value to_json( const located_token& lt ) {
+	const gld::hlsl::token& t = lt.t;
 	gld::string_view id = to_string( t.id );
+	gld::hlsl::occurrence where = lt.sources.resolve( t.where );
 	if ( t.value.is<gld::unit>() ) {
 		json::object v( {
 			{ "id", id },
 			{ "lexeme", t.lexeme },
-			{ "where", t.where }
+			{ "where", where }
 		} );
 		return v;
 	}
@@ -79,19 +91,33 @@ inline json::value to_json( const gld::hlsl::token& t ) {
 		json::object v( {
 			{ "id", id },
 			{ "lexeme", t.lexeme },
-			{ "where", t.where },
+			{ "where", where },
 			{ "value", t.value }
 		} );
 		return v;
 	}
 }
 
+inline json::value to_json( const gld::hlsl::pp::frozen_node& n ) {
+	using gld::hlsl::pp::frozen_node;
+	json::object v( {
+		{ "kind", to_string( n.kind ) },
+		{ "flags", json::value( n.flags ) },
+		{ "first_child", n.first_child == frozen_node::none ? json::null() : json::value( n.first_child ) },
+		{ "next_sibling", n.next_sibling == frozen_node::none ? json::null() : json::value( n.next_sibling ) },
+		{ "first_token", json::value( n.first_token ) },
+		{ "token_count", json::value( n.token_count ) },
+		{ "payload", json::value( n.payload ) }
+	} );
+	return v;
+}
+
 template <typename T>
 inline json::value to_json( const gld::buffer_view<T>& b ) {
 	return json::array( b.begin(), b.end() );
 }
 
-inline json::value to_json( const std::pair<gld::string_view, gld::buffer_view<gld::hlsl::token>>& p ) {
+inline json::value to_json( const std::pair<gld::string_view, gld::buffer_view<const located_token>>& p ) {
 	json::object v( {
 		{ "source", p.first },
 		{ "tokens", p.second }
@@ -99,17 +125,32 @@ inline json::value to_json( const std::pair<gld::string_view, gld::buffer_view<g
 	return v;
 }
 
-void json_print( gld::string_view name, gld::string_view source, gld::buffer_view<gld::hlsl::token> tokens ) {
-	std::string data = json::dump_string( std::make_pair( source, tokens ), json::format_options( 5, json::format_options::none ) );
+void json_print( gld::string_view name, gld::string_view source, const gld::hlsl::source_manager& sources, gld::buffer_view<const gld::hlsl::token> tokens ) {
+	std::vector<located_token> located;
+	located.reserve( tokens.size() );
+	for ( const gld::hlsl::token& t : tokens ) {
+		located.push_back( located_token{ t, sources } );
+	}
+	gld::buffer_view<const located_token> locatedview( located.data(), located.size() );
+	std::string data = json::dump_string( std::make_pair( source, locatedview ), json::format_options( 5, json::format_options::none ) );
 	std::ofstream output( name.c_str() );
 	output << data << std::endl;
 }
 
-void lex_print( gld::string name, gld::string_view source ) {
-	auto tokens = gld::hlsl::pp::lex( name, source );
-	json_print( name + ".pp.lex.json", source, tokens );
-	gld::hlsl::pp::parse_tree tree = gld::hlsl::pp::parse( tokens );
+// Nodes are written in the frozen tree's pre-order, the order every walk over it takes
+void json_print( gld::string_view name, const gld::hlsl::pp::frozen_tree& frozen ) {
+	std::string data = json::dump_string( frozen.nodes(), json::format_options( 5, json::format_options::none ) );
+	std::ofstream output( name.c_str() );
+	output << data << std::endl;
+}
 
+void lex_print( gld::hlsl::source_manager& sources, gld::hlsl::file_id file ) {
+	const gld::string& name = sources.origin_of( file );
+	gld::string_view source = sources.text_of( file );
+	auto tokens = gld::hlsl::pp::lex( sources, file );
+	json_print( name + ".pp.lex.json", source, sources, gld::buffer_view<const gld::hlsl::token>( tokens.data(), tokens.size() ) );
+	gld::hlsl::pp::parse_tree tree = gld::hlsl::pp::parse( std::move( tokens ) );
+	json_print( name + ".pp.parse.json", gld::hlsl::pp::freeze( tree ) );
 }
 
 int main( int argc, char* argv[] ) {
@@ -118,6 +159,10 @@ int main( int argc, char* argv[] ) {
 	using string_view = Furrovine::string_view;
 	std::vector<string_view> arguments(argv, argv + argc);
 
-	lex_print( "fluff", gld::hlsl::shaders::fluff::pre_processing );
-	//lex_print( "nymphbatch.json", gld::hlsl::shaders::sm40_level_93::nymph_batch );
+	gld::hlsl::source_manager sources;
+	lex_print( sources, sources.add( "fluff", gld::hlsl::shaders::fluff::pre_processing ) );
+	//lex_print( sources, sources.add( "nymphbatch.json", gld::hlsl::shaders::sm40_level_93::nymph_batch ) );
+	for ( int i = 1; i < argc; ++i ) {
+		lex_print( sources, sources.load( argv[ i ] ) );
+	}
 }
\ No newline at end of file
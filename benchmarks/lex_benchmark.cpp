@@ -0,0 +1,325 @@
+#include "../hlsl/shaders/source.hpp"
+#include "../hlsl/pp/lex.hpp"
+#include "../hlsl/pp/parallel_lex.hpp"
+#include <chrono>
+#include <algorithm>
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+// Measures pp::lex, pp::lex into an arena, and pp::lex_parallel throughput over the bundled shaders and over generated inputs
+// that each lean on one path through the lexer
+// pp.lex.scaling rows lex the inputs whose directives close blocks, at a size and at four times that size:
+// lexing is linear, so tokens per second should come out the same at both, however deep or long the blocks get.
+// Both sizes are past what the caches hold, so the comparison is not between a cached and an uncached run
+// The rows are checked as well as printed: throughput within 25% across the sizes, tokens per byte within 10%,
+// and block begin and end markers pairing up at both sizes. Every other input, long_comments among them,
+// has its block and comment markers checked the same way, and the benchmark exits 1 if anything fails
+// pp.lex_parallel uses every hardware thread, or as many as --threads N asks for; the rows say how many
+// Output is one JSON object per line, so runs can be diffed and tracked across releases:
+// every generated input is built deterministically, and the reported time is the median of the runs
+
+namespace {
+
+	struct benchmark_input {
+		std::string name;
+		std::string text;
+	};
+
+	const std::size_t generated_size = 1 << 20;
+
+	std::string repeat_until( std::size_t size, const char* chunk ) {
+		std::string text;
+		std::size_t chunksize = std::strlen( chunk );
+		text.reserve( size + chunksize );
+		while ( text.size() < size ) {
+			text.append( chunk, chunksize );
+		}
+		return text;
+	}
+
+	std::string long_comments( std::size_t size ) {
+		std::string text;
+		text.reserve( size + 4096 );
+		std::string line( 200, 'c' );
+		while ( text.size() < size ) {
+			text += "/*";
+			for ( int i = 0; i < 20; ++i ) {
+				text += line;
+				text += "\n";
+			}
+			text += "*/\n";
+			text += "// ";
+			text += line;
+			text += "\nfloat f;\n";
+		}
+		return text;
+	}
+
+	std::string dense_punctuation( std::size_t size ) {
+		return repeat_until( size, "a=(b[c]+d)*e/f%g-h;{i<j>k!=l&&m||n^o,p:q.r};\n" );
+	}
+
+	std::string numeric_literals( std::size_t size ) {
+		return repeat_until( size, "0 1 42 4294967295u 0x7FFFFFFF 0777 0b1011 1.5 1.5f 2.0h 3.25L 6.02e23 1e-7f 123456789012345 0.000001\n" );
+	}
+
+	std::string long_identifiers( std::size_t size ) {
+		std::string text;
+		text.reserve( size + 1024 );
+		for ( std::size_t n = 0; text.size() < size; ++n ) {
+			text += "float ";
+			text += std::string( 64, 'a' + static_cast<char>( n % 26 ) );
+			text += "_";
+			text += std::to_string( n );
+			text += "_with_an_even_longer_descriptive_suffix_name;\n";
+		}
+		return text;
+	}
+
+	std::string line_continuations( std::size_t size ) {
+		std::string text;
+		text.reserve( size + 1024 );
+		while ( text.size() < size ) {
+			text += "#define LONG_MACRO( a, b ) \\\n";
+			for ( int i = 0; i < 30; ++i ) {
+				text += "\ta = a + b * 2; \\\n";
+			}
+			text += "\tb = a\n";
+		}
+		return text;
+	}
+
+	std::string nested_conditionals( std::size_t size ) {
+		const int depth = 64;
+		std::string text;
+		text.reserve( size + 8192 );
+		while ( text.size() < size ) {
+			for ( int i = 0; i < depth; ++i ) {
+				text += "#if defined(LEVEL_" + std::to_string( i ) + ") && LEVEL > " + std::to_string( i ) + "\n";
+				text += "int level_" + std::to_string( i ) + ";\n";
+			}
+			for ( int i = depth; i-- > 0; ) {
+				text += "#else\nint not_level_" + std::to_string( i ) + ";\n#endif\n";
+			}
+		}
+		return text;
+	}
+
+	// One #if nest as deep as the size allows, so every #else and #endif closes a block opened thousands of lines before
+	std::string deep_nesting( std::size_t size ) {
+		std::string text;
+		text.reserve( size + 1024 );
+		std::size_t depth = 0;
+		for ( std::size_t closing = 0; text.size() + closing < size; ++depth ) {
+			std::string suffix = std::to_string( depth );
+			text += "#if LEVEL > " + suffix + "\nint level_" + suffix + ";\n";
+			closing += std::strlen( "#else\nint not_level_;\n#endif\n" ) + suffix.size();
+		}
+		while ( depth-- > 0 ) {
+			text += "#else\nint not_level_" + std::to_string( depth ) + ";\n#endif\n";
+		}
+		return text;
+	}
+
+	// One #if followed by nothing but #elif branches, each of which ends the block before it
+	std::string long_chain( std::size_t size ) {
+		std::string text = "#if CHOICE == 0\nint choice_0;\n";
+		text.reserve( size + 1024 );
+		for ( std::size_t n = 1; text.size() < size; ++n ) {
+			std::string suffix = std::to_string( n );
+			text += "#elif CHOICE == " + suffix + "\nint choice_" + suffix + ";\n";
+		}
+		text += "#else\nint no_choice;\n#endif\n";
+		return text;
+	}
+
+	struct benchmark_result {
+		double median_seconds;
+		double min_seconds;
+		std::size_t tokens;
+		// Peak bytes the arena held in any one pass, 0 when no arena was used:
+		// the size to give each worker's arena so that it never grows
+		std::size_t arena_high_water;
+		std::size_t threads;
+	};
+
+	template <typename Lex>
+	benchmark_result run( const benchmark_input& input, int repetitions, Lex&& lex ) {
+		gld::string_view source( input.text.data(), input.text.data() + input.text.size() );
+		std::vector<double> seconds;
+		seconds.reserve( repetitions );
+		std::size_t tokens = 0;
+		// One untimed pass warms the caches and the allocator
+		for ( int i = -1; i < repetitions; ++i ) {
+			gld::hlsl::source_manager sources;
+			gld::hlsl::file_id file = sources.add( input.name, source );
+			auto start = std::chrono::steady_clock::now();
+			auto lexed = lex( sources, file );
+			auto stop = std::chrono::steady_clock::now();
+			tokens = lexed.size();
+			if ( i >= 0 ) {
+				seconds.push_back( std::chrono::duration<double>( stop - start ).count() );
+			}
+		}
+		std::sort( seconds.begin(), seconds.end() );
+		return benchmark_result{ seconds[ seconds.size() / 2 ], seconds.front(), tokens, 0, 1 };
+	}
+
+	struct scaling_input {
+		const char* name;
+		std::string ( *generate )( std::size_t );
+	};
+
+	// Every begin marker of a kind is closed by an end marker of that kind, in order, and nothing is left open
+	bool markers_balanced( const std::vector<gld::hlsl::token>& tokens, gld::hlsl::token_id begin, gld::hlsl::token_id end ) {
+		std::size_t open = 0;
+		for ( const gld::hlsl::token& t : tokens ) {
+			if ( t.id == begin ) {
+				++open;
+			}
+			else if ( t.id == end ) {
+				if ( open == 0 ) {
+					return false;
+				}
+				--open;
+			}
+		}
+		return open == 0;
+	}
+
+	bool markers_balanced( const benchmark_input& input ) {
+		gld::hlsl::source_manager sources;
+		gld::hlsl::file_id file = sources.add( input.name, gld::string_view( input.text.data(), input.text.data() + input.text.size() ) );
+		std::vector<gld::hlsl::token> tokens = gld::hlsl::pp::lex( sources, file );
+		return markers_balanced( tokens, gld::hlsl::token_id::preprocessor_block_begin, gld::hlsl::token_id::preprocessor_block_end )
+			&& markers_balanced( tokens, gld::hlsl::token_id::block_comment_begin, gld::hlsl::token_id::block_comment_end )
+			&& markers_balanced( tokens, gld::hlsl::token_id::line_comment_begin, gld::hlsl::token_id::line_comment_end );
+	}
+
+	bool within( double ratio, double tolerance ) {
+		return ratio > 1.0 - tolerance && ratio < 1.0 / ( 1.0 - tolerance );
+	}
+
+	// Returns whether the row passed
+	template <typename Run>
+	bool print_scaling( const scaling_input& input, std::size_t size, std::size_t factor, int repetitions, Run&& run ) {
+		benchmark_input small{ input.name, input.generate( size ) };
+		benchmark_input large{ input.name, input.generate( size * factor ) };
+		benchmark_result smallresult = run( small );
+		benchmark_result largeresult = run( large );
+		double smallrate = static_cast<double>( smallresult.tokens ) / smallresult.median_seconds;
+		double largerate = static_cast<double>( largeresult.tokens ) / largeresult.median_seconds;
+		double ratio = largerate / smallrate;
+		double densityratio = ( static_cast<double>( largeresult.tokens ) / large.text.size() ) / ( static_cast<double>( smallresult.tokens ) / small.text.size() );
+		bool flat = within( ratio, 0.25 );
+		bool proportional = within( densityratio, 0.1 );
+		bool balanced = markers_balanced( small ) && markers_balanced( large );
+		bool passed = flat && proportional && balanced;
+		std::printf( "{\"benchmark\":\"pp.lex.scaling\",\"input\":\"%s\",\"repetitions\":%d,"
+			"\"bytes\":%zu,\"tokens\":%zu,\"tokens_per_second\":%.1f,"
+			"\"scaled_bytes\":%zu,\"scaled_tokens\":%zu,\"scaled_tokens_per_second\":%.1f,"
+			"\"throughput_ratio\":%.3f,\"token_density_ratio\":%.3f,"
+			"\"flat\":%s,\"proportional\":%s,\"balanced\":%s,\"passed\":%s}\n",
+			input.name, repetitions,
+			small.text.size(), smallresult.tokens, smallrate,
+			large.text.size(), largeresult.tokens, largerate,
+			ratio, densityratio,
+			flat ? "true" : "false", proportional ? "true" : "false", balanced ? "true" : "false", passed ? "true" : "false" );
+		return passed;
+	}
+
+	void print( const char* benchmark, const benchmark_input& input, int repetitions, const benchmark_result& result ) {
+		double bytes = static_cast<double>( input.text.size() );
+		std::printf( "{\"benchmark\":\"%s\",\"input\":\"%s\",\"bytes\":%zu,\"tokens\":%zu,\"repetitions\":%d,"
+			"\"median_seconds\":%.9f,\"min_seconds\":%.9f,\"mb_per_second\":%.3f,\"tokens_per_second\":%.1f,"
+			"\"arena_high_water\":%zu,\"threads\":%zu}\n",
+			benchmark, input.name.c_str(), input.text.size(), result.tokens, repetitions,
+			result.median_seconds, result.min_seconds,
+			bytes / ( 1024.0 * 1024.0 ) / result.median_seconds,
+			static_cast<double>( result.tokens ) / result.median_seconds,
+			result.arena_high_water, result.threads );
+	}
+
+}
+
+int main( int argc, char* argv[] ) {
+	int repetitions = 10;
+	const char* only = nullptr;
+	std::size_t threads = std::max( 1u, std::thread::hardware_concurrency() );
+	for ( int i = 1; i < argc; ++i ) {
+		if ( std::strcmp( argv[ i ], "--repetitions" ) == 0 && i + 1 < argc ) {
+			repetitions = std::max( 1, std::atoi( argv[ ++i ] ) );
+		}
+		else if ( std::strcmp( argv[ i ], "--only" ) == 0 && i + 1 < argc ) {
+			only = argv[ ++i ];
+		}
+		else if ( std::strcmp( argv[ i ], "--threads" ) == 0 && i + 1 < argc ) {
+			threads = static_cast<std::size_t>( std::max( 1, std::atoi( argv[ ++i ] ) ) );
+		}
+	}
+
+	std::vector<benchmark_input> inputs;
+	gld::string_view fluff = gld::hlsl::shaders::fluff::pre_processing;
+	gld::string_view nymph = gld::hlsl::shaders::sm40_level_93::nymph_batch;
+	inputs.push_back( benchmark_input{ "fluff_pre_processing", std::string( fluff.data(), fluff.data_end() ) } );
+	inputs.push_back( benchmark_input{ "sm40_level_93_nymph_batch", std::string( nymph.data(), nymph.data_end() ) } );
+	inputs.push_back( benchmark_input{ "long_comments", long_comments( generated_size ) } );
+	inputs.push_back( benchmark_input{ "dense_punctuation", dense_punctuation( generated_size ) } );
+	inputs.push_back( benchmark_input{ "numeric_literals", numeric_literals( generated_size ) } );
+	inputs.push_back( benchmark_input{ "long_identifiers", long_identifiers( generated_size ) } );
+	inputs.push_back( benchmark_input{ "line_continuations", line_continuations( generated_size ) } );
+	inputs.push_back( benchmark_input{ "nested_conditionals", nested_conditionals( generated_size ) } );
+	inputs.push_back( benchmark_input{ "deep_nesting", deep_nesting( generated_size ) } );
+	inputs.push_back( benchmark_input{ "long_chain", long_chain( generated_size ) } );
+
+	int failures = 0;
+	for ( const benchmark_input& input : inputs ) {
+		if ( only != nullptr && input.name != only ) {
+			continue;
+		}
+		if ( !markers_balanced( input ) ) {
+			std::fprintf( stderr, "%s: block or comment begin and end markers do not pair up\n", input.name.c_str() );
+			++failures;
+		}
+		print( "pp.lex", input, repetitions, run( input, repetitions, []( gld::hlsl::source_manager& sources, gld::hlsl::file_id file ) {
+			return gld::hlsl::pp::lex( sources, file );
+		} ) );
+		gld::pmr::monotonic_buffer_resource arena;
+		benchmark_result arenaresult = run( input, repetitions, [&arena]( gld::hlsl::source_manager& sources, gld::hlsl::file_id file ) {
+			// The previous pass's tokens are gone by now, so its whole arena goes back in one shot
+			arena.release();
+			return gld::hlsl::pp::lex( sources, file, &arena );
+		} );
+		arenaresult.arena_high_water = arena.high_water_mark();
+		print( "pp.lex_arena", input, repetitions, arenaresult );
+		benchmark_result parallelresult = run( input, repetitions, [ threads ]( gld::hlsl::source_manager& sources, gld::hlsl::file_id file ) {
+			return gld::hlsl::pp::lex_parallel( sources, file, threads );
+		} );
+		parallelresult.threads = threads;
+		print( "pp.lex_parallel", input, repetitions, parallelresult );
+	}
+
+	const scaling_input scaling[] = {
+		{ "deep_nesting", deep_nesting },
+		{ "long_chain", long_chain },
+		{ "nested_conditionals", nested_conditionals }
+	};
+	for ( const scaling_input& input : scaling ) {
+		if ( only != nullptr && std::strcmp( input.name, only ) != 0 ) {
+			continue;
+		}
+		bool passed = print_scaling( input, generated_size, 4, repetitions, [ repetitions ]( const benchmark_input& sized ) {
+			return run( sized, repetitions, []( gld::hlsl::source_manager& sources, gld::hlsl::file_id file ) {
+				return gld::hlsl::pp::lex( sources, file );
+			} );
+		} );
+		if ( !passed ) {
+			++failures;
+		}
+	}
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,588 @@
+#include "../hlsl/shaders/source.hpp"
+#include "../hlsl/pp/parse.hpp"
+#include "../hlsl/pp/frozen_tree.hpp"
+#include "../hlsl/pp/expander.hpp"
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+// Measures pp::parse over the bundled shaders and over generated inputs made of one kind of directive,
+// counting the calls that reach a memory_resource along with the time:
+// the counting resource is both the tree's resource and the default one, so the parser's scratch space is counted too.
+// pp.parse.packed rows parse the same input lexed into packed_tokens, which the parser reads in place
+// pp.expand rows time pp::expander over the frozen tree of each input, in output tokens per second,
+// with its expansion cache and, as pp.expand.uncached, without.
+// pp.conditions rows time every #if and #elif of an input evaluated again once the whole input has been expanded,
+// with the macros it left defined, counting what that allocates
+// Output is one JSON object per line, in the same shape as lex_benchmark's
+// With --verify-cache [--seed N], nothing is timed: random programs of #define, #undef and macro uses are expanded
+// with and without the expansion cache, and the run fails on the first output that differs
+// With --verify-conditions, nothing is timed either: #if expressions whose answer turns on signed and unsigned arithmetic
+// are evaluated as written, as a macro's value and through a macro call, and the run fails if any comes out wrong
+
+namespace {
+
+	struct benchmark_input {
+		std::string name;
+		std::string text;
+		// #define or #if lines in the text, to put the counts per directive
+		std::size_t directives;
+	};
+
+	const std::size_t generated_size = 1 << 20;
+
+	class counting_resource : public gld::pmr::memory_resource {
+	private:
+		gld::pmr::memory_resource* upstream;
+
+	public:
+		std::size_t allocations;
+		std::size_t bytes;
+
+		counting_resource( gld::pmr::memory_resource* upstream = gld::pmr::new_delete_resource() ) : upstream( upstream ), allocations( 0 ), bytes( 0 ) {
+
+		}
+
+	private:
+		void* do_allocate( std::size_t size, std::size_t alignment ) override {
+			++allocations;
+			bytes += size;
+			return upstream->allocate( size, alignment );
+		}
+
+		void do_deallocate( void* p, std::size_t size, std::size_t alignment ) override {
+			upstream->deallocate( p, size, alignment );
+		}
+
+		bool do_is_equal( const gld::pmr::memory_resource& other ) const noexcept override {
+			return this == &other;
+		}
+	};
+
+	std::size_t count_lines_starting( const std::string& text, const char* prefix ) {
+		std::size_t count = 0;
+		std::size_t prefixsize = std::strlen( prefix );
+		for ( std::size_t at = 0; at < text.size(); ) {
+			if ( text.compare( at, prefixsize, prefix ) == 0 ) {
+				++count;
+			}
+			std::size_t newline = text.find( '\n', at );
+			if ( newline == std::string::npos ) {
+				break;
+			}
+			at = newline + 1;
+		}
+		return count;
+	}
+
+	std::string function_defines( std::size_t size ) {
+		std::string text;
+		text.reserve( size + 1024 );
+		for ( std::size_t n = 0; text.size() < size; ++n ) {
+			std::string name = "MACRO_" + std::to_string( n );
+			text += "#define " + name + "( a, b, c ) ( ( a ) * ( b ) + c )\n";
+			text += "float value_" + std::to_string( n ) + " = " + name + "( 1, 2, 3 );\n";
+		}
+		return text;
+	}
+
+	std::string object_defines( std::size_t size ) {
+		std::string text;
+		text.reserve( size + 1024 );
+		for ( std::size_t n = 0; text.size() < size; ++n ) {
+			text += "#define VALUE_" + std::to_string( n ) + " ( 4 * 2 + 1 )\n";
+		}
+		return text;
+	}
+
+	std::string conditional_chains( std::size_t size ) {
+		std::string text = "#define QUALITY 2\n";
+		text.reserve( size + 1024 );
+		for ( std::size_t n = 0; text.size() < size; ++n ) {
+			std::string suffix = std::to_string( n );
+			if ( n % 3 != 0 ) {
+				// Left undefined, the rest are 0
+				text += "#define LEVEL_" + suffix + " " + std::to_string( n % 4 ) + "\n";
+			}
+			text += "#if LEVEL_" + suffix + " > 2 && ( QUALITY + 1 ) * 2 >= 4\n";
+			text += "int high_" + suffix + ";\n";
+			text += "#elif LEVEL_" + suffix + " > 1\n";
+			text += "int medium_" + suffix + ";\n";
+			text += "#else\n";
+			text += "int low_" + suffix + ";\n";
+			text += "#endif\n";
+		}
+		return text;
+	}
+
+	// Small helpers nested a few deep and used on every line, the way shader code leans on them
+	std::string macro_heavy( std::size_t size ) {
+		std::string text =
+			"#define SQUARE( x ) ( ( x ) * ( x ) )\n"
+			"#define MAD( a, b, c ) ( ( a ) * ( b ) + ( c ) )\n"
+			"#define LERP( a, b, t ) MAD( ( b ) - ( a ), t, a )\n"
+			"#define SATURATE( x ) clamp( x, 0, 1 )\n"
+			"#define CALL( f, ... ) f( VA_ARGS )\n"
+			"#define SCALE 4\n"
+			"#define BIAS ( SCALE / 2 )\n";
+		text.reserve( size + 1024 );
+		for ( std::size_t n = 0; text.size() < size; ++n ) {
+			std::string suffix = std::to_string( n );
+			text += "float v" + suffix + " = SATURATE( LERP( SQUARE( a" + suffix + " ), BIAS, SCALE ) ) + CALL( MAD, x, SCALE, y );\n";
+		}
+		return text;
+	}
+
+	// The same few object-like macros used over and over, like the type aliases and constants shaders are written against
+	std::string object_uses( std::size_t size ) {
+		std::string text =
+			"#define vec4 float4\n"
+			"#define vec3 float3\n"
+			"#define QUALITY_FACTOR 0.5\n"
+			"#define PLATFORM_SCALE ( 2.0 * QUALITY_FACTOR )\n";
+		text.reserve( size + 1024 );
+		for ( std::size_t n = 0; text.size() < size; ++n ) {
+			std::string suffix = std::to_string( n );
+			text += "vec4 v" + suffix + " = vec4( PLATFORM_SCALE, x" + suffix + ", 0, 1 ) * vec3( 1, 2, 3 ).xyzz;\n";
+		}
+		return text;
+	}
+
+	// Names built with ## and spelled with #, from a few hundred distinct spellings, the way generated shader interfaces are
+	std::string token_pastes( std::size_t size ) {
+		std::string text =
+			"#define CAT( a, b ) a ## b\n"
+			"#define FIELD( type, name ) type CAT( m_, name );\n"
+			"#define NAME( x ) #x\n";
+		text.reserve( size + 1024 );
+		for ( std::size_t n = 0; text.size() < size; ++n ) {
+			std::string suffix = std::to_string( n % 256 );
+			text += "FIELD( float4, color" + suffix + " ) string n" + suffix + " = NAME( color" + suffix + " ) + CAT( 1, " + suffix + " );\n";
+		}
+		return text;
+	}
+
+	std::vector<gld::hlsl::token> lex( gld::hlsl::source_manager& sources, gld::hlsl::file_id file ) {
+		return gld::hlsl::pp::lex( sources, file );
+	}
+
+	gld::hlsl::packed_tokens lex_packed( gld::hlsl::source_manager& sources, gld::hlsl::file_id file ) {
+		gld::hlsl::pp::packed_lexer l( sources, file );
+		return l();
+	}
+
+	benchmark_input make_input( std::string name, std::string text ) {
+		std::size_t directives = count_lines_starting( text, "#define" ) + count_lines_starting( text, "#if" );
+		return benchmark_input{ std::move( name ), std::move( text ), directives };
+	}
+
+	struct benchmark_result {
+		double median_seconds;
+		double min_seconds;
+		std::size_t statements;
+		std::size_t errors;
+		std::size_t allocations;
+		std::size_t allocated_bytes;
+	};
+
+	// lexer is lex or lex_packed; only the parse is timed
+	template <typename Lexer>
+	benchmark_result run( const benchmark_input& input, int repetitions, Lexer lexer ) {
+		gld::string_view source( input.text.data(), input.text.data() + input.text.size() );
+		std::vector<double> seconds;
+		seconds.reserve( repetitions );
+		benchmark_result result{};
+		// One untimed pass warms the caches and the allocator
+		for ( int i = -1; i < repetitions; ++i ) {
+			gld::hlsl::source_manager sources;
+			gld::hlsl::file_id file = sources.add( input.name, source );
+			auto tokens = lexer( sources, file );
+			counting_resource counter;
+			gld::pmr::memory_resource* previous = gld::pmr::set_default_resource( &counter );
+			auto start = std::chrono::steady_clock::now();
+			{
+				gld::hlsl::pp::parse_tree tree = gld::hlsl::pp::parse( std::move( tokens ), gld::hlsl::pp::error_mode::recover, &counter );
+				result.statements = tree.statements.size();
+				result.errors = tree.errors.size();
+			}
+			auto stop = std::chrono::steady_clock::now();
+			gld::pmr::set_default_resource( previous );
+			result.allocations = counter.allocations;
+			result.allocated_bytes = counter.bytes;
+			if ( i >= 0 ) {
+				seconds.push_back( std::chrono::duration<double>( stop - start ).count() );
+			}
+		}
+		std::sort( seconds.begin(), seconds.end() );
+		result.median_seconds = seconds[ seconds.size() / 2 ];
+		result.min_seconds = seconds.front();
+		return result;
+	}
+
+	struct expand_result {
+		double median_seconds;
+		double min_seconds;
+		std::size_t output_tokens;
+		std::size_t spans;
+		std::size_t expansions;
+		std::size_t errors;
+		std::size_t allocations;
+		// Made by ## and #, each distinct spelling once
+		std::size_t synthesized_tokens;
+		gld::hlsl::pp::expansion_cache_counters cache;
+	};
+
+	expand_result run_expand( const benchmark_input& input, int repetitions, bool caching ) {
+		gld::string_view source( input.text.data(), input.text.data() + input.text.size() );
+		gld::hlsl::source_manager sources;
+		gld::hlsl::file_id file = sources.add( input.name, source );
+		gld::hlsl::pp::frozen_tree frozen = gld::hlsl::pp::freeze( gld::hlsl::pp::parse( gld::hlsl::pp::lex( sources, file ), gld::hlsl::pp::error_mode::recover ) );
+		std::vector<double> seconds;
+		seconds.reserve( repetitions );
+		expand_result result{};
+		for ( int i = -1; i < repetitions; ++i ) {
+			counting_resource counter;
+			auto start = std::chrono::steady_clock::now();
+			{
+				gld::hlsl::pp::expander e( frozen, &counter );
+				e.use_cache( caching );
+				gld::hlsl::pp::expansion out = e();
+				result.output_tokens = out.token_count();
+				result.spans = out.spans.size();
+				result.synthesized_tokens = out.synthesized->size();
+				result.expansions = e.expansions();
+				result.errors = e.errors().size();
+				result.cache = e.cache_counters();
+			}
+			auto stop = std::chrono::steady_clock::now();
+			result.allocations = counter.allocations;
+			if ( i >= 0 ) {
+				seconds.push_back( std::chrono::duration<double>( stop - start ).count() );
+			}
+		}
+		std::sort( seconds.begin(), seconds.end() );
+		result.median_seconds = seconds[ seconds.size() / 2 ];
+		result.min_seconds = seconds.front();
+		return result;
+	}
+
+	struct conditions_result {
+		double median_seconds;
+		double min_seconds;
+		std::size_t conditions;
+		std::size_t taken;
+		std::size_t errors;
+		// Made by the timed passes alone
+		std::size_t allocations;
+	};
+
+	conditions_result run_conditions( const benchmark_input& input, int repetitions ) {
+		gld::string_view source( input.text.data(), input.text.data() + input.text.size() );
+		gld::hlsl::source_manager sources;
+		gld::hlsl::file_id file = sources.add( input.name, source );
+		gld::hlsl::pp::frozen_tree frozen = gld::hlsl::pp::freeze( gld::hlsl::pp::parse( gld::hlsl::pp::lex( sources, file ), gld::hlsl::pp::error_mode::recover ) );
+		std::vector<const gld::hlsl::pp::frozen_node*> conditions;
+		for ( gld::uint32 i = 0; i < frozen.size(); ++i ) {
+			if ( frozen.condition_of( i ) != nullptr ) {
+				conditions.push_back( &frozen[ i ] );
+			}
+		}
+		counting_resource counter;
+		gld::hlsl::pp::expander e( frozen, &counter );
+		e();
+		std::vector<double> seconds;
+		seconds.reserve( repetitions );
+		conditions_result result{};
+		result.conditions = conditions.size();
+		std::size_t errors = e.errors().size();
+		for ( int i = -1; i < repetitions; ++i ) {
+			std::size_t allocations = counter.allocations;
+			std::size_t taken = 0;
+			auto start = std::chrono::steady_clock::now();
+			for ( const gld::hlsl::pp::frozen_node* condition : conditions ) {
+				taken += e.evaluate( *condition ) ? 1 : 0;
+			}
+			auto stop = std::chrono::steady_clock::now();
+			result.taken = taken;
+			result.errors = e.errors().size() - errors;
+			errors = e.errors().size();
+			if ( i >= 0 ) {
+				result.allocations += counter.allocations - allocations;
+				seconds.push_back( std::chrono::duration<double>( stop - start ).count() );
+			}
+		}
+		std::sort( seconds.begin(), seconds.end() );
+		result.median_seconds = seconds[ seconds.size() / 2 ];
+		result.min_seconds = seconds.front();
+		return result;
+	}
+
+	// Object-like and function-like macros over a handful of names, redefined, undefined and used in any order,
+	// with ## and # in some bodies, so cached expansions keep going stale
+	std::string random_program( std::mt19937& random ) {
+		const char* names[] = { "A", "B", "C", "F", "G", "H" };
+		auto pick = [ &random ]( int n ) {
+			return static_cast<int>( random() % static_cast<unsigned>( n ) );
+		};
+		auto atom = [ & ]() -> std::string {
+			int kind = pick( 8 );
+			if ( kind < 4 ) {
+				return names[ pick( 6 ) ];
+			}
+			if ( kind == 4 ) {
+				return "x";
+			}
+			if ( kind == 5 ) {
+				return "(1)";
+			}
+			if ( kind == 6 ) {
+				return std::string( names[ 3 + pick( 3 ) ] ) + "(" + names[ pick( 6 ) ] + ")";
+			}
+			return "y";
+		};
+		std::string text;
+		for ( int lines = 5 + pick( 25 ); lines-- > 0; ) {
+			int kind = pick( 10 );
+			if ( kind < 3 ) {
+				text += std::string( "#define " ) + names[ pick( 3 ) ] + " " + atom() + " " + atom() + "\n";
+			}
+			else if ( kind < 5 ) {
+				text += std::string( "#define " ) + names[ 3 + pick( 3 ) ] + "(p, q) p " + atom() + " q " + ( pick( 2 ) ? "p ## q" : "" ) + ( pick( 3 ) == 0 ? " #p" : "" ) + "\n";
+			}
+			else if ( kind < 6 ) {
+				text += std::string( "#undef " ) + names[ pick( 6 ) ] + "\n";
+			}
+			else {
+				for ( int uses = 1 + pick( 6 ); uses-- > 0; ) {
+					text += atom();
+					if ( pick( 3 ) == 0 ) {
+						text += "(" + atom() + "," + atom() + ")";
+					}
+					text += " ";
+				}
+				text += "\n";
+			}
+		}
+		return text;
+	}
+
+	struct expanded_program {
+		// Kept whole: pasted and stringized tokens are spelled into its arena
+		gld::hlsl::pp::expansion output;
+		std::vector<gld::hlsl::token> tokens;
+		std::size_t expansions;
+		std::size_t errors;
+		gld::hlsl::pp::expansion_cache_counters cache;
+	};
+
+	expanded_program expand_program( const gld::hlsl::pp::frozen_tree& frozen, bool caching ) {
+		gld::hlsl::pp::expander e( frozen );
+		e.use_cache( caching );
+		expanded_program result{ e(), {}, e.expansions(), e.errors().size(), e.cache_counters() };
+		result.output.for_each_token( [ &result ]( const gld::hlsl::token& t ) {
+			result.tokens.push_back( t );
+		} );
+		return result;
+	}
+
+	bool same_output( const expanded_program& left, const expanded_program& right ) {
+		if ( left.tokens.size() != right.tokens.size() || left.expansions != right.expansions || left.errors != right.errors ) {
+			return false;
+		}
+		for ( std::size_t i = 0; i < left.tokens.size(); ++i ) {
+			const gld::hlsl::token& l = left.tokens[ i ];
+			const gld::hlsl::token& r = right.tokens[ i ];
+			if ( l.id != r.id || l.where != r.where || l.lexeme != r.lexeme ) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// Returns the number of programs whose cached expansion differed from the uncached one; the first few are written to stderr
+	std::size_t verify_cache( unsigned seed, int programs ) {
+		std::mt19937 random( seed );
+		std::size_t mismatches = 0;
+		gld::hlsl::pp::expansion_cache_counters cache{};
+		for ( int i = 0; i < programs; ++i ) {
+			std::string text = random_program( random );
+			auto sources = std::make_shared<gld::hlsl::source_manager>();
+			gld::hlsl::file_id file = sources->add( "random", gld::string_view( text.data(), text.data() + text.size() ) );
+			gld::hlsl::pp::frozen_tree frozen = gld::hlsl::pp::freeze( gld::hlsl::pp::parse( sources, file, gld::hlsl::pp::error_mode::recover ) );
+			expanded_program uncached = expand_program( frozen, false );
+			expanded_program cached = expand_program( frozen, true );
+			cache.hits += cached.cache.hits;
+			cache.misses += cached.cache.misses;
+			cache.invalidations += cached.cache.invalidations;
+			cache.uncacheable += cached.cache.uncacheable;
+			cache.bypassed += cached.cache.bypassed;
+			if ( same_output( uncached, cached ) ) {
+				continue;
+			}
+			if ( mismatches++ < 3 ) {
+				std::fprintf( stderr, "cached expansion differs for program %d of seed %u:\n%s\n", i, seed, text.c_str() );
+			}
+		}
+		std::printf( "{\"benchmark\":\"pp.expand.verify\",\"seed\":%u,\"programs\":%d,\"mismatches\":%zu,"
+			"\"cache_hits\":%zu,\"cache_misses\":%zu,\"cache_invalidations\":%zu,\"cache_uncacheable\":%zu,\"cache_bypassed\":%zu}\n",
+			seed, programs, mismatches, cache.hits, cache.misses, cache.invalidations, cache.uncacheable, cache.bypassed );
+		return mismatches;
+	}
+
+	// An #if expression and what C makes of it
+	struct condition_case {
+		const char* expression;
+		bool expected;
+	};
+
+	// Returns the number of conditions that came out wrong, each of which is written to stderr
+	std::size_t verify_conditions() {
+		static const condition_case cases[] = {
+			// Too large for intmax_t, so a uintmax_t
+			{ "0xFFFFFFFFFFFFFFFF > 0", true },
+			{ "18446744073709551615 == -1", true },
+			// -1 becomes a uintmax_t beside 0u
+			{ "-1 < 0u", false },
+			{ "-1 < 0", true },
+			{ "-1 > 0u", true },
+			{ "-1 / 2u > 0", true },
+			{ "-1 % 3u == 0", true },
+			{ "1u - 2 > 0", true },
+			{ "-1 * 1u > 0", true },
+			{ "~0u == 0xFFFFFFFFFFFFFFFF", true },
+			{ "(0 | 1u) - 2 > 0", true },
+			// Fits in intmax_t without a suffix, so it stays signed
+			{ "0xFFFFFFFF + 1 == 0x100000000", true },
+			{ "-0x7FFFFFFFFFFFFFFF - 1 < 0", true },
+			// A shift takes its left operand's type alone
+			{ "-1 >> 63u == -1", true },
+			{ "(0u - 1) >> 63 == 1", true },
+			// Comparisons and logical operators give a signed int
+			{ "(1 < 2u) - 2 < 0", true },
+			{ "(1u && 1) - 2 < 0", true },
+			{ "!0u - 2 < 0", true },
+		};
+		// As written, as the value of an object-like macro, and through a call only expansion can answer
+		static const char* const forms[] = {
+			"#if %s\nyes\n#else\nno\n#endif\n",
+			"#define VALUE (%s)\n#if VALUE\nyes\n#else\nno\n#endif\n",
+			"#define SAME(x) x\n#if SAME(%s)\nyes\n#else\nno\n#endif\n",
+		};
+		std::size_t failures = 0;
+		std::size_t checked = 0;
+		for ( const condition_case& c : cases ) {
+			for ( const char* form : forms ) {
+				char text[ 256 ];
+				std::snprintf( text, sizeof( text ), form, c.expression );
+				auto sources = std::make_shared<gld::hlsl::source_manager>();
+				gld::hlsl::file_id file = sources->add( "condition", gld::string_view( text, text + std::strlen( text ) ) );
+				gld::hlsl::pp::frozen_tree frozen = gld::hlsl::pp::freeze( gld::hlsl::pp::parse( sources, file, gld::hlsl::pp::error_mode::recover ) );
+				expanded_program expanded = expand_program( frozen, true );
+				bool taken = std::any_of( expanded.tokens.begin(), expanded.tokens.end(), []( const gld::hlsl::token& t ) {
+					return t.lexeme == "yes";
+				} );
+				++checked;
+				if ( taken != c.expected || expanded.errors != 0 || frozen.errors().size() != 0 ) {
+					++failures;
+					std::fprintf( stderr, "#if %s should be %s, was %s with %zu errors:\n%s\n", c.expression, c.expected ? "true" : "false", taken ? "true" : "false",
+						expanded.errors + frozen.errors().size(), text );
+				}
+			}
+		}
+		std::printf( "{\"benchmark\":\"pp.conditions.verify\",\"conditions\":%zu,\"failures\":%zu}\n", checked, failures );
+		return failures;
+	}
+
+	void print_conditions( const benchmark_input& input, int repetitions, const conditions_result& result ) {
+		std::printf( "{\"benchmark\":\"pp.conditions\",\"input\":\"%s\",\"conditions\":%zu,\"taken\":%zu,\"errors\":%zu,"
+			"\"repetitions\":%d,\"median_seconds\":%.9f,\"min_seconds\":%.9f,\"nanoseconds_per_condition\":%.1f,\"allocations\":%zu}\n",
+			input.name.c_str(), result.conditions, result.taken, result.errors,
+			repetitions, result.median_seconds, result.min_seconds,
+			result.median_seconds * 1e9 / static_cast<double>( std::max<std::size_t>( result.conditions, 1 ) ), result.allocations );
+	}
+
+	void print_expand( const char* benchmark, const benchmark_input& input, int repetitions, const expand_result& result ) {
+		std::printf( "{\"benchmark\":\"%s\",\"input\":\"%s\",\"bytes\":%zu,\"output_tokens\":%zu,\"spans\":%zu,\"expansions\":%zu,\"errors\":%zu,"
+			"\"repetitions\":%d,\"median_seconds\":%.9f,\"min_seconds\":%.9f,\"tokens_per_second\":%.0f,\"allocations\":%zu,\"synthesized_tokens\":%zu,"
+			"\"cache_hits\":%zu,\"cache_misses\":%zu,\"cache_invalidations\":%zu,\"cache_uncacheable\":%zu,\"cache_bypassed\":%zu,\"cache_hit_rate\":%.3f}\n",
+			benchmark, input.name.c_str(), input.text.size(), result.output_tokens, result.spans, result.expansions, result.errors,
+			repetitions, result.median_seconds, result.min_seconds,
+			static_cast<double>( result.output_tokens ) / std::max( result.median_seconds, 1e-9 ), result.allocations, result.synthesized_tokens,
+			result.cache.hits, result.cache.misses, result.cache.invalidations, result.cache.uncacheable, result.cache.bypassed, result.cache.hit_rate() );
+	}
+
+	void print( const char* benchmark, const benchmark_input& input, int repetitions, const benchmark_result& result ) {
+		double directives = static_cast<double>( std::max<std::size_t>( input.directives, 1 ) );
+		std::printf( "{\"benchmark\":\"%s\",\"input\":\"%s\",\"bytes\":%zu,\"directives\":%zu,\"statements\":%zu,\"errors\":%zu,"
+			"\"repetitions\":%d,\"median_seconds\":%.9f,\"min_seconds\":%.9f,"
+			"\"allocations\":%zu,\"allocated_bytes\":%zu,\"allocations_per_directive\":%.3f}\n",
+			benchmark, input.name.c_str(), input.text.size(), input.directives, result.statements, result.errors,
+			repetitions, result.median_seconds, result.min_seconds,
+			result.allocations, result.allocated_bytes, static_cast<double>( result.allocations ) / directives );
+	}
+
+}
+
+int main( int argc, char* argv[] ) {
+	int repetitions = 10;
+	const char* only = nullptr;
+	bool verify = false;
+	bool verifyconditions = false;
+	unsigned seed = 1;
+	for ( int i = 1; i < argc; ++i ) {
+		if ( std::strcmp( argv[ i ], "--repetitions" ) == 0 && i + 1 < argc ) {
+			repetitions = std::max( 1, std::atoi( argv[ ++i ] ) );
+		}
+		else if ( std::strcmp( argv[ i ], "--only" ) == 0 && i + 1 < argc ) {
+			only = argv[ ++i ];
+		}
+		else if ( std::strcmp( argv[ i ], "--verify-cache" ) == 0 ) {
+			verify = true;
+		}
+		else if ( std::strcmp( argv[ i ], "--seed" ) == 0 && i + 1 < argc ) {
+			seed = static_cast<unsigned>( std::strtoul( argv[ ++i ], nullptr, 10 ) );
+		}
+		else if ( std::strcmp( argv[ i ], "--verify-conditions" ) == 0 ) {
+			verifyconditions = true;
+		}
+	}
+	if ( verify || verifyconditions ) {
+		std::size_t failures = 0;
+		if ( verify ) {
+			failures += verify_cache( seed, 3000 );
+		}
+		if ( verifyconditions ) {
+			failures += verify_conditions();
+		}
+		return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	std::vector<benchmark_input> inputs;
+	gld::string_view fluff = gld::hlsl::shaders::fluff::pre_processing;
+	gld::string_view nymph = gld::hlsl::shaders::sm40_level_93::nymph_batch;
+	inputs.push_back( make_input( "fluff_pre_processing", std::string( fluff.data(), fluff.data_end() ) ) );
+	inputs.push_back( make_input( "sm40_level_93_nymph_batch", std::string( nymph.data(), nymph.data_end() ) ) );
+	inputs.push_back( make_input( "function_defines", function_defines( generated_size ) ) );
+	inputs.push_back( make_input( "object_defines", object_defines( generated_size ) ) );
+	inputs.push_back( make_input( "conditional_chains", conditional_chains( generated_size ) ) );
+	inputs.push_back( make_input( "macro_heavy", macro_heavy( generated_size ) ) );
+	inputs.push_back( make_input( "object_uses", object_uses( generated_size ) ) );
+	inputs.push_back( make_input( "token_pastes", token_pastes( generated_size ) ) );
+
+	for ( const benchmark_input& input : inputs ) {
+		if ( only != nullptr && input.name != only ) {
+			continue;
+		}
+		print( "pp.parse", input, repetitions, run( input, repetitions, lex ) );
+		print( "pp.parse.packed", input, repetitions, run( input, repetitions, lex_packed ) );
+		print_expand( "pp.expand", input, repetitions, run_expand( input, repetitions, true ) );
+		print_expand( "pp.expand.uncached", input, repetitions, run_expand( input, repetitions, false ) );
+		print_conditions( input, repetitions, run_conditions( input, repetitions ) );
+	}
+	return 0;
+}
@@ -0,0 +1,355 @@
+#pragma once
+
+#include "numeric.hpp"
+#include "string.hpp"
+#include "character_table.hpp"
+
+#if defined( __AVX2__ )
+#define GLD_AVX2 1
+#else
+#define GLD_AVX2 0
+#endif // AVX2
+
+#if defined( __SSE2__ ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && _M_IX86_FP >= 2 )
+#define GLD_SSE2 1
+#else
+#define GLD_SSE2 0
+#endif // SSE2
+
+#if GLD_AVX2
+#include <immintrin.h>
+#elif GLD_SSE2
+#include <emmintrin.h>
+#endif // Intrinsics
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif // MSVC bit scans
+
+namespace gld {
+
+	inline uint32 first_set_bit( uint32 mask ) {
+#ifdef _MSC_VER
+		unsigned long index;
+		_BitScanForward( &index, mask );
+		return static_cast<uint32>( index );
+#else
+		return static_cast<uint32>( __builtin_ctz( mask ) );
+#endif // MSVC
+	}
+
+	// Matchers describe a byte-class test three ways: per byte, and over
+	// 16 or 32 byte lanes returning a movemask-style bit per matching byte.
+	// lookahead is how many bytes past each lane the test reads.
+
+	struct line_end_matcher {
+		// Line terminators in ASCII are 0x0A - 0x0D;
+		// every other terminator is multi-byte UTF-8, so stop on any high byte too
+		static const intz lookahead = 0;
+
+		bool operator()( const char* p ) const {
+			uint8 c = static_cast<uint8>( *p );
+			return static_cast<uint8>( c - 0x0A ) <= 3 || c >= 0x80;
+		}
+
+#if GLD_SSE2
+		uint32 operator()( __m128i v ) const {
+			__m128i t = _mm_sub_epi8( v, _mm_set1_epi8( 0x0A ) );
+			__m128i terminator = _mm_cmpeq_epi8( _mm_min_epu8( t, _mm_set1_epi8( 3 ) ), t );
+			return static_cast<uint32>( _mm_movemask_epi8( _mm_or_si128( terminator, v ) ) );
+		}
+#endif // SSE2
+
+#if GLD_AVX2
+		uint32 operator()( __m256i v ) const {
+			__m256i t = _mm256_sub_epi8( v, _mm256_set1_epi8( 0x0A ) );
+			__m256i terminator = _mm256_cmpeq_epi8( _mm256_min_epu8( t, _mm256_set1_epi8( 3 ) ), t );
+			return static_cast<uint32>( _mm256_movemask_epi8( _mm256_or_si256( terminator, v ) ) );
+		}
+#endif // AVX2
+	};
+
+	struct string_stop_matcher {
+		static const intz lookahead = 0;
+		char delimeter;
+
+		string_stop_matcher( char delimeter ) : delimeter( delimeter ) {
+
+		}
+
+		bool operator()( const char* p ) const {
+			return *p == delimeter || *p == '\\' || line_end_matcher()( p );
+		}
+
+#if GLD_SSE2
+		uint32 operator()( __m128i v ) const {
+			__m128i stops = _mm_or_si128( _mm_cmpeq_epi8( v, _mm_set1_epi8( delimeter ) ), _mm_cmpeq_epi8( v, _mm_set1_epi8( '\\' ) ) );
+			return static_cast<uint32>( _mm_movemask_epi8( stops ) ) | line_end_matcher()( v );
+		}
+#endif // SSE2
+
+#if GLD_AVX2
+		uint32 operator()( __m256i v ) const {
+			__m256i stops = _mm256_or_si256( _mm256_cmpeq_epi8( v, _mm256_set1_epi8( delimeter ) ), _mm256_cmpeq_epi8( v, _mm256_set1_epi8( '\\' ) ) );
+			return static_cast<uint32>( _mm256_movemask_epi8( stops ) ) | line_end_matcher()( v );
+		}
+#endif // AVX2
+	};
+
+	struct byte_matcher {
+		static const intz lookahead = 0;
+		char value;
+
+		byte_matcher( char value ) : value( value ) {
+
+		}
+
+		bool operator()( const char* p ) const {
+			return *p == value;
+		}
+
+#if GLD_SSE2
+		uint32 operator()( __m128i v ) const {
+			return static_cast<uint32>( _mm_movemask_epi8( _mm_cmpeq_epi8( v, _mm_set1_epi8( value ) ) ) );
+		}
+#endif // SSE2
+
+#if GLD_AVX2
+		uint32 operator()( __m256i v ) const {
+			return static_cast<uint32>( _mm256_movemask_epi8( _mm256_cmpeq_epi8( v, _mm256_set1_epi8( value ) ) ) );
+		}
+#endif // AVX2
+	};
+
+	struct non_blank_matcher {
+		static const intz lookahead = 0;
+
+		bool operator()( const char* p ) const {
+			return *p != ' ' && *p != '\t';
+		}
+
+#if GLD_SSE2
+		uint32 operator()( __m128i v ) const {
+			__m128i blanks = _mm_or_si128( _mm_cmpeq_epi8( v, _mm_set1_epi8( ' ' ) ), _mm_cmpeq_epi8( v, _mm_set1_epi8( '\t' ) ) );
+			return ~static_cast<uint32>( _mm_movemask_epi8( blanks ) ) & 0xFFFF;
+		}
+#endif // SSE2
+
+#if GLD_AVX2
+		uint32 operator()( __m256i v ) const {
+			__m256i blanks = _mm256_or_si256( _mm256_cmpeq_epi8( v, _mm256_set1_epi8( ' ' ) ), _mm256_cmpeq_epi8( v, _mm256_set1_epi8( '\t' ) ) );
+			return ~static_cast<uint32>( _mm256_movemask_epi8( blanks ) );
+		}
+#endif // AVX2
+	};
+
+	struct block_comment_end_matcher {
+		// Matches the '*' of a "*/" pair, so each lane peeks one byte further
+		static const intz lookahead = 1;
+
+		bool operator()( const char* p ) const {
+			return p[ 0 ] == '*' && p[ 1 ] == '/';
+		}
+
+#if GLD_SSE2
+		uint32 operator()( __m128i v, __m128i after ) const {
+			__m128i star = _mm_cmpeq_epi8( v, _mm_set1_epi8( '*' ) );
+			__m128i slash = _mm_cmpeq_epi8( after, _mm_set1_epi8( '/' ) );
+			return static_cast<uint32>( _mm_movemask_epi8( _mm_and_si128( star, slash ) ) );
+		}
+#endif // SSE2
+
+#if GLD_AVX2
+		uint32 operator()( __m256i v, __m256i after ) const {
+			__m256i star = _mm256_cmpeq_epi8( v, _mm256_set1_epi8( '*' ) );
+			__m256i slash = _mm256_cmpeq_epi8( after, _mm256_set1_epi8( '/' ) );
+			return static_cast<uint32>( _mm256_movemask_epi8( _mm256_and_si256( star, slash ) ) );
+		}
+#endif // AVX2
+	};
+
+	namespace detail {
+
+#if GLD_SSE2
+		template <typename Matcher>
+		inline uint32 match_lane( const Matcher& m, const char*, __m128i v, std::integral_constant<intz, 0> ) {
+			return m( v );
+		}
+
+		template <typename Matcher>
+		inline uint32 match_lane( const Matcher& m, const char* p, __m128i v, std::integral_constant<intz, 1> ) {
+			return m( v, _mm_loadu_si128( reinterpret_cast<const __m128i*>( p + 1 ) ) );
+		}
+#endif // SSE2
+
+#if GLD_AVX2
+		template <typename Matcher>
+		inline uint32 match_lane( const Matcher& m, const char*, __m256i v, std::integral_constant<intz, 0> ) {
+			return m( v );
+		}
+
+		template <typename Matcher>
+		inline uint32 match_lane( const Matcher& m, const char* p, __m256i v, std::integral_constant<intz, 1> ) {
+			return m( v, _mm256_loadu_si256( reinterpret_cast<const __m256i*>( p + 1 ) ) );
+		}
+#endif // AVX2
+
+	}
+
+	// Returns the first position in [first, last) the matcher accepts, or last.
+	// Lanes never read at or past last, so the tail is finished one byte at a time
+	template <typename Matcher>
+	inline const char* find_first( const char* first, const char* last, const Matcher& m ) {
+		typedef std::integral_constant<intz, Matcher::lookahead> lookahead;
+		last -= Matcher::lookahead;
+		if ( last <= first ) {
+			return last + Matcher::lookahead;
+		}
+#if GLD_AVX2
+		for ( ; last - first >= 32; first += 32 ) {
+			__m256i v = _mm256_loadu_si256( reinterpret_cast<const __m256i*>( first ) );
+			uint32 mask = detail::match_lane( m, first, v, lookahead() );
+			if ( mask != 0 ) {
+				return first + first_set_bit( mask );
+			}
+		}
+#endif // AVX2
+#if GLD_SSE2
+		for ( ; last - first >= 16; first += 16 ) {
+			__m128i v = _mm_loadu_si128( reinterpret_cast<const __m128i*>( first ) );
+			uint32 mask = detail::match_lane( m, first, v, lookahead() );
+			if ( mask != 0 ) {
+				return first + first_set_bit( mask );
+			}
+		}
+#endif // SSE2
+		for ( ; first != last; ++first ) {
+			if ( m( first ) ) {
+				return first;
+			}
+		}
+		return last + Matcher::lookahead;
+	}
+
+	inline const char* find_block_comment_end( const char* first, const char* last ) {
+		return find_first( first, last, block_comment_end_matcher() );
+	}
+
+	inline const char* find_line_end( const char* first, const char* last ) {
+		return find_first( first, last, line_end_matcher() );
+	}
+
+	inline const char* find_string_stop( const char* first, const char* last, code_point delimeter ) {
+		// Non-ASCII delimeters land on the high-byte stop anyway
+		return find_first( first, last, string_stop_matcher( delimeter < 0x80 ? static_cast<char>( delimeter ) : '\\' ) );
+	}
+
+	inline const char* find_byte( const char* first, const char* last, char value ) {
+		return find_first( first, last, byte_matcher( value ) );
+	}
+
+	inline const char* find_blank_end( const char* first, const char* last ) {
+		return find_first( first, last, non_blank_matcher() );
+	}
+
+	// Length of the well-formed UTF-8 sequence at first, which is decoded into c, or 0 when there is none:
+	// rejects stray continuation bytes, truncated sequences, overlong forms,
+	// surrogates and anything past U+10FFFF
+	inline intz decode_utf8_sequence( const char* first, const char* last, code_point& c ) {
+		uint8 lead = static_cast<uint8>( *first );
+		intz length;
+		code_point minimum;
+		if ( lead < 0x80 ) {
+			c = lead;
+			return 1;
+		}
+		else if ( ( lead & 0xE0 ) == 0xC0 ) {
+			length = 2;
+			minimum = 0x80;
+		}
+		else if ( ( lead & 0xF0 ) == 0xE0 ) {
+			length = 3;
+			minimum = 0x800;
+		}
+		else if ( ( lead & 0xF8 ) == 0xF0 ) {
+			length = 4;
+			minimum = 0x10000;
+		}
+		else {
+			return 0;
+		}
+		if ( last - first < length ) {
+			return 0;
+		}
+		c = lead & ( 0x7F >> length );
+		for ( intz i = 1; i < length; ++i ) {
+			uint8 trail = static_cast<uint8>( first[ i ] );
+			if ( ( trail & 0xC0 ) != 0x80 ) {
+				return 0;
+			}
+			c = ( c << 6 ) | ( trail & 0x3F );
+		}
+		if ( c < minimum || c > 0x10FFFF || ( c >= 0xD800 && c <= 0xDFFF ) ) {
+			return 0;
+		}
+		return length;
+	}
+
+	// Steps over one code point; a byte that starts no well-formed sequence is stepped over alone
+	// and reads as U+FFFD, so ill-formed text never throws the walk off its line breaks
+	inline code_point decode_utf8( const char*& first, const char* last ) {
+		code_point c;
+		intz length = decode_utf8_sequence( first, last, c );
+		if ( length == 0 ) {
+			++first;
+			return 0xFFFD;
+		}
+		first += length;
+		return c;
+	}
+
+	// Replays the "only whitespace since the last line terminator" state of stepping
+	// one code point at a time over [first, last); ASCII runs are checked in bulk
+	inline bool track_line_whitespace( const char* first, const char* last, bool linewhitespace ) {
+		while ( first != last ) {
+			const char* stop = find_line_end( first, last );
+			if ( linewhitespace && find_blank_end( first, stop ) != stop ) {
+				linewhitespace = false;
+			}
+			first = stop;
+			if ( first == last ) {
+				break;
+			}
+			character_type type = character_type_of( decode_utf8( first, last ) );
+			if ( has_character_type( type, character_type::line_terminator ) ) {
+				linewhitespace = true;
+			}
+			else if ( !has_character_type( type, character_type::whitespace ) ) {
+				linewhitespace = false;
+			}
+		}
+		return linewhitespace;
+	}
+
+	// Appends the offset of every line start in [first, last), relative to first.
+	// A "\r\n" pair ends a single line
+	template <typename Container>
+	inline void find_line_starts( const char* first, const char* last, Container& linestarts ) {
+		const char* origin = first;
+		while ( first != last ) {
+			first = find_line_end( first, last );
+			if ( first == last ) {
+				break;
+			}
+			code_point c = decode_utf8( first, last );
+			if ( !has_character_type( character_type_of( c ), character_type::line_terminator ) ) {
+				continue;
+			}
+			if ( c == '\r' && first != last && *first == '\n' ) {
+				continue;
+			}
+			linestarts.push_back( static_cast<uint32>( first - origin ) );
+		}
+	}
+
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "character_type.hpp"
+#include "numeric.hpp"
+#include "string.hpp"
+#include "unicode.hpp"
+#include <utility>
+
+namespace gld {
+
+	namespace detail {
+
+		// Mirrors the Unicode properties the lexers query, restricted to ASCII:
+		// id_start is ID_Start (letters only), id is ID_Continue (letters, digits, '_')
+		// and line_terminator/whitespace follow Unicode::is_line_terminator/is_white_space
+		constexpr uint8 classify_ascii( uint8 c ) {
+			return static_cast<uint8>(
+				( c >= '0' && c <= '9' ? 
+					static_cast<uint8>( character_type::numeric ) | static_cast<uint8>( character_type::id ) : 0 )
+				| ( ( c >= 'a' && c <= 'z' ) || ( c >= 'A' && c <= 'Z' ) ? 
+					static_cast<uint8>( character_type::id_start ) | static_cast<uint8>( character_type::id ) : 0 )
+				| ( c == '_' ? static_cast<uint8>( character_type::id ) : 0 )
+				| ( c >= 0x0A && c <= 0x0D ? 
+					static_cast<uint8>( character_type::line_terminator ) | static_cast<uint8>( character_type::whitespace ) : 0 )
+				| ( c == ' ' || c == '\t' ? static_cast<uint8>( character_type::whitespace ) : 0 )
+				| ( c == '#' || c == '@' || c == '>' || c == '<' || c == '=' || c == '&' 
+					|| c == '|' || c == '^' || c == '(' || c == ')' || c == '[' || c == ']' 
+					|| c == ',' || c == '+' || c == '*' || c == '%' || c == '/' || c == '-' 
+					|| c == '\\' || c == '"' || c == '\'' || c == ';' || c == '.' || c == '!' 
+					|| c == '}' || c == '{' ? static_cast<uint8>( character_type::symbol ) : 0 )
+			);
+		}
+
+		template <typename Indices>
+		struct ascii_table;
+
+		template <std::size_t... I>
+		struct ascii_table<std::index_sequence<I...>> {
+			static constexpr uint8 value[ sizeof...( I ) ] = { classify_ascii( static_cast<uint8>( I ) )... };
+		};
+
+		template <std::size_t... I>
+		constexpr uint8 ascii_table<std::index_sequence<I...>>::value[ sizeof...( I ) ];
+
+		typedef ascii_table<std::make_index_sequence<256>> character_table;
+
+	}
+
+	inline character_type ascii_character_type( uint8 c ) {
+		return static_cast<character_type>( detail::character_table::value[ c ] );
+	}
+
+	inline bool has_character_type( character_type set, character_type flag ) {
+		return ( static_cast<uint8>( set ) & static_cast<uint8>( flag ) ) != 0;
+	}
+
+	// Only code points above ASCII pay for the Unicode property lookups
+	inline character_type character_type_of( code_point c ) {
+		if ( c < 0x80 ) {
+			return ascii_character_type( static_cast<uint8>( c ) );
+		}
+		uint8 type = static_cast<uint8>( character_type::none );
+		if ( Unicode::is_line_terminator( c ) ) {
+			type |= static_cast<uint8>( character_type::line_terminator ) | static_cast<uint8>( character_type::whitespace );
+		}
+		else if ( Unicode::is_white_space( c ) ) {
+			type |= static_cast<uint8>( character_type::whitespace );
+		}
+		if ( Unicode::ucd::is_id_start( c ) ) {
+			type |= static_cast<uint8>( character_type::id_start );
+		}
+		if ( Unicode::ucd::is_id_continue( c ) ) {
+			type |= static_cast<uint8>( character_type::id );
+		}
+		return static_cast<character_type>( type );
+	}
+
+}
@@ -9,7 +9,9 @@ namespace gld {
 		numeric = 0x1,
 		symbol = 0x2,
 		id = 0x4,
-		whitespace = 0x8
+		whitespace = 0x8,
+		line_terminator = 0x10,
+		id_start = 0x20
 	};
 
 }
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "../numeric.hpp"
+#include <functional>
+
+namespace gld { namespace hlsl {
+
+	// An identifier interned into a string_pool: equal names always get equal ids,
+	// so comparing and hashing names is comparing and hashing one integer
+	// 0 is reserved for "not interned"
+	struct identifier_id {
+		uint32 index;
+
+		identifier_id() : index( 0 ) {
+
+		}
+
+		explicit identifier_id( uint32 index ) : index( index ) {
+
+		}
+
+		bool valid() const {
+			return index != 0;
+		}
+
+		bool operator==( const identifier_id& right ) const {
+			return index == right.index;
+		}
+
+		bool operator!=( const identifier_id& right ) const {
+			return index != right.index;
+		}
+
+		bool operator<( const identifier_id& right ) const {
+			return index < right.index;
+		}
+	};
+
+}}
+
+namespace std {
+
+	template <>
+	struct hash<gld::hlsl::identifier_id> {
+		std::size_t operator()( const gld::hlsl::identifier_id& id ) const {
+			return static_cast<std::size_t>( id.index );
+		}
+	};
+
+}
@@ -0,0 +1,197 @@
+#pragma once
+
+#include "../keyword_table.hpp"
+#include "token_id.hpp"
+
+namespace gld { namespace hlsl {
+
+	template <typename = void>
+	struct keyword_tables {
+		// Sorted by length, then bytewise: see keyword_table.hpp
+		static constexpr keyword<token_id> language[] = {
+			make_keyword( "*/", token_id::block_comment_end ),
+			make_keyword( "/*", token_id::block_comment_begin ),
+			make_keyword( "//", token_id::line_comment_begin ),
+			make_keyword( "do", token_id::flow_control_do ),
+			make_keyword( "if", token_id::flow_control_if ),
+			make_keyword( "in", token_id::in ),
+			make_keyword( "for", token_id::flow_control_for ),
+			make_keyword( "int", token_id::type_integer ),
+			make_keyword( "new", token_id::reserved_new ),
+			make_keyword( "out", token_id::out ),
+			make_keyword( "try", token_id::reserved_try ),
+			make_keyword( "auto", token_id::reserved_auto ),
+			make_keyword( "bool", token_id::type_bool ),
+			make_keyword( "call", token_id::call_attribute ),
+			make_keyword( "case", token_id::flow_control_case ),
+			make_keyword( "char", token_id::reserved_char ),
+			make_keyword( "else", token_id::flow_control_else ),
+			make_keyword( "enum", token_id::reserved_enum ),
+			make_keyword( "goto", token_id::reserved_goto ),
+			make_keyword( "half", token_id::type_half ),
+			make_keyword( "line", token_id::primitive_line ),
+			make_keyword( "long", token_id::reserved_long ),
+			make_keyword( "loop", token_id::loop_attribute ),
+			make_keyword( "pass", token_id::keyword_pass ),
+			make_keyword( "this", token_id::reserved_this ),
+			make_keyword( "uint", token_id::type_unsigned_integer ),
+			make_keyword( "#line", token_id::preprocessor_line ),
+			make_keyword( "break", token_id::flow_control_break ),
+			make_keyword( "catch", token_id::reserved_catch ),
+			make_keyword( "class", token_id::reserved_class ),
+			make_keyword( "const", token_id::keyword_const ),
+			make_keyword( "dword", token_id::type_dword ),
+			make_keyword( "float", token_id::type_float ),
+			make_keyword( "inout", token_id::inout ),
+			make_keyword( "point", token_id::primitive_point ),
+			make_keyword( "short", token_id::reserved_short ),
+			make_keyword( "snorm", token_id::snorm ),
+			make_keyword( "union", token_id::reserved_union ),
+			make_keyword( "unorm", token_id::unorm ),
+			make_keyword( "while", token_id::flow_control_while ),
+			make_keyword( "branch", token_id::branch_attribute ),
+			make_keyword( "buffer", token_id::type_buffer ),
+			make_keyword( "cs_4_0", token_id::profile_cs_40 ),
+			make_keyword( "cs_4_1", token_id::profile_cs_41 ),
+			make_keyword( "cs_5_0", token_id::profile_cs_50 ),
+			make_keyword( "cs_5_1", token_id::profile_cs_51 ),
+			make_keyword( "delete", token_id::reserved_delete ),
+			make_keyword( "double", token_id::type_double ),
+			make_keyword( "ds_5_0", token_id::profile_ds_50 ),
+			make_keyword( "ds_5_1", token_id::profile_ds_51 ),
+			make_keyword( "extern", token_id::keyword_extern ),
+			make_keyword( "fastop", token_id::fastop_attribute ),
+			make_keyword( "friend", token_id::reserved_friend ),
+			make_keyword( "gs_4_0", token_id::profile_gs_40 ),
+			make_keyword( "gs_4_1", token_id::profile_gs_41 ),
+			make_keyword( "gs_5_0", token_id::profile_gs_50 ),
+			make_keyword( "gs_5_1", token_id::profile_gs_51 ),
+			make_keyword( "hs_5_0", token_id::profile_hs_50 ),
+			make_keyword( "hs_5_1", token_id::profile_hs_51 ),
+			make_keyword( "inline", token_id::keyword_inline ),
+			make_keyword( "linear", token_id::linear ),
+			make_keyword( "matrix", token_id::type_matrix ),
+			make_keyword( "ps_2_0", token_id::profile_ps_20 ),
+			make_keyword( "ps_2_a", token_id::profile_ps_2a ),
+			make_keyword( "ps_2_b", token_id::profile_ps_2b ),
+			make_keyword( "ps_3_0", token_id::profile_ps_30 ),
+			make_keyword( "ps_4_0", token_id::profile_ps_40 ),
+			make_keyword( "ps_4_1", token_id::profile_ps_41 ),
+			make_keyword( "ps_5_0", token_id::profile_ps_50 ),
+			make_keyword( "ps_5_1", token_id::profile_ps_51 ),
+			make_keyword( "public", token_id::reserved_public ),
+			make_keyword( "return", token_id::flow_control_return ),
+			make_keyword( "sample", token_id::sample ),
+			make_keyword( "shared", token_id::shared ),
+			make_keyword( "signed", token_id::reserved_signed ),
+			make_keyword( "sizeof", token_id::reserved_sizeof ),
+			make_keyword( "static", token_id::keyword_static ),
+			make_keyword( "struct", token_id::keyword_struct ),
+			make_keyword( "unroll", token_id::unroll_attribute ),
+			make_keyword( "vector", token_id::type_vector ),
+			make_keyword( "vs_2_0", token_id::profile_vs_20 ),
+			make_keyword( "vs_2_a", token_id::profile_vs_2a ),
+			make_keyword( "vs_2_b", token_id::profile_vs_2b ),
+			make_keyword( "vs_3_0", token_id::profile_vs_30 ),
+			make_keyword( "vs_4_0", token_id::profile_vs_40 ),
+			make_keyword( "vs_4_1", token_id::profile_vs_41 ),
+			make_keyword( "vs_5_0", token_id::profile_vs_50 ),
+			make_keyword( "vs_5_1", token_id::profile_vs_51 ),
+			make_keyword( "Compile", token_id::keyword_compile_sm4 ),
+			make_keyword( "cbuffer", token_id::keyword_cbuffer ),
+			make_keyword( "compile", token_id::keyword_compile ),
+			make_keyword( "default", token_id::reserved_default ),
+			make_keyword( "discard", token_id::keyword_discard ),
+			make_keyword( "flatten", token_id::flatten_attribute ),
+			make_keyword( "lib_4_0", token_id::profile_lib_40 ),
+			make_keyword( "lib_4_1", token_id::profile_lib_41 ),
+			make_keyword( "lib_5_0", token_id::profile_lib_50 ),
+			make_keyword( "lib_5_1", token_id::profile_lib_51 ),
+			make_keyword( "lineadj", token_id::primitive_lineadj ),
+			make_keyword( "mutable", token_id::reserved_mutable ),
+			make_keyword( "precise", token_id::precise ),
+			make_keyword( "private", token_id::reserved_private ),
+			make_keyword( "sampler", token_id::keyword_sampler ),
+			make_keyword( "tbuffer", token_id::keyword_tbuffer ),
+			make_keyword( "texture", token_id::type_texture ),
+			make_keyword( "typedef", token_id::keyword_typedef ),
+			make_keyword( "uniform", token_id::uniform ),
+			make_keyword( "virtual", token_id::reserved_virtual ),
+			make_keyword( "continue", token_id::flow_control_continue ),
+			make_keyword( "explicit", token_id::reserved_explicit ),
+			make_keyword( "operator", token_id::reserved_operator ),
+			make_keyword( "ps_2_s_w", token_id::profile_ps_2sw ),
+			make_keyword( "register", token_id::keyword_register ),
+			make_keyword( "template", token_id::reserved_template ),
+			make_keyword( "triangle", token_id::primitive_triangle ),
+			make_keyword( "typename", token_id::reserved_typename ),
+			make_keyword( "unsigned", token_id::reserved_unsigned ),
+			make_keyword( "volatile", token_id::keyword_volatile ),
+			make_keyword( "vs_2_s_w", token_id::profile_vs_2sw ),
+			make_keyword( "Texture1D", token_id::type_texture_1d ),
+			make_keyword( "Texture2D", token_id::type_texture_2d ),
+			make_keyword( "Texture3D", token_id::type_texture_3d ),
+			make_keyword( "forcecase", token_id::forcecase_attribute ),
+			make_keyword( "interface", token_id::keyword_interface ),
+			make_keyword( "namespace", token_id::reserved_namespace ),
+			make_keyword( "protected", token_id::reserved_protected ),
+			make_keyword( "row_major", token_id::keyword_row_major ),
+			make_keyword( "sampler1D", token_id::type_sampler_1d ),
+			make_keyword( "sampler2D", token_id::type_sampler_2d ),
+			make_keyword( "sampler3D", token_id::type_sampler_3d ),
+			make_keyword( "technique", token_id::keyword_technique ),
+			make_keyword( "HullShader", token_id::keyword_hull_shader ),
+			make_keyword( "clipplanes", token_id::clipplanes ),
+			make_keyword( "const_cast", token_id::reserved_const_cast ),
+			make_keyword( "packoffset", token_id::keyword_packoffset ),
+			make_keyword( "PixelShader", token_id::keyword_pixel_shader ),
+			make_keyword( "TextureCube", token_id::type_texture_cube ),
+			make_keyword( "groupshared", token_id::groupshared ),
+			make_keyword( "samplerCUBE", token_id::type_sampler_cube ),
+			make_keyword( "static_cast", token_id::reserved_static_cast ),
+			make_keyword( "technique10", token_id::keyword_technique_sm4 ),
+			make_keyword( "technique11", token_id::keyword_technique_sm5 ),
+			make_keyword( "triangleadj", token_id::primitive_triangleadj ),
+			make_keyword( "DomainShader", token_id::keyword_domain_shader ),
+			make_keyword( "SamplerState", token_id::type_sampler_state_sm4 ),
+			make_keyword( "VertexShader", token_id::keyword_vertex_shader ),
+			make_keyword( "column_major", token_id::keyword_column_major ),
+			make_keyword( "dynamic_cast", token_id::reserved_dynamic_cast ),
+			make_keyword( "ComputeShader", token_id::keyword_compute_shader ),
+			make_keyword( "SetHullShader", token_id::keyword_hull_shader_sm4 ),
+			make_keyword( "noperspective", token_id::noperspective ),
+			make_keyword( "sampler_state", token_id::type_sampler_state ),
+			make_keyword( "ComparisonFunc", token_id::type_sampler_comparison_state_comparison_func ),
+			make_keyword( "GeometryShader", token_id::keyword_geometry_shader ),
+			make_keyword( "SetPixelShader", token_id::keyword_pixel_shader_sm4 ),
+			make_keyword( "Texture1DArray", token_id::type_texture_1d_array ),
+			make_keyword( "Texture2DArray", token_id::type_texture_2d_array ),
+			make_keyword( "maxvertexcount", token_id::maxvertexcount ),
+			make_keyword( "SetDomainShader", token_id::keyword_domain_shader_sm4 ),
+			make_keyword( "SetVertexShader", token_id::keyword_vertex_shader_sm4 ),
+			make_keyword( "nointerpolation", token_id::nointerpolation ),
+			make_keyword( "SetComputeShader", token_id::keyword_compute_shader_sm4 ),
+			make_keyword( "ps_4_0_level_9_0", token_id::profile_ps_40_level_90 ),
+			make_keyword( "ps_4_0_level_9_1", token_id::profile_ps_40_level_91 ),
+			make_keyword( "ps_4_0_level_9_3", token_id::profile_ps_40_level_93 ),
+			make_keyword( "reinterpret_case", token_id::reserved_reinterpret_cast ),
+			make_keyword( "vs_4_0_level_9_0", token_id::profile_vs_40_level_90 ),
+			make_keyword( "vs_4_0_level_9_1", token_id::profile_vs_40_level_91 ),
+			make_keyword( "vs_4_0_level_9_3", token_id::profile_vs_40_level_93 ),
+			make_keyword( "SetGeometryShader", token_id::keyword_geometry_shader_sm4 ),
+			make_keyword( "lib_4_0_level_9_0", token_id::profile_lib_40_level_90 ),
+			make_keyword( "lib_4_0_level_9_1", token_id::profile_lib_40_level_91 ),
+			make_keyword( "lib_4_0_level_9_3", token_id::profile_lib_40_level_93 ),
+			make_keyword( "allow_uav_condition", token_id::allow_uav_condition_attribute ),
+			make_keyword( "SamplerComparisonState", token_id::type_sampler_comparison_state )
+		};
+
+		static_assert( is_keyword_table_sorted( language ), "language keywords must be sorted by length, then by bytes" );
+	};
+
+	template <typename T>
+	constexpr keyword<token_id> keyword_tables<T>::language[];
+
+	typedef keyword_tables<> keywords;
+
+}}
@@ -1,10 +1,22 @@
+#pragma once
+
+#include "source_location.hpp"
 #include "../string.hpp"
 #include <exception>
 
 namespace gld { namespace hlsl { 
 
 	struct lexer_error : public std::exception {
+		string message;
+		source_location where;
+
+		lexer_error( source_location where = {}, string message = "undescribed lexing failure" ) : message( std::move( message ) ), where( where ) {
+
+		}
 
+		virtual const char* what() const noexcept override {
+			return message.c_str();
+		}
 	};
 
 }}
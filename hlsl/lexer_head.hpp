@@ -1,7 +1,9 @@
 #pragma once
 
-#include "occurrence.hpp"
+#include "source_location.hpp"
+#include "../numeric.hpp"
 #include "../string.hpp"
+#include "../character_type.hpp"
 
 namespace gld { namespace hlsl { 
 
@@ -11,7 +13,10 @@ namespace gld { namespace hlsl {
 		Iterator after_at;
 		code_point c;
 		code_point after_c;
-		occurrence where;
+		character_type type;
+		source_location where;
+		intz offset;
+		intz offset_after;
 		bool available;
 		bool after_available;
 		bool white_space;
@@ -22,7 +27,8 @@ namespace gld { namespace hlsl {
 
 		lexer_head( Iterator a ) : at( a ), after_at( a ), 
 		c( static_cast<code_point>( -1 ) ), after_c( static_cast<code_point>(-1) ),
-		where{},
+		type( character_type::none ),
+		where(), offset( 0 ), offset_after( 0 ),
 		available( true ),after_available( true ), 
 		white_space( true ), line_terminator( false ), compound_line_terminator( false ),
 		previous_line_whitespace( false ), line_whitespace( false ) {
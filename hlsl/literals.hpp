@@ -0,0 +1,306 @@
+#pragma once
+
+#include "token.hpp"
+#include "../numeric.hpp"
+#include "../optional.hpp"
+#include "../character_table.hpp"
+#include "../byte_scan.hpp"
+#include "../lexical_numeric_format.hpp"
+#include <algorithm>
+#include <string>
+#include <cstdlib>
+#include <limits>
+
+namespace gld { namespace hlsl {
+
+	struct numeric_literal {
+		token_id id;
+		token_value value;
+	};
+
+	// Finds the end of a preprocessing number starting at first: digits, letters, '_', '.',
+	// and a sign directly after a decimal exponent marker
+	inline const char* scan_numeric_literal( const char* first, const char* last ) {
+		bool hex = last - first > 1 && first[ 0 ] == '0' && ( first[ 1 ] == 'x' || first[ 1 ] == 'X' );
+		const char* p = first;
+		for ( ; p != last; ++p ) {
+			char c = *p;
+			if ( c != '.' && !has_character_type( ascii_character_type( static_cast<uint8>( c ) ), character_type::id ) ) {
+				break;
+			}
+			if ( !hex && ( c == 'e' || c == 'E' ) && p + 1 != last && ( p[ 1 ] == '+' || p[ 1 ] == '-' ) ) {
+				++p;
+			}
+		}
+		return p;
+	}
+
+	namespace detail {
+
+		inline intz digit_value( char c ) {
+			if ( c >= '0' && c <= '9' )
+				return c - '0';
+			if ( c >= 'a' && c <= 'f' )
+				return c - 'a' + 10;
+			if ( c >= 'A' && c <= 'F' )
+				return c - 'A' + 10;
+			return 16;
+		}
+
+		inline double parse_double_slow( const char* first, const char* last ) {
+			// strtod needs a terminated buffer, and the lexeme points into the middle of the source
+			char buffer[ 128 ];
+			std::size_t size = static_cast<std::size_t>( last - first );
+			if ( size < sizeof( buffer ) ) {
+				std::copy( first, last, buffer );
+				buffer[ size ] = '\0';
+				return std::strtod( buffer, nullptr );
+			}
+			std::string copy( first, last );
+			return std::strtod( copy.c_str(), nullptr );
+		}
+
+		inline numeric_literal make_integer( token_id id, uint64 value, bool unsignedsuffix, bool longsuffix, bool decimal ) {
+			if ( unsignedsuffix ) {
+				if ( !longsuffix && value <= std::numeric_limits<uint32>::max() )
+					return numeric_literal{ id, token_value( in_place_of<uint32>(), static_cast<uint32>( value ) ) };
+				return numeric_literal{ id, token_value( in_place_of<uint64>(), value ) };
+			}
+			if ( !longsuffix && value <= static_cast<uint64>( std::numeric_limits<int32>::max() ) )
+				return numeric_literal{ id, token_value( in_place_of<int32>(), static_cast<int32>( value ) ) };
+			// Like C, non-decimal literals may become unsigned before growing
+			if ( !longsuffix && !decimal && value <= std::numeric_limits<uint32>::max() )
+				return numeric_literal{ id, token_value( in_place_of<uint32>(), static_cast<uint32>( value ) ) };
+			if ( value <= static_cast<uint64>( std::numeric_limits<int64>::max() ) )
+				return numeric_literal{ id, token_value( in_place_of<int64>(), static_cast<int64>( value ) ) };
+			return numeric_literal{ id, token_value( in_place_of<uint64>(), value ) };
+		}
+
+	}
+
+	// Decodes a preprocessing number in one pass: hex (0x), binary (0b), octal (leading 0)
+	// and decimal integers with u/l/ll suffixes, and decimal floats with exponents and f/h/l/lf suffixes.
+	// A float without a suffix keeps double precision; the compiler narrows it where the context asks
+	// Anything malformed comes back as invalid_literal with no value
+	inline numeric_literal decode_numeric_literal( const char* first, const char* last ) {
+		static const double powers[] = {
+			1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+			1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+		};
+		const numeric_literal invalid{ token_id::invalid_literal, token_value() };
+		const char* p = first;
+		lexical_numeric_format format = lexical_numeric_format::decimal;
+		if ( last - p > 1 && p[ 0 ] == '0' ) {
+			if ( p[ 1 ] == 'x' || p[ 1 ] == 'X' ) {
+				format = lexical_numeric_format::hex;
+				p += 2;
+			}
+			else if ( p[ 1 ] == 'b' || p[ 1 ] == 'B' ) {
+				format = lexical_numeric_format::binary;
+				p += 2;
+			}
+			else if ( p[ 1 ] >= '0' && p[ 1 ] <= '9' ) {
+				format = lexical_numeric_format::octal;
+			}
+		}
+
+		uint64 value = 0;
+		bool overflow = false;
+		bool octalvalid = true;
+		intz digits = 0;
+		intz significant = 0;
+		intz exponent = 0;
+		bool floating = false;
+
+		if ( format == lexical_numeric_format::hex || format == lexical_numeric_format::binary ) {
+			uint64 base = format == lexical_numeric_format::hex ? 16 : 2;
+			for ( ; p != last; ++p, ++digits ) {
+				uint64 d = static_cast<uint64>( detail::digit_value( *p ) );
+				if ( d >= base )
+					break;
+				overflow |= value > ( std::numeric_limits<uint64>::max() - d ) / base;
+				value = value * base + d;
+			}
+			if ( digits == 0 || overflow )
+				return invalid;
+		}
+		else {
+			// Decimal and octal share a scan: "017" is octal, but "017.5" is a decimal float
+			uint64 integer = 0;
+			uint64 octal = 0;
+			for ( ; p != last && *p >= '0' && *p <= '9'; ++p, ++digits ) {
+				uint64 d = static_cast<uint64>( *p - '0' );
+				octalvalid &= d < 8;
+				overflow |= integer > ( std::numeric_limits<uint64>::max() - d ) / 10;
+				integer = integer * 10 + d;
+				octal = ( octal << 3 ) | ( d & 7 );
+				if ( significant < 19 ) {
+					if ( value != 0 || d != 0 ) {
+						++significant;
+					}
+					value = value * 10 + d;
+				}
+				else {
+					// Digits past what a uint64 holds exactly only scale the float
+					++exponent;
+				}
+			}
+			if ( p != last && *p == '.' ) {
+				floating = true;
+				for ( ++p; p != last && *p >= '0' && *p <= '9'; ++p, ++digits ) {
+					if ( significant < 19 ) {
+						if ( value != 0 || *p != '0' ) {
+							++significant;
+						}
+						value = value * 10 + static_cast<uint64>( *p - '0' );
+						--exponent;
+					}
+				}
+			}
+			if ( digits == 0 )
+				return invalid;
+			if ( p != last && ( *p == 'e' || *p == 'E' ) ) {
+				floating = true;
+				++p;
+				bool negativeexponent = false;
+				if ( p != last && ( *p == '+' || *p == '-' ) ) {
+					negativeexponent = *p == '-';
+					++p;
+				}
+				intz written = 0;
+				intz e = 0;
+				for ( ; p != last && *p >= '0' && *p <= '9'; ++p, ++written ) {
+					if ( e < 100000 ) {
+						e = e * 10 + ( *p - '0' );
+					}
+				}
+				if ( written == 0 )
+					return invalid;
+				exponent += negativeexponent ? -e : e;
+			}
+			if ( !floating ) {
+				if ( format == lexical_numeric_format::octal && !octalvalid )
+					return invalid;
+				// An octal literal never holds more than its decimal reading, so one overflow check covers both
+				value = format == lexical_numeric_format::octal ? octal : integer;
+			}
+		}
+
+		if ( floating ) {
+			const char* numberend = p;
+			char suffix = p != last ? *p++ : '\0';
+			// DXC spells double as lf as well as l
+			if ( ( suffix == 'l' || suffix == 'L' ) && p != last && ( *p == 'f' || *p == 'F' ) )
+				++p;
+			if ( p != last )
+				return invalid;
+			double d;
+			if ( value <= ( 1ull << 53 ) && exponent >= -22 && exponent <= 22 ) {
+				// Exact: both the mantissa and the power of ten are representable
+				d = static_cast<double>( value );
+				d = exponent < 0 ? d / powers[ -exponent ] : d * powers[ exponent ];
+			}
+			else {
+				d = detail::parse_double_slow( first, numberend );
+			}
+			switch ( suffix ) {
+			case 'f':
+			case 'F':
+				return numeric_literal{ token_id::float_literal, token_value( in_place_of<float>(), static_cast<float>( d ) ) };
+			case 'h':
+			case 'H':
+				return numeric_literal{ token_id::float_literal, token_value( in_place_of<half>(), half( static_cast<float>( d ) ) ) };
+			case '\0':
+			case 'l':
+			case 'L':
+				return numeric_literal{ token_id::float_literal, token_value( in_place_of<double>(), d ) };
+			default:
+				return invalid;
+			}
+		}
+
+		if ( overflow )
+			return invalid;
+		bool unsignedsuffix = false;
+		bool longsuffix = false;
+		for ( ; p != last; ++p ) {
+			if ( !unsignedsuffix && ( *p == 'u' || *p == 'U' ) ) {
+				unsignedsuffix = true;
+			}
+			else if ( !longsuffix && ( *p == 'l' || *p == 'L' ) ) {
+				longsuffix = true;
+				// ll and LL, never lL, say the same as l: a long is 64 bits already
+				if ( p + 1 != last && p[ 1 ] == *p ) {
+					++p;
+				}
+			}
+			else {
+				return invalid;
+			}
+		}
+		token_id id = format == lexical_numeric_format::hex ? token_id::integer_hex_literal
+			: format == lexical_numeric_format::octal ? token_id::integer_octal_literal
+			: token_id::integer_literal;
+		return detail::make_integer( id, value, unsignedsuffix, longsuffix, format == lexical_numeric_format::decimal );
+	}
+
+	// Decodes the text between the quotes of a character literal.
+	// Multi-character literals pack one byte per character, most significant first
+	inline optional<code_point> decode_character_literal( const char* first, const char* last ) {
+		if ( first == last ) {
+			return none;
+		}
+		code_point value = 0;
+		code_point single = 0;
+		intz count = 0;
+		for ( ; first != last; ++count ) {
+			code_point c;
+			if ( *first != '\\' ) {
+				c = decode_utf8( first, last );
+			}
+			else {
+				++first;
+				if ( first == last ) {
+					return none;
+				}
+				char e = *first++;
+				switch ( e ) {
+				case 'n': c = '\n'; break;
+				case 't': c = '\t'; break;
+				case 'r': c = '\r'; break;
+				case 'a': c = '\a'; break;
+				case 'b': c = '\b'; break;
+				case 'f': c = '\f'; break;
+				case 'v': c = '\v'; break;
+				case '\\': c = '\\'; break;
+				case '\'': c = '\''; break;
+				case '"': c = '"'; break;
+				case '?': c = '?'; break;
+				case 'x': {
+					c = 0;
+					intz count = 0;
+					for ( ; first != last && detail::digit_value( *first ) < 16; ++first, ++count ) {
+						c = ( c << 4 ) | static_cast<code_point>( detail::digit_value( *first ) );
+					}
+					if ( count == 0 || count > 8 ) {
+						return none;
+					}
+					break; }
+				case '0': case '1': case '2': case '3':
+				case '4': case '5': case '6': case '7': {
+					c = static_cast<code_point>( e - '0' );
+					for ( intz count = 1; count < 3 && first != last && *first >= '0' && *first <= '7'; ++first, ++count ) {
+						c = ( c << 3 ) | static_cast<code_point>( *first - '0' );
+					}
+					break; }
+				default:
+					return none;
+				}
+			}
+			single = c;
+			value = ( value << 8 ) | ( c & 0xFF );
+		}
+		return count == 1 ? single : value;
+	}
+
+}}
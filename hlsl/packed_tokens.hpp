@@ -0,0 +1,421 @@
+#pragma once
+
+#include "token.hpp"
+#include "../numeric.hpp"
+#include "../string.hpp"
+#include "../range.hpp"
+#include "../memory_resource.hpp"
+#include <vector>
+#include <algorithm>
+#include <iterator>
+#include <functional>
+
+namespace gld { namespace hlsl {
+
+	// Structure-of-arrays token storage: 14 bytes per token for the id, source offset, length
+	// and interned name (0 for anything but an identifier), with the rare other token values kept in a sparse side table
+	// Lexemes are rebuilt as views into the source the buffer was lexed from,
+	// and locations from the file's base location plus the stored offset
+	// The few lexemes broken across lines by a backslash-newline are spelled from the spliced line copies instead,
+	// where their start is kept in another sparse table
+	// Every array is allocated from the resource the buffer was made with
+	class packed_tokens {
+	private:
+		string_view source;
+		string_view spliced;
+		source_location base;
+		pmr::vector<uint16> ids;
+		pmr::vector<uint32> offsets;
+		pmr::vector<uint32> lengths;
+		pmr::vector<uint32> names;
+		pmr::vector<uint32> valueindices;
+		pmr::vector<token_value> values;
+		pmr::vector<uint32> splicedindices;
+		pmr::vector<uint32> splicedoffsets;
+
+		// Set in lengths for the lexemes spelled from spliced, and for the tokens marked spaced
+		static const uint32 spliced_bit = 0x80000000u;
+		static const uint32 spaced_bit = 0x40000000u;
+
+		static_assert( static_cast<std::size_t>( token_id::profile_lib_51 ) <= 0xFFFF, "token_id must fit in 16 bits for packed token storage" );
+
+		optional<std::size_t> value_slot( std::size_t i ) const {
+			auto found = std::lower_bound( valueindices.begin(), valueindices.end(), static_cast<uint32>( i ) );
+			if ( found == valueindices.end() || *found != i ) {
+				return none;
+			}
+			return static_cast<std::size_t>( std::distance( valueindices.begin(), found ) );
+		}
+
+	public:
+		// Tokens are rebuilt on every read, so the iterator hands them out by value
+		class const_iterator {
+		private:
+			const packed_tokens* buffer;
+			std::size_t index;
+
+		public:
+			typedef std::random_access_iterator_tag iterator_category;
+			typedef token value_type;
+			typedef std::ptrdiff_t difference_type;
+			typedef void pointer;
+			typedef token reference;
+
+			const_iterator( const packed_tokens* buffer = nullptr, std::size_t index = 0 ) : buffer( buffer ), index( index ) {
+
+			}
+
+			token operator*() const {
+				return ( *buffer )[ index ];
+			}
+
+			token operator[]( std::ptrdiff_t n ) const {
+				return ( *buffer )[ index + n ];
+			}
+
+			const_iterator& operator++() { ++index; return *this; }
+			const_iterator operator++( int ) { const_iterator r = *this; ++index; return r; }
+			const_iterator& operator--() { --index; return *this; }
+			const_iterator operator--( int ) { const_iterator r = *this; --index; return r; }
+			const_iterator& operator+=( std::ptrdiff_t n ) { index += n; return *this; }
+			const_iterator& operator-=( std::ptrdiff_t n ) { index -= n; return *this; }
+			const_iterator operator+( std::ptrdiff_t n ) const { return const_iterator( buffer, index + n ); }
+			const_iterator operator-( std::ptrdiff_t n ) const { return const_iterator( buffer, index - n ); }
+			std::ptrdiff_t operator-( const const_iterator& right ) const { return static_cast<std::ptrdiff_t>( index ) - static_cast<std::ptrdiff_t>( right.index ); }
+			bool operator==( const const_iterator& right ) const { return index == right.index; }
+			bool operator!=( const const_iterator& right ) const { return index != right.index; }
+			bool operator<( const const_iterator& right ) const { return index < right.index; }
+			bool operator>( const const_iterator& right ) const { return index > right.index; }
+			bool operator<=( const const_iterator& right ) const { return index <= right.index; }
+			bool operator>=( const const_iterator& right ) const { return index >= right.index; }
+		};
+
+		packed_tokens( string_view source = {}, string_view spliced = {}, source_location base = {}, pmr::memory_resource* resource = pmr::get_default_resource() )
+		: source( source ), spliced( spliced ), base( base ),
+			ids( resource ), offsets( resource ), lengths( resource ), names( resource ),
+			valueindices( resource ), values( resource ), splicedindices( resource ), splicedoffsets( resource ) {
+
+		}
+
+		void reserve( std::size_t n ) {
+			ids.reserve( n );
+			offsets.reserve( n );
+			lengths.reserve( n );
+			names.reserve( n );
+		}
+
+		// Drops every token but keeps the capacity, so a streaming lexer can reuse its window
+		void clear() {
+			ids.clear();
+			offsets.clear();
+			lengths.clear();
+			names.clear();
+			valueindices.clear();
+			values.clear();
+			splicedindices.clear();
+			splicedoffsets.clear();
+		}
+
+		// Drops the first count tokens in place, as a lexer does with the ones it already handed out
+		void erase_front( std::size_t count ) {
+			ids.erase( ids.begin(), ids.begin() + count );
+			offsets.erase( offsets.begin(), offsets.begin() + count );
+			lengths.erase( lengths.begin(), lengths.begin() + count );
+			names.erase( names.begin(), names.begin() + count );
+			erase_front_of( valueindices, values, count );
+			erase_front_of( splicedindices, splicedoffsets, count );
+		}
+
+		std::size_t size() const {
+			return ids.size();
+		}
+
+		bool empty() const {
+			return ids.empty();
+		}
+
+		const string_view& source_text() const {
+			return source;
+		}
+
+		token_id id( std::size_t i ) const {
+			return static_cast<token_id>( ids[ i ] );
+		}
+
+		uint32 offset( std::size_t i ) const {
+			return offsets[ i ];
+		}
+
+		uint32 length( std::size_t i ) const {
+			return lengths[ i ] & ~( spliced_bit | spaced_bit );
+		}
+
+		bool spaced( std::size_t i ) const {
+			return ( lengths[ i ] & spaced_bit ) != 0;
+		}
+
+		void set_spaced( std::size_t i ) {
+			lengths[ i ] |= spaced_bit;
+		}
+
+		buffer_view<const uint16> id_view() const {
+			return buffer_view<const uint16>( ids.data(), ids.size() );
+		}
+
+		// The interned name of an identifier token, or the invalid id for any other token
+		identifier_id identifier( std::size_t i ) const {
+			return identifier_id( names[ i ] );
+		}
+
+		buffer_view<const uint32> identifier_view() const {
+			return buffer_view<const uint32>( names.data(), names.size() );
+		}
+
+		string_view lexeme( std::size_t i ) const {
+			if ( ( lengths[ i ] & spliced_bit ) != 0 ) {
+				auto found = std::lower_bound( splicedindices.begin(), splicedindices.end(), static_cast<uint32>( i ) );
+				const char* first = spliced.data() + splicedoffsets[ std::distance( splicedindices.begin(), found ) ];
+				return string_view( first, first + length( i ) );
+			}
+			const char* first = source.data() + offsets[ i ];
+			return string_view( first, first + length( i ) );
+		}
+
+		bool has_value( std::size_t i ) const {
+			return names[ i ] != 0 || static_cast<bool>( value_slot( i ) );
+		}
+
+		token_value value( std::size_t i ) const {
+			if ( names[ i ] != 0 ) {
+				return token_value( identifier_id( names[ i ] ) );
+			}
+			optional<std::size_t> slot = value_slot( i );
+			if ( !slot ) {
+				return token_value( unit() );
+			}
+			return values[ slot.get() ];
+		}
+
+		void set_value( std::size_t i, token_value v ) {
+			if ( v.is<identifier_id>() ) {
+				names[ i ] = v.get<identifier_id>().index;
+				return;
+			}
+			auto found = std::lower_bound( valueindices.begin(), valueindices.end(), static_cast<uint32>( i ) );
+			std::size_t slot = static_cast<std::size_t>( std::distance( valueindices.begin(), found ) );
+			if ( found != valueindices.end() && *found == i ) {
+				values[ slot ] = std::move( v );
+				return;
+			}
+			// Values are almost always attached to the newest tokens, so this is an append
+			valueindices.insert( found, static_cast<uint32>( i ) );
+			values.insert( values.begin() + slot, std::move( v ) );
+		}
+
+		template <typename... Tn>
+		void emplace_back( token_id id, source_location where, string_view lexeme, Tn&&... argn ) {
+			uint32 length = static_cast<uint32>( std::distance( lexeme.data(), lexeme.data_end() ) );
+			ids.push_back( static_cast<uint16>( id ) );
+			if ( !lexeme.empty() && is_spliced( lexeme.data() ) ) {
+				splicedindices.push_back( static_cast<uint32>( ids.size() - 1 ) );
+				splicedoffsets.push_back( static_cast<uint32>( std::distance( spliced.data(), lexeme.data() ) ) );
+				offsets.push_back( where.raw - base.raw );
+				length |= spliced_bit;
+			}
+			else {
+				offsets.push_back( lexeme.empty() ? where.raw - base.raw : static_cast<uint32>( std::distance( source.data(), lexeme.data() ) ) );
+			}
+			lengths.push_back( length );
+			names.push_back( 0 );
+			emplace_value( std::forward<Tn>( argn )... );
+		}
+
+		source_location location( std::size_t i ) const {
+			return base.advanced( offsets[ i ] );
+		}
+
+		token operator[]( std::size_t i ) const {
+			token t( id( i ), location( i ), lexeme( i ), value( i ) );
+			t.spaced = spaced( i );
+			return t;
+		}
+
+		token back() const {
+			return ( *this )[ size() - 1 ];
+		}
+
+		const_iterator begin() const {
+			return const_iterator( this, 0 );
+		}
+
+		const_iterator end() const {
+			return const_iterator( this, size() );
+		}
+
+		std::vector<token> unpack() const {
+			std::vector<token> tokens;
+			tokens.reserve( size() );
+			unpack_into( 0, size(), tokens );
+			return tokens;
+		}
+
+		// Appends the count tokens from first to out, walking the value table alongside them
+		// rather than searching it once per token as operator[] does
+		void unpack_into( std::size_t first, std::size_t count, std::vector<token>& out ) const {
+			auto valueat = std::lower_bound( valueindices.begin(), valueindices.end(), static_cast<uint32>( first ) );
+			for ( std::size_t i = first; i < first + count; ++i ) {
+				out.emplace_back( id( i ), location( i ), lexeme( i ) );
+				token& t = out.back();
+				t.spaced = spaced( i );
+				if ( names[ i ] != 0 ) {
+					t.value = identifier_id( names[ i ] );
+				}
+				else if ( valueat != valueindices.end() && *valueat == i ) {
+					t.value = values[ std::distance( valueindices.begin(), valueat ) ];
+					++valueat;
+				}
+			}
+		}
+
+	private:
+		// Drops the sparse entries of the first count tokens and renumbers the rest
+		template <typename Entries>
+		static void erase_front_of( pmr::vector<uint32>& indices, Entries& entries, std::size_t count ) {
+			auto kept = std::lower_bound( indices.begin(), indices.end(), static_cast<uint32>( count ) );
+			std::ptrdiff_t dropped = std::distance( indices.begin(), kept );
+			indices.erase( indices.begin(), kept );
+			entries.erase( entries.begin(), entries.begin() + dropped );
+			for ( uint32& index : indices ) {
+				index -= static_cast<uint32>( count );
+			}
+		}
+
+		bool is_spliced( const char* p ) const {
+			std::less_equal<const char*> before;
+			return !spliced.empty() && before( spliced.data(), p ) && !before( spliced.data_end(), p );
+		}
+
+		void emplace_value() {
+
+		}
+
+		// Every identifier has a name, so names are kept densely rather than in the side table
+		void emplace_value( identifier_id name ) {
+			names.back() = name.index;
+		}
+
+		template <typename T0, typename... Tn>
+		void emplace_value( T0&& arg0, Tn&&... argn ) {
+			valueindices.push_back( static_cast<uint32>( ids.size() - 1 ) );
+			values.emplace_back( std::forward<T0>( arg0 ), std::forward<Tn>( argn )... );
+		}
+	};
+
+	// packed_tokens' reading interface over tokens stored whole, so code that reads tokens by position,
+	// like the parser, takes either storage
+	class unpacked_tokens {
+	private:
+		buffer_view<const token> tokens;
+
+	public:
+		unpacked_tokens() {
+
+		}
+
+		unpacked_tokens( buffer_view<const token> tokens ) : tokens( tokens ) {
+
+		}
+
+		std::size_t size() const {
+			return tokens.size();
+		}
+
+		bool empty() const {
+			return tokens.empty();
+		}
+
+		const token* data() const {
+			return tokens.data();
+		}
+
+		token_id id( std::size_t i ) const {
+			return tokens[ i ].id;
+		}
+
+		bool spaced( std::size_t i ) const {
+			return tokens[ i ].spaced;
+		}
+
+		identifier_id identifier( std::size_t i ) const {
+			return identifier_of( tokens[ i ] );
+		}
+
+		const string_view& lexeme( std::size_t i ) const {
+			return tokens[ i ].lexeme;
+		}
+
+		const token_value& value( std::size_t i ) const {
+			return tokens[ i ].value;
+		}
+
+		source_location location( std::size_t i ) const {
+			return tokens[ i ].where;
+		}
+
+		const token& operator[]( std::size_t i ) const {
+			return tokens[ i ];
+		}
+	};
+
+	template <typename Tokens>
+	inline Tokens make_token_storage( string_view, string_view, source_location, pmr::memory_resource* ) {
+		return Tokens();
+	}
+
+	template <>
+	inline packed_tokens make_token_storage<packed_tokens>( string_view source, string_view spliced, source_location base, pmr::memory_resource* resource ) {
+		return packed_tokens( source, spliced, base, resource );
+	}
+
+	template <>
+	inline pmr::vector<token> make_token_storage<pmr::vector<token>>( string_view, string_view, source_location, pmr::memory_resource* resource ) {
+		return pmr::vector<token>( resource );
+	}
+
+	inline void assign_value( std::vector<token>& tokens, std::size_t i, token_value value ) {
+		tokens[ i ].value = std::move( value );
+	}
+
+	inline void assign_value( pmr::vector<token>& tokens, std::size_t i, token_value value ) {
+		tokens[ i ].value = std::move( value );
+	}
+
+	inline void assign_value( packed_tokens& tokens, std::size_t i, token_value value ) {
+		tokens.set_value( i, std::move( value ) );
+	}
+
+	inline void mark_spaced( std::vector<token>& tokens, std::size_t i ) {
+		tokens[ i ].spaced = true;
+	}
+
+	inline void mark_spaced( pmr::vector<token>& tokens, std::size_t i ) {
+		tokens[ i ].spaced = true;
+	}
+
+	inline void mark_spaced( packed_tokens& tokens, std::size_t i ) {
+		tokens.set_spaced( i );
+	}
+
+	inline void erase_front( std::vector<token>& tokens, std::size_t count ) {
+		tokens.erase( tokens.begin(), tokens.begin() + count );
+	}
+
+	inline void erase_front( pmr::vector<token>& tokens, std::size_t count ) {
+		tokens.erase( tokens.begin(), tokens.begin() + count );
+	}
+
+	inline void erase_front( packed_tokens& tokens, std::size_t count ) {
+		tokens.erase_front( count );
+	}
+
+}}
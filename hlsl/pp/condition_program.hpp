@@ -0,0 +1,701 @@
+#pragma once
+
+#include "../token.hpp"
+#include "precedence.hpp"
+#include "../identifier.hpp"
+#include "../../numeric.hpp"
+#include "../../optional.hpp"
+#include "../../memory_resource.hpp"
+#include <algorithm>
+#include <limits>
+
+namespace gld { namespace hlsl { namespace pp {
+
+	enum class condition_op : uint8 {
+		// Pushes value
+		push,
+		// Pushes the value of the macro operand names, or 0 when it names none
+		name,
+		// Pushes 1 when operand names a macro, else 0
+		defined,
+		// A call of operand, which only means something once the macro it names is expanded; value is the name's token
+		call,
+		negate,
+		complement,
+		logical_not,
+		multiply,
+		divide,
+		modulus,
+		add,
+		subtract,
+		left_shift,
+		right_shift,
+		less,
+		greater,
+		less_equal,
+		greater_equal,
+		equal,
+		not_equal,
+		bitwise_and,
+		bitwise_xor,
+		bitwise_or,
+		// With the left operand on top: when it settles the result, jumps to operand leaving 0 (and) or 1 (or); else pops it
+		and_skip,
+		or_skip,
+		// The top as 0 or 1
+		to_bool,
+		// Pops, and jumps to operand when what it popped was 0
+		jump_if_false,
+		jump,
+	};
+
+	struct condition_instruction {
+		condition_op op;
+		// Whether push's value is a uintmax_t rather than an intmax_t (see condition_value)
+		bool is_unsigned;
+		// The identifier index for name, defined and call; the target, as an offset into the program, for jumps
+		uint32 operand;
+		int64 value;
+	};
+
+	// A value on an #if expression's stack. As in C, every operand is an intmax_t or a uintmax_t, int64 and uint64 here:
+	// value holds the bits either way, and is_unsigned says which of the two to read them as
+	struct condition_value {
+		int64 value;
+		bool is_unsigned;
+	};
+
+	// An #if or #elif expression compiled once with the tree: a run of instructions in a code array shared by every condition
+	struct condition_program {
+		uint32 first_instruction;
+		uint32 instruction_count;
+		// The most values the program has on its stack at once
+		uint32 depth;
+		// Which of the compiled tokens made it invalid, when error is not null
+		uint32 error_token;
+		const char* error;
+		// A single operand, like 1, (A + 2) or -X: it may stand in for a name inside another expression
+		// without precedence changing what it means
+		bool atomic;
+
+		bool valid() const {
+			return error == nullptr;
+		}
+	};
+
+	typedef pmr::vector<condition_instruction> condition_code;
+
+	// What running a program came to
+	enum class condition_result : uint8 {
+		value,
+		// A name or a call only means something once expanded as text, as the standard has it
+		needs_expansion,
+		division_by_zero,
+		// A call of something that is not a function-like macro
+		invalid,
+	};
+
+	// Whether an integer literal's suffix has a u in it: the decoded value's type only says how HLSL stores it,
+	// and a literal that fits in 32 bits unsigned may still be signed to #if
+	inline bool has_unsigned_suffix( string_view lexeme ) {
+		for ( const char* p = lexeme.data_end(); p != lexeme.data(); ) {
+			char c = *--p;
+			if ( c == 'u' || c == 'U' ) {
+				return true;
+			}
+			if ( c != 'l' && c != 'L' ) {
+				break;
+			}
+		}
+		return false;
+	}
+
+	// The value of an integer or character literal token as #if reads it; none for anything else.
+	// An integer literal is a uintmax_t when it has a 'u' suffix or is too large for an intmax_t, and an intmax_t otherwise
+	inline optional<condition_value> integer_of( const token& t ) {
+		const token_value& v = t.value;
+		bool suffixed = ( t.id == token_id::integer_literal || t.id == token_id::integer_octal_literal || t.id == token_id::integer_hex_literal )
+			&& has_unsigned_suffix( t.lexeme );
+		if ( v.is<int32>() ) {
+			return condition_value{ static_cast<int64>( v.get<int32>() ), suffixed };
+		}
+		if ( v.is<uint32>() ) {
+			return condition_value{ static_cast<int64>( v.get<uint32>() ), suffixed };
+		}
+		if ( v.is<int64>() ) {
+			return condition_value{ v.get<int64>(), suffixed };
+		}
+		if ( v.is<uint64>() ) {
+			uint64 value = v.get<uint64>();
+			return condition_value{ static_cast<int64>( value ), suffixed || value > static_cast<uint64>( std::numeric_limits<int64>::max() ) };
+		}
+		if ( v.is<int16>() ) {
+			return condition_value{ static_cast<int64>( v.get<int16>() ), suffixed };
+		}
+		if ( v.is<uint16>() ) {
+			return condition_value{ static_cast<int64>( v.get<uint16>() ), suffixed };
+		}
+		if ( v.is<int8>() ) {
+			return condition_value{ static_cast<int64>( v.get<int8>() ), suffixed };
+		}
+		if ( v.is<uint8>() ) {
+			return condition_value{ static_cast<int64>( v.get<uint8>() ), suffixed };
+		}
+		if ( v.is<code_point>() ) {
+			return condition_value{ static_cast<int64>( v.get<code_point>() ), false };
+		}
+		if ( v.is<bool>() ) {
+			return condition_value{ v.get<bool>() ? 1 : 0, false };
+		}
+		return none;
+	}
+
+	// Compiles #if expressions, by precedence climbing over precedence_of, into a condition_code.
+	// Tokens is anything with size() and an operator[] giving const token&, so the tree's tokens
+	// and the result of expanding a condition compile alike
+	class condition_compiler {
+	private:
+		condition_code& code;
+		condition_program program;
+		uint32 depth;
+
+		template <typename Tokens>
+		struct reader {
+			const Tokens& tokens;
+			uint32 at;
+
+			bool done() const {
+				return at >= tokens.size();
+			}
+
+			const token& current() const {
+				return tokens[ at ];
+			}
+		};
+
+		static bool is_blank( token_id id ) {
+			switch ( id ) {
+			case token_id::whitespace:
+			case token_id::newlines:
+			case token_id::preprocessor_escaped_newline:
+			case token_id::block_comment_begin:
+			case token_id::block_comment_end:
+			case token_id::line_comment_begin:
+			case token_id::line_comment_end:
+			case token_id::comment_text:
+			case token_id::preprocessor_statement_begin:
+			case token_id::preprocessor_statement_end:
+			case token_id::preprocessor_block_begin:
+			case token_id::preprocessor_block_end:
+				return true;
+			default:
+				break;
+			}
+			return false;
+		}
+
+		template <typename Tokens>
+		static void skip_blanks( reader<Tokens>& r ) {
+			while ( !r.done() && is_blank( r.current().id ) ) {
+				++r.at;
+			}
+		}
+
+		template <typename Tokens>
+		static bool next_is( reader<Tokens>& r, token_id id ) {
+			skip_blanks( r );
+			return !r.done() && r.current().id == id;
+		}
+
+		template <typename Tokens>
+		bool fail( const reader<Tokens>& r, const char* message ) {
+			if ( program.error == nullptr ) {
+				program.error = message;
+				program.error_token = r.done() ? ( r.tokens.size() == 0 ? 0 : static_cast<uint32>( r.tokens.size() - 1 ) ) : r.at;
+			}
+			return false;
+		}
+
+		uint32 emit( condition_op op, uint32 operand = 0, int64 value = 0, bool isunsigned = false ) {
+			code.push_back( condition_instruction{ op, isunsigned, operand, value } );
+			return static_cast<uint32>( code.size() - 1 );
+		}
+
+		void push( uint32 count = 1 ) {
+			depth += count;
+			program.depth = std::max( program.depth, depth );
+		}
+
+		// Points the jump at index to the next instruction emitted
+		void land( uint32 index ) {
+			code[ index ].operand = static_cast<uint32>( code.size() - program.first_instruction );
+		}
+
+		static optional<condition_op> binary_of( operation op ) {
+			switch ( op ) {
+			case operation::multiply:
+				return condition_op::multiply;
+			case operation::divide:
+				return condition_op::divide;
+			case operation::modulus:
+				return condition_op::modulus;
+			case operation::add:
+				return condition_op::add;
+			case operation::subtract:
+				return condition_op::subtract;
+			case operation::left_shift:
+				return condition_op::left_shift;
+			case operation::right_shift:
+				return condition_op::right_shift;
+			case operation::less_than:
+				return condition_op::less;
+			case operation::greater_than:
+				return condition_op::greater;
+			case operation::less_than_or_equal_to:
+				return condition_op::less_equal;
+			case operation::greater_than_or_equal_to:
+				return condition_op::greater_equal;
+			case operation::equal_to:
+				return condition_op::equal;
+			case operation::not_equal_to:
+				return condition_op::not_equal;
+			case operation::boolean_and:
+				return condition_op::bitwise_and;
+			case operation::boolean_xor:
+				return condition_op::bitwise_xor;
+			case operation::boolean_or:
+				return condition_op::bitwise_or;
+			case operation::expression_and:
+				return condition_op::and_skip;
+			case operation::expression_or:
+				return condition_op::or_skip;
+			default:
+				break;
+			}
+			return none;
+		}
+
+		// The lowest precedence of a binary operator
+		static intz lowest() {
+			return precedence_of( operation::expression_or ).precedence;
+		}
+
+		template <typename Tokens>
+		bool unary( reader<Tokens>& r ) {
+			skip_blanks( r );
+			if ( r.done() ) {
+				return fail( r, "expected a value in the #if expression" );
+			}
+			const token& t = r.current();
+			switch ( t.id ) {
+			case token_id::integer_literal:
+			case token_id::integer_octal_literal:
+			case token_id::integer_hex_literal:
+			{
+				optional<condition_value> value = integer_of( t );
+				if ( !value ) {
+					return fail( r, "invalid integer literal in the #if expression" );
+				}
+				++r.at;
+				emit( condition_op::push, 0, value.get().value, value.get().is_unsigned );
+				push();
+				return true;
+			}
+			case token_id::character_literal_begin:
+			{
+				++r.at;
+				if ( r.done() || r.current().id != token_id::character_literal ) {
+					return fail( r, "invalid character literal in the #if expression" );
+				}
+				optional<condition_value> value = integer_of( r.current() );
+				++r.at;
+				if ( !value || r.done() || r.current().id != token_id::character_literal_end ) {
+					return fail( r, "invalid character literal in the #if expression" );
+				}
+				++r.at;
+				emit( condition_op::push, 0, value.get().value, value.get().is_unsigned );
+				push();
+				return true;
+			}
+			case token_id::float_literal:
+				return fail( r, "floating-point literal in the #if expression" );
+			case token_id::identifier:
+			{
+				uint32 nameat = r.at;
+				identifier_id name = identifier_of( t );
+				++r.at;
+				if ( !next_is( r, token_id::open_parenthesis ) ) {
+					emit( condition_op::name, name.index );
+					push();
+					return true;
+				}
+				// The arguments are text for the macro, not expressions: only their parentheses are followed
+				uint32 parentheses = 0;
+				for ( ; !r.done(); ++r.at ) {
+					token_id id = r.current().id;
+					if ( id == token_id::open_parenthesis ) {
+						++parentheses;
+					}
+					else if ( id == token_id::close_parenthesis && --parentheses == 0 ) {
+						break;
+					}
+				}
+				if ( r.done() ) {
+					return fail( r, "expected ')' to end the call in the #if expression" );
+				}
+				++r.at;
+				emit( condition_op::call, name.index, nameat );
+				push();
+				return true;
+			}
+			case token_id::preprocessor_defined:
+			{
+				++r.at;
+				bool parenthesized = next_is( r, token_id::open_parenthesis );
+				if ( parenthesized ) {
+					++r.at;
+				}
+				if ( !next_is( r, token_id::identifier ) ) {
+					return fail( r, "expected a macro name after 'defined'" );
+				}
+				identifier_id name = identifier_of( r.current() );
+				++r.at;
+				if ( parenthesized ) {
+					if ( !next_is( r, token_id::close_parenthesis ) ) {
+						return fail( r, "expected ')' after the macro name in 'defined'" );
+					}
+					++r.at;
+				}
+				emit( condition_op::defined, name.index );
+				push();
+				return true;
+			}
+			case token_id::open_parenthesis:
+				++r.at;
+				if ( !conditional( r ) ) {
+					return false;
+				}
+				if ( !next_is( r, token_id::close_parenthesis ) ) {
+					return fail( r, "expected ')' in the #if expression" );
+				}
+				++r.at;
+				return true;
+			case token_id::plus:
+			case token_id::add:
+				++r.at;
+				return unary( r );
+			case token_id::minus:
+			case token_id::subtract:
+				++r.at;
+				if ( !unary( r ) ) {
+					return false;
+				}
+				emit( condition_op::negate );
+				return true;
+			case token_id::expression_negation:
+				++r.at;
+				if ( !unary( r ) ) {
+					return false;
+				}
+				emit( condition_op::logical_not );
+				return true;
+			case token_id::boolean_complement:
+				++r.at;
+				if ( !unary( r ) ) {
+					return false;
+				}
+				emit( condition_op::complement );
+				return true;
+			default:
+				break;
+			}
+			return fail( r, "unexpected token in the #if expression" );
+		}
+
+		// The binary operators after an operand already compiled, down to minimum precedence
+		template <typename Tokens>
+		bool binary( reader<Tokens>& r, intz minimum ) {
+			for ( ;; ) {
+				skip_blanks( r );
+				if ( r.done() ) {
+					return true;
+				}
+				optional<operation> maybeop = operator_of( r.current().id );
+				optional<condition_op> op = maybeop ? binary_of( maybeop.get() ) : none;
+				if ( !op ) {
+					return true;
+				}
+				intz precedence = precedence_of( maybeop.get() ).precedence;
+				if ( precedence < minimum ) {
+					return true;
+				}
+				++r.at;
+				if ( op.get() == condition_op::and_skip || op.get() == condition_op::or_skip ) {
+					uint32 skip = emit( op.get() );
+					--depth;
+					if ( !operand( r, precedence + 1 ) ) {
+						return false;
+					}
+					emit( condition_op::to_bool );
+					land( skip );
+					continue;
+				}
+				// Every binary operator here is left-associative
+				if ( !operand( r, precedence + 1 ) ) {
+					return false;
+				}
+				emit( op.get() );
+				--depth;
+			}
+		}
+
+		template <typename Tokens>
+		bool operand( reader<Tokens>& r, intz minimum ) {
+			return unary( r ) && binary( r, minimum );
+		}
+
+		// After its condition, a ?: is two conditionals: right-associative, so a ? b : c ? d : e is a ? b : ( c ? d : e )
+		template <typename Tokens>
+		bool choice( reader<Tokens>& r ) {
+			if ( !next_is( r, token_id::question_mark ) ) {
+				return true;
+			}
+			++r.at;
+			uint32 otherwise = emit( condition_op::jump_if_false );
+			--depth;
+			if ( !conditional( r ) ) {
+				return false;
+			}
+			if ( !next_is( r, token_id::colon ) ) {
+				return fail( r, "expected ':' in the #if expression" );
+			}
+			++r.at;
+			uint32 done = emit( condition_op::jump );
+			--depth;
+			land( otherwise );
+			if ( !conditional( r ) ) {
+				return false;
+			}
+			land( done );
+			return true;
+		}
+
+		template <typename Tokens>
+		bool conditional( reader<Tokens>& r ) {
+			return operand( r, lowest() ) && choice( r );
+		}
+
+	public:
+		explicit condition_compiler( condition_code& code ) : code( code ), program(), depth( 0 ) {
+
+		}
+
+		template <typename Tokens>
+		condition_program compile( const Tokens& tokens ) {
+			program = condition_program{ static_cast<uint32>( code.size() ), 0, 0, 0, nullptr, false };
+			depth = 0;
+			reader<Tokens> r{ tokens, 0 };
+			bool compiled = unary( r );
+			if ( compiled ) {
+				skip_blanks( r );
+				program.atomic = r.done();
+				compiled = binary( r, lowest() ) && choice( r );
+			}
+			if ( compiled ) {
+				skip_blanks( r );
+				if ( !r.done() ) {
+					fail( r, "missing binary operator in the #if expression" );
+				}
+			}
+			if ( !program.valid() ) {
+				// Nothing of a broken program is kept
+				code.resize( program.first_instruction );
+				program.atomic = false;
+			}
+			program.instruction_count = static_cast<uint32>( code.size() - program.first_instruction );
+			return program;
+		}
+	};
+
+	// Where programs keep their values: a program names runs for another goes on above it, and the values only ever grow,
+	// so once they are deep enough evaluating allocates nothing
+	struct condition_stack {
+		pmr::vector<condition_value> values;
+		std::size_t top;
+
+		explicit condition_stack( pmr::memory_resource* resource = pmr::get_default_resource() ) : values( resource ), top( 0 ) {
+
+		}
+	};
+
+	// Runs program, out of code, on stack. Names answers defined( identifier_id ) as a bool, and name( identifier_id, condition_value& )
+	// and call( identifier_id, uint32 token ) as condition_results; code may grow while they do, as it is indexed afresh each step.
+	// Arithmetic is C's, in int64 and uint64: an unsigned operand makes a binary operator unsigned, a shift takes its left operand's type,
+	// comparisons and logical operators give a signed 0 or 1, and overflow wraps rather than being undefined.
+	// A ?: takes the type of whichever branch it picks
+	template <typename Names>
+	inline condition_result evaluate_condition( const condition_code& code, const condition_program& program, condition_stack& values, Names& names, condition_value& result ) {
+		const uint32 first = program.first_instruction;
+		const uint32 count = program.instruction_count;
+		std::size_t base = values.top;
+		if ( values.values.size() < base + program.depth ) {
+			values.values.resize( std::max<std::size_t>( base + program.depth, values.values.size() * 2 ) );
+		}
+		values.top = base + program.depth;
+		// Indexed rather than held, as names may grow the values
+		pmr::vector<condition_value>& stack = values.values;
+		std::size_t top = base;
+		condition_result outcome = condition_result::value;
+		for ( uint32 i = 0; i < count; ) {
+			const condition_instruction instruction = code[ first + i++ ];
+			switch ( instruction.op ) {
+			case condition_op::push:
+				stack[ top++ ] = condition_value{ instruction.value, instruction.is_unsigned };
+				continue;
+			case condition_op::name:
+			{
+				condition_value value{ 0, false };
+				outcome = names.name( identifier_id( instruction.operand ), value );
+				if ( outcome != condition_result::value ) {
+					break;
+				}
+				stack[ top++ ] = value;
+				continue;
+			}
+			case condition_op::defined:
+				stack[ top++ ] = condition_value{ names.defined( identifier_id( instruction.operand ) ) ? 1 : 0, false };
+				continue;
+			case condition_op::call:
+				outcome = names.call( identifier_id( instruction.operand ), static_cast<uint32>( instruction.value ) );
+				break;
+			case condition_op::negate:
+				stack[ top - 1 ].value = static_cast<int64>( 0 - static_cast<uint64>( stack[ top - 1 ].value ) );
+				continue;
+			case condition_op::complement:
+				stack[ top - 1 ].value = ~stack[ top - 1 ].value;
+				continue;
+			case condition_op::logical_not:
+				stack[ top - 1 ] = condition_value{ stack[ top - 1 ].value == 0 ? 1 : 0, false };
+				continue;
+			case condition_op::to_bool:
+				stack[ top - 1 ] = condition_value{ stack[ top - 1 ].value != 0 ? 1 : 0, false };
+				continue;
+			case condition_op::and_skip:
+				if ( stack[ top - 1 ].value == 0 ) {
+					stack[ top - 1 ].is_unsigned = false;
+					i = instruction.operand;
+				}
+				else {
+					--top;
+				}
+				continue;
+			case condition_op::or_skip:
+				if ( stack[ top - 1 ].value != 0 ) {
+					stack[ top - 1 ] = condition_value{ 1, false };
+					i = instruction.operand;
+				}
+				else {
+					--top;
+				}
+				continue;
+			case condition_op::jump_if_false:
+				if ( stack[ --top ].value == 0 ) {
+					i = instruction.operand;
+				}
+				continue;
+			case condition_op::jump:
+				i = instruction.operand;
+				continue;
+			default:
+			{
+				condition_value right = stack[ --top ];
+				condition_value& left = stack[ top - 1 ];
+				uint64 l = static_cast<uint64>( left.value );
+				uint64 r = static_cast<uint64>( right.value );
+				bool isunsigned = left.is_unsigned || right.is_unsigned;
+				switch ( instruction.op ) {
+				case condition_op::multiply:
+					left = condition_value{ static_cast<int64>( l * r ), isunsigned };
+					break;
+				case condition_op::divide:
+				case condition_op::modulus:
+					if ( r == 0 ) {
+						outcome = condition_result::division_by_zero;
+						break;
+					}
+					if ( isunsigned ) {
+						left = condition_value{ static_cast<int64>( instruction.op == condition_op::divide ? l / r : l % r ), true };
+						break;
+					}
+					if ( right.value == -1 ) {
+						// The one quotient int64 cannot hold wraps, like the rest
+						left.value = instruction.op == condition_op::divide ? static_cast<int64>( 0 - l ) : 0;
+						break;
+					}
+					left.value = instruction.op == condition_op::divide ? left.value / right.value : left.value % right.value;
+					break;
+				case condition_op::add:
+					left = condition_value{ static_cast<int64>( l + r ), isunsigned };
+					break;
+				case condition_op::subtract:
+					left = condition_value{ static_cast<int64>( l - r ), isunsigned };
+					break;
+				case condition_op::left_shift:
+					// A negative count reads as a huge one, which shifts everything out
+					left.value = r >= 64 ? 0 : static_cast<int64>( l << r );
+					break;
+				case condition_op::right_shift:
+					if ( left.is_unsigned ) {
+						left.value = r >= 64 ? 0 : static_cast<int64>( l >> r );
+					}
+					else {
+						left.value = r >= 64 ? ( left.value < 0 ? -1 : 0 ) : left.value >> r;
+					}
+					break;
+				case condition_op::less:
+					left = condition_value{ ( isunsigned ? l < r : left.value < right.value ) ? 1 : 0, false };
+					break;
+				case condition_op::greater:
+					left = condition_value{ ( isunsigned ? l > r : left.value > right.value ) ? 1 : 0, false };
+					break;
+				case condition_op::less_equal:
+					left = condition_value{ ( isunsigned ? l <= r : left.value <= right.value ) ? 1 : 0, false };
+					break;
+				case condition_op::greater_equal:
+					left = condition_value{ ( isunsigned ? l >= r : left.value >= right.value ) ? 1 : 0, false };
+					break;
+				case condition_op::equal:
+					left = condition_value{ l == r ? 1 : 0, false };
+					break;
+				case condition_op::not_equal:
+					left = condition_value{ l != r ? 1 : 0, false };
+					break;
+				case condition_op::bitwise_and:
+					left = condition_value{ left.value & right.value, isunsigned };
+					break;
+				case condition_op::bitwise_xor:
+					left = condition_value{ left.value ^ right.value, isunsigned };
+					break;
+				case condition_op::bitwise_or:
+					left = condition_value{ left.value | right.value, isunsigned };
+					break;
+				default:
+					break;
+				}
+				if ( outcome != condition_result::value ) {
+					break;
+				}
+				continue;
+			}
+			}
+			// Only a failure gets here
+			break;
+		}
+		if ( outcome == condition_result::value ) {
+			result = stack[ base ];
+		}
+		values.top = base;
+		return outcome;
+	}
+
+}}}
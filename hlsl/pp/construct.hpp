@@ -1,14 +1,25 @@
 #pragma once
 
 #include "../token.hpp"
+#include "../../numeric.hpp"
 
 namespace gld { namespace hlsl { namespace pp {
 
+	// Consecutive tokens of a token buffer, by position
+	struct token_span {
+		uint32 first_token;
+		uint32 count;
+	};
+
+	// By position rather than by pointer, so the tree reads its tokens packed or whole alike
 	struct sequence {
-		buffer_view<const token> tokens;
+		token_span tokens;
+
+		sequence() : tokens{ 0, 0 } {
+
+		}
 
-		template <typename... Tn>
-		sequence( Tn&&... argn ) : tokens( std::forward<Tn>( argn )... ) {
+		sequence( token_span tokens ) : tokens( tokens ) {
 
 		}
 	};
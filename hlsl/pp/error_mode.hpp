@@ -0,0 +1,14 @@
+#pragma once
+
+namespace gld { namespace hlsl { namespace pp {
+
+	// How pp::lexer and pp::parser deal with broken source
+	enum class error_mode {
+		// Throw lexer_error / parser_error at the first problem
+		exceptions,
+		// Record every problem, mark it in the output (an invalid_* token, a parser_error node)
+		// and carry on from the next line or directive, so one pass reports everything
+		recover
+	};
+
+}}}
@@ -0,0 +1,1510 @@
+#pragma once
+
+#include "frozen_tree.hpp"
+#include "hide_set.hpp"
+#include "token_arena.hpp"
+#include "condition_program.hpp"
+#include "keywords.hpp"
+#include "parser_error.hpp"
+#include "conditional_origin.hpp"
+#include "../token.hpp"
+#include "../literals.hpp"
+#include "../../numeric.hpp"
+#include "../../character_table.hpp"
+#include "../../string.hpp"
+#include "../../memory_resource.hpp"
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <cstring>
+#include <functional>
+
+namespace gld { namespace hlsl { namespace pp {
+
+	// A translation unit after macro expansion, as runs of the token buffer it was parsed from:
+	// text with no macros in it is a single span, and each expansion adds the spans of its body and arguments.
+	// Positions past the end of the buffer are tokens pasting and stringizing made, held in synthesized
+	struct expansion {
+		buffer_view<const token> tokens;
+		std::shared_ptr<const token_arena> synthesized;
+		pmr::vector<token_span> spans;
+
+		explicit expansion( pmr::memory_resource* resource = pmr::get_default_resource() ) : spans( resource ) {
+
+		}
+
+		const token& token_at( uint32 index ) const {
+			return index < tokens.size() ? tokens[ index ] : ( *synthesized )[ index - tokens.size() ];
+		}
+
+		std::size_t token_count() const {
+			std::size_t count = 0;
+			for ( const token_span& span : spans ) {
+				count += span.count;
+			}
+			return count;
+		}
+
+		template <typename F>
+		void for_each_token( F&& f ) const {
+			for ( const token_span& span : spans ) {
+				for ( uint32 i = 0; i < span.count; ++i ) {
+					f( token_at( span.first_token + i ) );
+				}
+			}
+		}
+	};
+
+	struct macro_definition {
+		// The variable or function node in the frozen tree, or frozen_node::none while undefined
+		uint32 node;
+		macro_program program;
+	};
+
+	class expander;
+
+	struct expansion_cache_counters {
+		// Uses spliced from the cache
+		std::size_t hits;
+		// Uses expanded and then cached, including those whose entry had gone stale
+		std::size_t misses;
+		// Entries found stale, as a #define or #undef changed a name they were expanded with
+		std::size_t invalidations;
+		// Calls expanded in place without a lookup, to a macro whose calls seldom repeat
+		std::size_t bypassed;
+		// Uses expanded in place, as their expansion reported errors or left a macro name free to take arguments from the text after it
+		std::size_t uncacheable;
+
+		double hit_rate() const {
+			std::size_t lookups = hits + misses + uncacheable + bypassed;
+			return lookups == 0 ? 0.0 : static_cast<double>( hits ) / static_cast<double>( lookups );
+		}
+	};
+
+	// Chooses #ifdef, #ifndef, their #elif forms and #else from what is defined,
+	// and #if and #elif by running their compiled conditions against it
+	struct definition_conditions {
+		bool operator()( expander& e, const frozen_tree& frozen, const frozen_node& condition ) const;
+	};
+
+	// Object-like and function-like macro expansion over a frozen tree, with every argument expanded before it is
+	// substituted and every result rescanned along with the text after it (Prosser's algorithm).
+	// Tokens are never copied: the working set is pairs of token index and interned hide set, so painting a token blue
+	// is writing one integer, and what ## and # spell is kept in a token_arena and indexed past the end of the buffer.
+	// Working storage is kept between uses, and text with no macro in it is passed over in one scan,
+	// so a warmed-up expander only allocates as its output grows
+	class expander {
+	private:
+		struct expansion_token {
+			uint32 index;
+			hide_set hides;
+			// Whitespace comes before it where it now stands: as in the text for the text's own tokens,
+			// and as in the replacement, or before the macro's name, for tokens a replacement put there
+			bool spaced;
+		};
+
+		// One level of expansion: level 0 reads the tree's text, each deeper level pre-expands one argument.
+		// Tokens come off pending first, last token first, then off [cursor, limit) of the buffer itself,
+		// which is text no macro has touched yet
+		struct level {
+			// The tree's tokens, which cursor and limit index
+			const token* text;
+			pmr::vector<expansion_token> pending;
+			uint32 cursor;
+			uint32 limit;
+			pmr::vector<expansion_token> output;
+			// The call being replaced: its argument tokens in order, with each argument's extent among them,
+			// each argument once pre-expanded (count none until it is asked for), and the substituted body
+			pmr::vector<expansion_token> arguments;
+			pmr::vector<token_span> argumentbounds;
+			pmr::vector<expansion_token> expandedarguments;
+			pmr::vector<token_span> expandedbounds;
+			pmr::vector<expansion_token> substituted;
+
+			level( const token* text, pmr::memory_resource* resource ) : text( text ), pending( resource ), cursor( 0 ), limit( 0 ), output( resource ),
+			arguments( resource ), argumentbounds( resource ), expandedarguments( resource ), expandedbounds( resource ), substituted( resource ) {
+
+			}
+
+			bool empty() const {
+				return pending.empty() && cursor == limit;
+			}
+
+			std::size_t remaining() const {
+				return pending.size() + ( limit - cursor );
+			}
+
+			expansion_token next() {
+				if ( !pending.empty() ) {
+					expansion_token t = pending.back();
+					pending.pop_back();
+					return t;
+				}
+				uint32 index = cursor++;
+				return expansion_token{ index, 0, text[ index ].spaced };
+			}
+
+			expansion_token peek( std::size_t ahead ) const {
+				if ( ahead < pending.size() ) {
+					return pending[ pending.size() - 1 - ahead ];
+				}
+				uint32 index = cursor + static_cast<uint32>( ahead - pending.size() );
+				return expansion_token{ index, 0, text[ index ].spaced };
+			}
+
+			void skip( std::size_t count ) {
+				if ( count <= pending.size() ) {
+					pending.resize( pending.size() - count );
+					return;
+				}
+				cursor += static_cast<uint32>( count - pending.size() );
+				pending.clear();
+			}
+		};
+
+		// A use's expansion, worked out once in isolation and spliced in for every later use spelled the same way.
+		// An entry depends on every name looked up while it was expanded, defined or not,
+		// and is stale once any of them has been defined or undefined since
+		struct cache_entry {
+			identifier_id name;
+			// Into cachedtokens; for calls, tokens that came from an argument hold their position among the arguments
+			uint32 first;
+			uint32 count;
+			// Into cachedependencies
+			uint32 dependencyfirst;
+			uint32 dependencycount;
+			// Into cachedkeys and cachedkeybounds, for calls: the arguments of the call the entry was made from
+			uint32 keyfirst;
+			uint32 keycount;
+			uint32 boundsfirst;
+			uint32 boundscount;
+			// The generation the entry was expanded in, and the last in which it was found still good
+			uint32 built;
+			uint32 validated;
+			// Macro uses replaced in making it, so expansions() counts the same with or without the cache
+			uint32 expansions;
+			// False when the expansion reported errors or left a macro name free to take arguments from the text after it:
+			// such uses are expanded in place, but remembering so saves trying again
+			bool cacheable;
+		};
+
+		// How a macro's calls have fared in the cache since it was last defined: once enough have been tried,
+		// a macro whose calls hardly ever repeat is no longer looked up, as building entries nobody reuses costs more than it saves
+		struct call_statistics {
+			uint32 hits;
+			uint32 misses;
+		};
+
+		// An object-like macro's body as an #if operand, compiled the first time a condition asks for its value
+		struct value_program {
+			bool compiled;
+			// A single operand the body's one run of tokens makes: anything else is only understood expanded
+			bool usable;
+			condition_program program;
+		};
+
+		// What a condition's names and calls come to. Before expansion, an object-like macro is the value of its body;
+		// after it, a name left over is 0 and one followed by '(' is an error
+		struct condition_names {
+			expander& e;
+			bool expanded;
+			// The token of the call that was invalid, in the expanded text
+			uint32 invalidcall;
+
+			bool defined( identifier_id name ) const {
+				return e.is_defined( name );
+			}
+
+			condition_result name( identifier_id name, condition_value& value ) {
+				if ( expanded ) {
+					value = condition_value{ 0, false };
+					return condition_result::value;
+				}
+				return e.value_of( name, value );
+			}
+
+			condition_result call( identifier_id, uint32 token ) {
+				if ( expanded ) {
+					invalidcall = token;
+					return condition_result::invalid;
+				}
+				return condition_result::needs_expansion;
+			}
+		};
+
+		// The compiler's view of an expanded condition
+		struct expanded_condition {
+			const expander& e;
+			const pmr::vector<expansion_token>& tokens;
+
+			std::size_t size() const {
+				return tokens.size();
+			}
+
+			const token& operator[]( std::size_t i ) const {
+				return e.token_at( tokens[ i ].index );
+			}
+		};
+
+		static const uint32 argument_token = 0x80000000;
+		static const uint32 call_trial = 16;
+		static const std::size_t seen_bits = 1 << 16;
+
+		const frozen_tree& frozen;
+		buffer_view<const token> source;
+		pmr::memory_resource* resource;
+		// What pasting and stringizing made, shared with every expansion that shows it
+		std::shared_ptr<token_arena> synthesized;
+		// Where a pasted or stringized spelling is put together before the arena is asked for it
+		pmr::vector<char> spelling;
+		// Indexed by identifier: interned ids are dense, so finding a macro is one load
+		pmr::vector<macro_definition> macros;
+		hide_set_table hides;
+		std::vector<std::unique_ptr<level>> levels;
+		std::vector<parser_error> errorlist;
+		std::size_t expansioncount;
+		// Where level 0 writes
+		expansion* out;
+
+		bool caching;
+		// Bumped by every #define and #undef; namechanged holds, by identifier, the generation it last changed in
+		uint32 generation;
+		pmr::vector<uint32> namechanged;
+		pmr::vector<cache_entry> cacheentries;
+		pmr::vector<expansion_token> cachedtokens;
+		pmr::vector<uint32> cachedependencies;
+		pmr::vector<expansion_token> cachedkeys;
+		pmr::vector<token_span> cachedkeybounds;
+		// Entry + 1 by identifier, for object-like macros; by the hash of name and arguments, for calls
+		pmr::vector<uint32> objectcache;
+		pmr::unordered_map<uint64, uint32> callcache;
+		pmr::vector<call_statistics> callstatistics;
+		// Calls seen once, by key, as bits of a filter that may err towards "seen": only the second sighting builds an entry,
+		// so a call made just once costs a hash rather than a copy of its expansion
+		pmr::vector<uint64> seencalls;
+		// Names looked up by the cache entries being built, innermost last; recording counts how many are being built
+		pmr::vector<uint32> dependencies;
+		std::size_t recording;
+		expansion_cache_counters counters;
+		// By definition node; empty until a condition first needs a macro's value
+		pmr::vector<value_program> valueprograms;
+		condition_code valuecode;
+		// An expanded condition's program, compiled afresh each time
+		condition_code scratchcode;
+		condition_stack conditionstack;
+		// The object-like macros whose values are being taken, innermost last
+		pmr::vector<uint32> evaluating;
+		pmr::vector<expansion_token> conditiontext;
+
+		static bool is_marker( token_id id ) {
+			switch ( id ) {
+			case token_id::stream_begin:
+			case token_id::stream_end:
+			case token_id::preprocessor_block_begin:
+			case token_id::preprocessor_block_end:
+			case token_id::preprocessor_statement_begin:
+			case token_id::preprocessor_statement_end:
+				return true;
+			default:
+				break;
+			}
+			return false;
+		}
+
+		// What may sit between a function-like macro's name and its '(', or around an argument
+		static bool is_blank( token_id id ) {
+			switch ( id ) {
+			case token_id::whitespace:
+			case token_id::newlines:
+			case token_id::preprocessor_escaped_newline:
+			case token_id::block_comment_begin:
+			case token_id::block_comment_end:
+			case token_id::line_comment_begin:
+			case token_id::line_comment_end:
+			case token_id::comment_text:
+				return true;
+			default:
+				break;
+			}
+			return is_marker( id );
+		}
+
+		const token& token_at( uint32 index ) const {
+			return index < source.size() ? source[ index ] : ( *synthesized )[ index - source.size() ];
+		}
+
+		level& level_at( std::size_t depth ) {
+			while ( levels.size() <= depth ) {
+				levels.emplace_back( new level( source.data(), resource ) );
+			}
+			return *levels[ depth ];
+		}
+
+		static string spelling_of( const token& t ) {
+			return string( t.lexeme.data(), t.lexeme.data_end() );
+		}
+
+		string name_of( expansion_token name ) const {
+			return spelling_of( token_at( name.index ) );
+		}
+
+		const macro_definition* expandable( const token& t ) const {
+			if ( t.id != token_id::identifier ) {
+				return nullptr;
+			}
+			identifier_id name = identifier_of( t );
+			return find( name );
+		}
+
+		void emit_span( uint32 first, uint32 count ) {
+			if ( count == 0 ) {
+				return;
+			}
+			pmr::vector<token_span>& spans = out->spans;
+			if ( !spans.empty() && spans.back().first_token + spans.back().count == first ) {
+				spans.back().count += count;
+				return;
+			}
+			spans.push_back( token_span{ first, count } );
+		}
+
+		void emit( std::size_t depth, expansion_token t ) {
+			if ( is_marker( token_at( t.index ).id ) ) {
+				return;
+			}
+			if ( depth == 0 ) {
+				emit_span( t.index, 1 );
+				return;
+			}
+			level_at( depth ).output.push_back( t );
+		}
+
+		uint32 trimmed_first( const pmr::vector<expansion_token>& tokens, token_span bounds ) const {
+			uint32 first = bounds.first_token;
+			uint32 last = first + bounds.count;
+			while ( first < last && is_blank( token_at( tokens[ first ].index ).id ) ) {
+				++first;
+			}
+			return first;
+		}
+
+		uint32 trimmed_last( const pmr::vector<expansion_token>& tokens, uint32 first, token_span bounds ) const {
+			uint32 last = bounds.first_token + bounds.count;
+			while ( last > first && is_blank( token_at( tokens[ last - 1 ].index ).id ) ) {
+				--last;
+			}
+			return last;
+		}
+
+		// Expands the arguments as text of their own, the way they are substituted unless they meet # or ##
+		const token_span& expanded_argument( std::size_t depth, uint32 parameter ) {
+			level& call = level_at( depth );
+			token_span& expanded = call.expandedbounds[ parameter ];
+			if ( expanded.count != frozen_node::none ) {
+				return expanded;
+			}
+			level& inner = level_at( depth + 1 );
+			inner.pending.clear();
+			inner.cursor = 0;
+			inner.limit = 0;
+			inner.output.clear();
+			const token_span& bounds = call.argumentbounds[ parameter ];
+			for ( uint32 i = bounds.first_token + bounds.count; i-- > bounds.first_token; ) {
+				inner.pending.push_back( call.arguments[ i ] );
+			}
+			expand( depth + 1 );
+			// expand may have grown the level list, but levels are held by pointer, so call and inner are still good
+			expanded.first_token = static_cast<uint32>( call.expandedarguments.size() );
+			expanded.count = static_cast<uint32>( inner.output.size() );
+			call.expandedarguments.insert( call.expandedarguments.end(), inner.output.begin(), inner.output.end() );
+			return expanded;
+		}
+
+		// Whitespace at either end of a replacement is not part of it;
+		// its first token stands where the macro's name stood, spaced as that was
+		void push_reversed( level& l, const pmr::vector<expansion_token>& tokens, bool spaced ) {
+			std::size_t first = 0;
+			std::size_t last = tokens.size();
+			while ( first < last && is_blank( token_at( tokens[ first ].index ).id ) ) {
+				++first;
+			}
+			while ( last > first && is_blank( token_at( tokens[ last - 1 ].index ).id ) ) {
+				--last;
+			}
+			for ( std::size_t i = last; i-- > first; ) {
+				l.pending.push_back( tokens[ i ] );
+			}
+			if ( last != first ) {
+				l.pending.back().spaced = spaced;
+			}
+		}
+
+		void replace_object( std::size_t depth, expansion_token name, identifier_id id, const macro_definition& m ) {
+			level& l = level_at( depth );
+			hide_set painted = hides.with( name.hides, id );
+			buffer_view<const macro_instruction> code = frozen.instructions_of( m.program );
+			if ( code.size() == 1 ) {
+				// The usual replacement, one run of tokens: pushed straight on, last first
+				const macro_instruction& instruction = code[ 0 ];
+				for ( uint32 i = instruction.operand + instruction.count; i-- > instruction.operand; ) {
+					l.pending.push_back( expansion_token{ i, painted, source[ i ].spaced } );
+				}
+				if ( instruction.count != 0 ) {
+					l.pending.back().spaced = name.spaced;
+				}
+			}
+			else if ( !code.empty() ) {
+				substitute( depth, m, painted );
+				push_reversed( l, l.substituted, name.spaced );
+			}
+			++expansioncount;
+		}
+
+		void substitute_verbatim( level& call, uint32 parameter, hide_set painted ) {
+			const token_span& bounds = call.argumentbounds[ parameter ];
+			for ( uint32 i = 0; i < bounds.count; ++i ) {
+				expansion_token t = call.arguments[ bounds.first_token + i ];
+				call.substituted.push_back( expansion_token{ t.index, hides.join( t.hides, painted ), t.spaced } );
+			}
+		}
+
+		// The interned name spelled [first, last): pasting may make a name no token in the buffer had,
+		// and those are never interned, as no macro can be called by them
+		identifier_id name_for( const char* first, const char* last ) {
+			const source_manager* sources = frozen.sources();
+			if ( sources == nullptr ) {
+				return synthesized->find_name( source, first, last );
+			}
+			optional<identifier_id> name = sources->names().find( string_view( first, last ) );
+			return name ? name.get() : identifier_id();
+		}
+
+		// The arena's token spelled [first, last) as id, made on first use
+		uint32 synthesize( token_id id, source_location where, const char* first, const char* last ) {
+			token_arena& arena = *synthesized;
+			uint32 i = arena.find( id, first, last );
+			if ( i == token_arena::none ) {
+				i = arena.add( id, where, first, last, id == token_id::identifier ? token_value( name_for( first, last ) ) : token_value( unit() ) );
+			}
+			return static_cast<uint32>( source.size() ) + i;
+		}
+
+		static bool is_name_start( uint8 c ) {
+			return c == '_' || c >= 0x80 || has_character_type( ascii_character_type( c ), character_type::id_start );
+		}
+
+		static bool is_name_part( uint8 c ) {
+			return c >= 0x80 || has_character_type( ascii_character_type( c ), character_type::id );
+		}
+
+		// The one token left and right spell together, or token_arena::none when they spell none
+		uint32 paste( const token& left, const token& right ) {
+			spelling.assign( left.lexeme.data(), left.lexeme.data_end() );
+			spelling.insert( spelling.end(), right.lexeme.data(), right.lexeme.data_end() );
+			if ( spelling.empty() ) {
+				return token_arena::none;
+			}
+			const char* first = spelling.data();
+			const char* last = first + spelling.size();
+			uint8 c = static_cast<uint8>( *first );
+			bool digit = has_character_type( ascii_character_type( c ), character_type::numeric );
+			if ( digit || ( c == '.' && last - first > 1 && has_character_type( ascii_character_type( static_cast<uint8>( first[ 1 ] ) ), character_type::numeric ) ) ) {
+				if ( scan_numeric_literal( first, last ) != last ) {
+					return token_arena::none;
+				}
+				// Decoded as the lexer decodes it, as the kind of literal depends on the whole spelling
+				numeric_literal literal = decode_numeric_literal( first, last );
+				token_arena& arena = *synthesized;
+				uint32 i = arena.find( literal.id, first, last );
+				if ( i == token_arena::none ) {
+					i = arena.add( literal.id, left.where, first, last, std::move( literal.value ) );
+				}
+				return static_cast<uint32>( source.size() ) + i;
+			}
+			if ( is_name_start( c ) ) {
+				for ( const char* p = first; p != last; ++p ) {
+					if ( !is_name_part( static_cast<uint8>( *p ) ) ) {
+						return token_arena::none;
+					}
+				}
+				optional<token_id> keyword = find_keyword( keywords::directives, first, last );
+				return synthesize( keyword ? keyword.get() : token_id::identifier, left.where, first, last );
+			}
+			optional<token_id> punctuator = find_keyword( keywords::pasted_punctuators, first, last );
+			if ( punctuator ) {
+				return synthesize( punctuator.get(), left.where, first, last );
+			}
+			return token_arena::none;
+		}
+
+		// Joins the token before at to the token at, which starts the right operand of a ##
+		void join( level& call, std::size_t at ) {
+			expansion_token left = call.substituted[ at - 1 ];
+			expansion_token right = call.substituted[ at ];
+			const token& lefttoken = token_at( left.index );
+			const token& righttoken = token_at( right.index );
+			uint32 pasted = paste( lefttoken, righttoken );
+			if ( pasted == token_arena::none ) {
+				// Both are left as they were
+				report( parser_error( lefttoken.where, "pasting '" + spelling_of( lefttoken ) + "' and '" + spelling_of( righttoken ) + "' does not give a valid token" ) );
+				return;
+			}
+			call.substituted[ at - 1 ] = expansion_token{ pasted, hides.intersect( left.hides, right.hides ), left.spaced };
+			call.substituted.erase( call.substituted.begin() + at );
+		}
+
+		// An argument as # spells it, into spelling: each run of whitespace and comments is one space,
+		// and '"' and '\' inside string and character literals are escaped
+		void spell_string( const level& call, const token_span& bounds ) {
+			spelling.clear();
+			bool space = false;
+			for ( uint32 i = 0; i < bounds.count; ++i ) {
+				const expansion_token& e = call.arguments[ bounds.first_token + i ];
+				const token& t = token_at( e.index );
+				if ( is_blank( t.id ) ) {
+					space = !spelling.empty();
+					continue;
+				}
+				if ( ( space || e.spaced ) && !spelling.empty() ) {
+					spelling.push_back( ' ' );
+					space = false;
+				}
+				bool literal = false;
+				switch ( t.id ) {
+				case token_id::string_literal_begin:
+				case token_id::string_literal:
+				case token_id::string_literal_end:
+				case token_id::character_literal_begin:
+				case token_id::character_literal:
+				case token_id::character_literal_end:
+					literal = true;
+					break;
+				default:
+					break;
+				}
+				for ( const char* c = t.lexeme.data(); c != t.lexeme.data_end(); ++c ) {
+					if ( literal && ( *c == '"' || *c == '\\' ) ) {
+						spelling.push_back( '\\' );
+					}
+					spelling.push_back( *c );
+				}
+			}
+		}
+
+		// A string literal, lexed as the lexer lexes one: its quotes and its text, three tokens
+		void stringize( level& call, const macro_definition& m, uint32 parameter, hide_set painted ) {
+			const token_span& bounds = call.argumentbounds[ parameter ];
+			source_location where = bounds.count != 0 ? token_at( call.arguments[ bounds.first_token ].index ).where : source[ frozen[ m.node ].first_token ].where;
+			static const char quote = '"';
+			spell_string( call, bounds );
+			uint32 text = synthesize( token_id::string_literal, where, spelling.data(), spelling.data() + spelling.size() );
+			// None of the three is spaced; substitute spaces the opening quote as the # was written
+			call.substituted.push_back( expansion_token{ synthesize( token_id::string_literal_begin, where, &quote, &quote + 1 ), painted, false } );
+			call.substituted.push_back( expansion_token{ text, painted, false } );
+			call.substituted.push_back( expansion_token{ synthesize( token_id::string_literal_end, where, &quote, &quote + 1 ), painted, false } );
+		}
+
+		// Replays the program of the call being replaced at depth, with no name lookups
+		void substitute( std::size_t depth, const macro_definition& m, hide_set painted ) {
+			level& call = level_at( depth );
+			call.substituted.clear();
+			// Where the operand last substituted starts, which is the left operand of a ## after it;
+			// a pasted pair counts as the one operand, so a ## b ## c pastes all three
+			std::size_t operandfirst = 0;
+			bool pasting = false;
+			for ( const macro_instruction& instruction : frozen.instructions_of( m.program ) ) {
+				if ( instruction.op == macro_op::paste ) {
+					pasting = true;
+					continue;
+				}
+				std::size_t first = call.substituted.size();
+				switch ( instruction.op ) {
+				case macro_op::copy:
+					for ( uint32 i = 0; i < instruction.count; ++i ) {
+						call.substituted.push_back( expansion_token{ instruction.operand + i, painted, source[ instruction.operand + i ].spaced } );
+					}
+					break;
+				case macro_op::argument:
+				case macro_op::variadic_arguments:
+				{
+					if ( ( instruction.flags & macro_instruction::verbatim ) != 0 ) {
+						substitute_verbatim( call, instruction.operand, painted );
+						break;
+					}
+					token_span expanded = expanded_argument( depth, instruction.operand );
+					for ( uint32 i = 0; i < expanded.count; ++i ) {
+						expansion_token t = call.expandedarguments[ expanded.first_token + i ];
+						call.substituted.push_back( expansion_token{ t.index, hides.join( t.hides, painted ), t.spaced } );
+					}
+					break;
+				}
+				case macro_op::stringize:
+					stringize( call, m, instruction.operand, painted );
+					break;
+				default:
+					break;
+				}
+				bool empty = first == call.substituted.size();
+				// An argument or string stands where its parameter was written
+				if ( !empty && instruction.op != macro_op::copy ) {
+					call.substituted[ first ].spaced = ( instruction.flags & macro_instruction::spaced ) != 0;
+				}
+				if ( !pasting ) {
+					operandfirst = first;
+					continue;
+				}
+				// An empty operand leaves the other as it was, free to be rescanned
+				if ( !empty ) {
+					if ( operandfirst != first ) {
+						join( call, first );
+					}
+					else {
+						operandfirst = first;
+					}
+				}
+				pasting = false;
+			}
+		}
+
+		// Collects the arguments of the call starting at the reader; false, leaving the reader where it was,
+		// when there is no '(' or no matching ')' or the argument count is wrong
+		bool replace_call( std::size_t depth, expansion_token name, identifier_id id, const macro_definition& m ) {
+			level& l = level_at( depth );
+			std::size_t remaining = l.remaining();
+			std::size_t ahead = 0;
+			while ( ahead < remaining && is_blank( token_at( l.peek( ahead ).index ).id ) ) {
+				++ahead;
+			}
+			if ( ahead == remaining || token_at( l.peek( ahead ).index ).id != token_id::open_parenthesis ) {
+				return false;
+			}
+			++ahead;
+			l.arguments.clear();
+			l.argumentbounds.clear();
+			uint32 parentheses = 1;
+			uint32 argumentfirst = 0;
+			expansion_token close{ 0, 0, false };
+			for ( ;; ++ahead ) {
+				if ( ahead == remaining ) {
+					// Inside an argument the call may yet be completed by the text after it, once rescanned
+					if ( depth == 0 ) {
+						report( parser_error( token_at( name.index ).where, "unterminated call to macro '" + name_of( name ) + "'" ) );
+					}
+					return false;
+				}
+				expansion_token t = l.peek( ahead );
+				token_id tid = token_at( t.index ).id;
+				if ( tid == token_id::open_parenthesis ) {
+					++parentheses;
+				}
+				else if ( tid == token_id::close_parenthesis ) {
+					if ( --parentheses == 0 ) {
+						close = t;
+						break;
+					}
+				}
+				else if ( tid == token_id::comma && parentheses == 1 && !( m.program.variadic && l.argumentbounds.size() + 1 >= m.program.parameter_count ) ) {
+					l.argumentbounds.push_back( token_span{ argumentfirst, static_cast<uint32>( l.arguments.size() ) - argumentfirst } );
+					argumentfirst = static_cast<uint32>( l.arguments.size() );
+					continue;
+				}
+				l.arguments.push_back( t );
+			}
+			l.argumentbounds.push_back( token_span{ argumentfirst, static_cast<uint32>( l.arguments.size() ) - argumentfirst } );
+			for ( token_span& bounds : l.argumentbounds ) {
+				uint32 first = trimmed_first( l.arguments, bounds );
+				uint32 last = trimmed_last( l.arguments, first, bounds );
+				bounds = token_span{ first, last - first };
+			}
+			std::size_t argumentcount = l.argumentbounds.size();
+			if ( m.program.parameter_count == 0 && argumentcount == 1 && l.argumentbounds[ 0 ].count == 0 ) {
+				argumentcount = 0;
+				l.argumentbounds.clear();
+			}
+			if ( m.program.variadic && argumentcount + 1 == m.program.parameter_count ) {
+				// Nothing was passed for '...'
+				l.argumentbounds.push_back( token_span{ static_cast<uint32>( l.arguments.size() ), 0 } );
+				++argumentcount;
+			}
+			if ( argumentcount != m.program.parameter_count ) {
+				report( parser_error( token_at( name.index ).where, "macro '" + name_of( name ) + "' takes "
+					+ std::to_string( m.program.parameter_count ) + " arguments, not " + std::to_string( argumentcount ) ) );
+				return false;
+			}
+			l.skip( ahead + 1 );
+
+			hide_set painted = hides.with( hides.intersect( name.hides, close.hides ), id );
+			if ( caching && name.hides == 0 && close.hides == 0 && all_unpainted( l.arguments ) ) {
+				if ( is_worth_caching( id ) ) {
+					replace_call_cached( depth, id, m, painted, name.spaced );
+					return true;
+				}
+				++counters.bypassed;
+			}
+			replace_call_in_place( depth, m, painted, name.spaced );
+			return true;
+		}
+
+		call_statistics& statistics_of( identifier_id id ) {
+			if ( id.index >= callstatistics.size() ) {
+				callstatistics.resize( std::max<std::size_t>( id.index + 1, callstatistics.size() * 2 ), call_statistics{ 0, 0 } );
+			}
+			return callstatistics[ id.index ];
+		}
+
+		// Marks key seen, answering whether it already was
+		bool was_seen( uint64 key ) {
+			if ( seencalls.empty() ) {
+				seencalls.assign( seen_bits / 64, 0 );
+			}
+			std::size_t bit = static_cast<std::size_t>( ( key ^ ( key >> 29 ) ) & ( seen_bits - 1 ) );
+			uint64 mask = 1ull << ( bit % 64 );
+			uint64& word = seencalls[ bit / 64 ];
+			bool seen = ( word & mask ) != 0;
+			word |= mask;
+			return seen;
+		}
+
+		bool is_worth_caching( identifier_id id ) {
+			const call_statistics& calls = statistics_of( id );
+			return calls.misses < call_trial || calls.hits * 4 >= calls.misses;
+		}
+
+		static bool all_unpainted( const pmr::vector<expansion_token>& tokens ) {
+			for ( const expansion_token& t : tokens ) {
+				if ( t.hides != 0 ) {
+					return false;
+				}
+			}
+			return true;
+		}
+
+		bool spelled_alike( const token& left, const token& right ) const {
+			if ( left.id != right.id ) {
+				return false;
+			}
+			if ( left.id == token_id::identifier ) {
+				return identifier_of( left ) == identifier_of( right );
+			}
+			std::size_t size = static_cast<std::size_t>( left.lexeme.data_end() - left.lexeme.data() );
+			return size == static_cast<std::size_t>( right.lexeme.data_end() - right.lexeme.data() )
+				&& std::memcmp( left.lexeme.data(), right.lexeme.data(), size ) == 0;
+		}
+
+		static uint64 mix( uint64 h, uint32 value ) {
+			return ( h ^ value ) * 1099511628211ull;
+		}
+
+		// The call's name and its arguments by spelling, so the same call anywhere finds the same entry
+		uint64 call_key( identifier_id id, const level& call ) const {
+			uint64 h = mix( 14695981039346656037ull, id.index );
+			for ( const token_span& bounds : call.argumentbounds ) {
+				h = mix( mix( h, bounds.first_token ), bounds.count );
+			}
+			for ( const expansion_token& t : call.arguments ) {
+				const token& argument = token_at( t.index );
+				h = mix( h, static_cast<uint32>( argument.id ) | ( t.spaced ? 0x80000000u : 0u ) );
+				if ( argument.id == token_id::identifier ) {
+					h = mix( h, identifier_of( argument ).index );
+					continue;
+				}
+				for ( const char* c = argument.lexeme.data(); c != argument.lexeme.data_end(); ++c ) {
+					h = mix( h, static_cast<uint8>( *c ) );
+				}
+			}
+			return h;
+		}
+
+		// Guards against two calls whose keys collide
+		bool is_same_call( const cache_entry& entry, const level& call ) const {
+			if ( entry.keycount != call.arguments.size() || entry.boundscount != call.argumentbounds.size() ) {
+				return false;
+			}
+			for ( uint32 i = 0; i < entry.boundscount; ++i ) {
+				const token_span& left = cachedkeybounds[ entry.boundsfirst + i ];
+				const token_span& right = call.argumentbounds[ i ];
+				if ( left.first_token != right.first_token || left.count != right.count ) {
+					return false;
+				}
+			}
+			for ( uint32 i = 0; i < entry.keycount; ++i ) {
+				const expansion_token& left = cachedkeys[ entry.keyfirst + i ];
+				const expansion_token& right = call.arguments[ i ];
+				if ( left.spaced != right.spaced || !spelled_alike( token_at( left.index ), token_at( right.index ) ) ) {
+					return false;
+				}
+			}
+			return true;
+		}
+
+		bool is_current( cache_entry& entry ) {
+			if ( entry.validated == generation ) {
+				return true;
+			}
+			for ( uint32 i = 0; i < entry.dependencycount; ++i ) {
+				uint32 name = cachedependencies[ entry.dependencyfirst + i ];
+				if ( name < namechanged.size() && namechanged[ name ] > entry.built ) {
+					return false;
+				}
+			}
+			entry.validated = generation;
+			return true;
+		}
+
+		level& isolate( std::size_t depth ) {
+			level& inner = level_at( depth + 1 );
+			inner.pending.clear();
+			inner.cursor = 0;
+			inner.limit = 0;
+			inner.output.clear();
+			return inner;
+		}
+
+		std::size_t begin_build( identifier_id name ) {
+			++recording;
+			std::size_t mark = dependencies.size();
+			dependencies.push_back( name.index );
+			return mark;
+		}
+
+		void end_build() {
+			if ( --recording == 0 ) {
+				dependencies.clear();
+			}
+		}
+
+		// Whether the isolated expansion at depth + 1 is final: had it been expanded in place,
+		// the text after it could not have changed it, as no macro name in it is left free to expand
+		bool is_final( std::size_t depth ) {
+			for ( const expansion_token& t : level_at( depth + 1 ).output ) {
+				const token& candidate = token_at( t.index );
+				if ( expandable( candidate ) != nullptr && !hides.contains( t.hides, identifier_of( candidate ) ) ) {
+					return false;
+				}
+			}
+			return true;
+		}
+
+		void emit_isolated( std::size_t depth ) {
+			const pmr::vector<expansion_token>& output = level_at( depth + 1 ).output;
+			for ( const expansion_token& t : output ) {
+				emit( depth, t );
+			}
+		}
+
+		cache_entry make_entry( identifier_id name, std::size_t mark, std::size_t expansionsbefore, bool cacheable ) {
+			cache_entry entry{};
+			entry.name = name;
+			entry.cacheable = cacheable;
+			entry.dependencyfirst = static_cast<uint32>( cachedependencies.size() );
+			cachedependencies.insert( cachedependencies.end(), dependencies.begin() + mark, dependencies.end() );
+			auto first = cachedependencies.begin() + entry.dependencyfirst;
+			cachedependencies.erase( std::unique( first, ( std::sort( first, cachedependencies.end() ), cachedependencies.end() ) ), cachedependencies.end() );
+			entry.dependencycount = static_cast<uint32>( cachedependencies.size() - entry.dependencyfirst );
+			entry.first = static_cast<uint32>( cachedtokens.size() );
+			entry.built = generation;
+			entry.validated = generation;
+			entry.expansions = static_cast<uint32>( expansioncount - expansionsbefore );
+			return entry;
+		}
+
+		// The entry's first token stands where this use's name did, spaced as that was
+		void splice( std::size_t depth, const cache_entry& entry, const pmr::vector<expansion_token>* arguments, bool spaced ) {
+			for ( uint32 i = 0; i < entry.count; ++i ) {
+				expansion_token t = cachedtokens[ entry.first + i ];
+				if ( ( t.index & argument_token ) != 0 ) {
+					t.index = ( *arguments )[ t.index & ~argument_token ].index;
+				}
+				if ( i == 0 ) {
+					t.spaced = spaced;
+				}
+				emit( depth, t );
+			}
+			if ( recording != 0 ) {
+				// What is being built around this use depends on whatever the entry did
+				dependencies.insert( dependencies.end(), cachedependencies.begin() + entry.dependencyfirst, cachedependencies.begin() + entry.dependencyfirst + entry.dependencycount );
+			}
+			expansioncount += entry.expansions;
+		}
+
+		void replace_object_cached( std::size_t depth, expansion_token name, identifier_id id, const macro_definition& m ) {
+			uint32 slot = id.index < objectcache.size() ? objectcache[ id.index ] : 0;
+			if ( slot != 0 ) {
+				cache_entry& entry = cacheentries[ slot - 1 ];
+				if ( is_current( entry ) ) {
+					if ( entry.cacheable ) {
+						++counters.hits;
+						splice( depth, entry, nullptr, name.spaced );
+						return;
+					}
+					++counters.uncacheable;
+					replace_object( depth, name, id, m );
+					return;
+				}
+				++counters.invalidations;
+			}
+			isolate( depth );
+			std::size_t mark = begin_build( id );
+			std::size_t before = expansioncount;
+			std::size_t errorsbefore = errorlist.size();
+			replace_object( depth + 1, name, id, m );
+			expand( depth + 1 );
+			bool cacheable = errorlist.size() == errorsbefore && is_final( depth );
+			const pmr::vector<expansion_token>& output = level_at( depth + 1 ).output;
+			cache_entry entry = make_entry( id, mark, before, cacheable );
+			if ( cacheable ) {
+				cachedtokens.insert( cachedtokens.end(), output.begin(), output.end() );
+				entry.count = static_cast<uint32>( output.size() );
+			}
+			if ( id.index >= objectcache.size() ) {
+				objectcache.resize( std::max<std::size_t>( id.index + 1, objectcache.size() * 2 ), 0 );
+			}
+			cacheentries.push_back( entry );
+			objectcache[ id.index ] = static_cast<uint32>( cacheentries.size() );
+			end_build();
+			if ( cacheable ) {
+				++counters.misses;
+				emit_isolated( depth );
+				return;
+			}
+			// Undone, and expanded in place as though never tried
+			++counters.uncacheable;
+			errorlist.erase( errorlist.begin() + errorsbefore, errorlist.end() );
+			expansioncount = before;
+			replace_object( depth, name, id, m );
+		}
+
+		void replace_call_in_place( std::size_t depth, const macro_definition& m, hide_set painted, bool spaced ) {
+			level& call = level_at( depth );
+			call.expandedarguments.clear();
+			call.expandedbounds.assign( m.program.parameter_count, token_span{ 0, frozen_node::none } );
+			substitute( depth, m, painted );
+			push_reversed( call, call.substituted, spaced );
+			++expansioncount;
+		}
+
+		// The call's arguments are in the level at depth, its tokens already taken off the reader;
+		// spaced is whether its name was
+		void replace_call_cached( std::size_t depth, identifier_id id, const macro_definition& m, hide_set painted, bool spaced ) {
+			level& call = level_at( depth );
+			uint64 key = call_key( id, call );
+			auto found = callcache.find( key );
+			if ( found != callcache.end() ) {
+				cache_entry& entry = cacheentries[ found->second ];
+				if ( entry.name == id && is_same_call( entry, call ) ) {
+					if ( is_current( entry ) ) {
+						if ( entry.cacheable ) {
+							++counters.hits;
+							++statistics_of( id ).hits;
+							splice( depth, entry, &call.arguments, spaced );
+							return;
+						}
+						++counters.uncacheable;
+						replace_call_in_place( depth, m, painted, spaced );
+						return;
+					}
+					++counters.invalidations;
+				}
+			}
+			++statistics_of( id ).misses;
+			if ( found == callcache.end() && !was_seen( key ) ) {
+				++counters.misses;
+				replace_call_in_place( depth, m, painted, spaced );
+				return;
+			}
+			std::size_t mark = begin_build( id );
+			std::size_t before = expansioncount;
+			std::size_t errorsbefore = errorlist.size();
+			call.expandedarguments.clear();
+			call.expandedbounds.assign( m.program.parameter_count, token_span{ 0, frozen_node::none } );
+			substitute( depth, m, painted );
+			++expansioncount;
+			std::size_t substitutedexpansions = expansioncount;
+			std::size_t substitutederrors = errorlist.size();
+			level& inner = isolate( depth );
+			push_reversed( inner, call.substituted, spaced );
+			expand( depth + 1 );
+			bool cacheable = errorlist.size() == errorsbefore && is_final( depth );
+			cache_entry entry = make_entry( id, mark, before, cacheable );
+			if ( cacheable ) {
+				// Tokens that came from the arguments are kept by position, to be taken from whichever call uses the entry
+				uint32 lowest = argument_token;
+				uint32 highest = 0;
+				for ( const expansion_token& t : call.arguments ) {
+					lowest = std::min( lowest, t.index );
+					highest = std::max( highest, t.index );
+				}
+				for ( expansion_token t : inner.output ) {
+					if ( t.index >= lowest && t.index <= highest ) {
+						for ( std::size_t k = 0; k < call.arguments.size(); ++k ) {
+							if ( call.arguments[ k ].index == t.index ) {
+								t.index = argument_token | static_cast<uint32>( k );
+								break;
+							}
+						}
+					}
+					cachedtokens.push_back( t );
+				}
+				entry.count = static_cast<uint32>( inner.output.size() );
+			}
+			entry.keyfirst = static_cast<uint32>( cachedkeys.size() );
+			entry.keycount = static_cast<uint32>( call.arguments.size() );
+			for ( const expansion_token& t : call.arguments ) {
+				cachedkeys.push_back( t );
+			}
+			entry.boundsfirst = static_cast<uint32>( cachedkeybounds.size() );
+			entry.boundscount = static_cast<uint32>( call.argumentbounds.size() );
+			cachedkeybounds.insert( cachedkeybounds.end(), call.argumentbounds.begin(), call.argumentbounds.end() );
+			cacheentries.push_back( entry );
+			callcache[ key ] = static_cast<uint32>( cacheentries.size() - 1 );
+			end_build();
+			if ( cacheable ) {
+				++counters.misses;
+				emit_isolated( depth );
+				return;
+			}
+			// The substitution stands; only its rescan is undone, to be done in place
+			++counters.uncacheable;
+			errorlist.erase( errorlist.begin() + substitutederrors, errorlist.end() );
+			expansioncount = substitutedexpansions;
+			push_reversed( call, call.substituted, spaced );
+		}
+
+		void expand( std::size_t depth ) {
+			level& l = level_at( depth );
+			while ( !l.empty() ) {
+				if ( depth == 0 && l.pending.empty() ) {
+					// Untouched text: everything up to the next macro name goes out as one span
+					uint32 first = l.cursor;
+					while ( l.cursor < l.limit && expandable( source[ l.cursor ] ) == nullptr ) {
+						++l.cursor;
+					}
+					emit_span( first, l.cursor - first );
+					if ( l.cursor == l.limit ) {
+						break;
+					}
+				}
+				expansion_token t = l.next();
+				const token& candidate = token_at( t.index );
+				if ( candidate.id != token_id::identifier ) {
+					emit( depth, t );
+					continue;
+				}
+				identifier_id id = identifier_of( candidate );
+				if ( recording != 0 ) {
+					dependencies.push_back( id.index );
+				}
+				const macro_definition* m = find( id );
+				if ( m == nullptr || hides.contains( t.hides, id ) ) {
+					emit( depth, t );
+					continue;
+				}
+				if ( !m->program.function_like ) {
+					if ( caching && t.hides == 0 ) {
+						replace_object_cached( depth, t, id, *m );
+					}
+					else {
+						replace_object( depth, t, id, *m );
+					}
+					continue;
+				}
+				// Copied, as the call's substitution may not outlive a table that is never changed mid-expansion anyway
+				macro_definition call = *m;
+				if ( !replace_call( depth, t, id, call ) ) {
+					emit( depth, t );
+				}
+			}
+		}
+
+		void expand_text( uint32 first, uint32 last ) {
+			// Text lines stop short of their line break, which would otherwise be lost before a directive
+			while ( last < source.size() && ( source[ last ].id == token_id::newlines || source[ last ].id == token_id::whitespace ) ) {
+				++last;
+			}
+			level& l = level_at( 0 );
+			l.pending.clear();
+			l.cursor = first;
+			l.limit = last;
+			expand( 0 );
+		}
+
+		template <typename Conditions>
+		void run_block( uint32 node, Conditions& conditions ) {
+			// Consecutive text lines are expanded together, so a call may run across lines
+			uint32 textfirst = frozen_node::none;
+			uint32 textlast = 0;
+			for ( uint32 child : frozen.children( node ) ) {
+				const frozen_node& n = frozen[ child ];
+				if ( n.kind == node_kind::text_line ) {
+					if ( textfirst == frozen_node::none ) {
+						textfirst = n.first_token;
+					}
+					textlast = n.first_token + n.token_count;
+					continue;
+				}
+				if ( textfirst != frozen_node::none ) {
+					expand_text( textfirst, textlast );
+					textfirst = frozen_node::none;
+				}
+				switch ( n.kind ) {
+				case node_kind::variable:
+				case node_kind::function:
+					define( child );
+					break;
+				case node_kind::undefinition:
+					undefine( identifier_id( n.payload ) );
+					break;
+				case node_kind::block:
+					run_block( child, conditions );
+					break;
+				case node_kind::if_elseif_else:
+					for ( uint32 branch : frozen.children( child ) ) {
+						const frozen_node& condition = frozen[ frozen[ branch ].first_child ];
+						if ( conditions( *this, frozen, condition ) ) {
+							run_branch( branch, conditions );
+							break;
+						}
+					}
+					break;
+				default:
+					// #include, #line, #pragma and #error are for the driver; parser errors are in frozen.errors()
+					break;
+				}
+			}
+			if ( textfirst != frozen_node::none ) {
+				expand_text( textfirst, textlast );
+			}
+		}
+
+		// Cache entries expanded with name before now are stale
+		void changed( identifier_id name ) {
+			++generation;
+			if ( name.index >= namechanged.size() ) {
+				namechanged.resize( std::max<std::size_t>( name.index + 1, namechanged.size() * 2 ), 0 );
+			}
+			namechanged[ name.index ] = generation;
+			if ( name.index < callstatistics.size() ) {
+				callstatistics[ name.index ] = call_statistics{ 0, 0 };
+			}
+		}
+
+		const value_program& value_program_of( const macro_definition& m ) {
+			if ( valueprograms.empty() ) {
+				valueprograms.resize( frozen.size(), value_program{ false, false, condition_program() } );
+			}
+			value_program& body = valueprograms[ m.node ];
+			if ( body.compiled ) {
+				return body;
+			}
+			body.compiled = true;
+			buffer_view<const macro_instruction> code = frozen.instructions_of( m.program );
+			if ( code.size() != 1 || code[ 0 ].op != macro_op::copy ) {
+				return body;
+			}
+			condition_compiler compiler( valuecode );
+			body.program = compiler.compile( buffer_view<const token>( source.data() + code[ 0 ].operand, code[ 0 ].count ) );
+			// Anything but one operand could bind differently once spliced among the condition's operators, as in 1 + 1 * 2
+			body.usable = body.program.valid() && body.program.atomic;
+			return body;
+		}
+
+		// An object-like macro's value in a condition, without expanding it
+		condition_result value_of( identifier_id name, condition_value& value ) {
+			const macro_definition* m = find( name );
+			// Undefined, a function-like macro with no call, or a name its own expansion would leave painted: each is 0
+			if ( m == nullptr || m->program.function_like || std::find( evaluating.begin(), evaluating.end(), name.index ) != evaluating.end() ) {
+				value = condition_value{ 0, false };
+				return condition_result::value;
+			}
+			const value_program& body = value_program_of( *m );
+			if ( !body.usable ) {
+				return condition_result::needs_expansion;
+			}
+			condition_program program = body.program;
+			const condition_instruction& first = valuecode[ program.first_instruction ];
+			if ( program.instruction_count == 1 && first.op == condition_op::push ) {
+				// The usual body, a number
+				value = condition_value{ first.value, first.is_unsigned };
+				return condition_result::value;
+			}
+			evaluating.push_back( name.index );
+			condition_names names{ *this, false, 0 };
+			condition_result result = evaluate_condition( valuecode, program, conditionstack, names, value );
+			evaluating.pop_back();
+			return result;
+		}
+
+		bool names_macro( buffer_view<const token> tokens ) const {
+			for ( const token& t : tokens ) {
+				if ( expandable( t ) != nullptr ) {
+					return true;
+				}
+			}
+			return false;
+		}
+
+		// The literal a defined operator comes to, answered before expansion so the name it asks after is never replaced
+		uint32 defined_literal( bool defined, source_location where ) {
+			const char* spelling = defined ? "1" : "0";
+			token_arena& arena = *synthesized;
+			uint32 i = arena.find( token_id::integer_literal, spelling, spelling + 1 );
+			if ( i == token_arena::none ) {
+				i = arena.add( token_id::integer_literal, where, spelling, spelling + 1, decode_numeric_literal( spelling, spelling + 1 ).value );
+			}
+			return static_cast<uint32>( source.size() ) + i;
+		}
+
+		// The standard's way: the condition is expanded as text, with its defined operators settled first, and what that gives is compiled
+		condition_result evaluate_expanded( buffer_view<const token> tokens, condition_value& value ) {
+			uint32 base = static_cast<uint32>( tokens.data() - source.data() );
+			uint32 size = static_cast<uint32>( tokens.size() );
+			conditiontext.clear();
+			for ( uint32 i = 0; i < size; ++i ) {
+				if ( tokens[ i ].id != token_id::preprocessor_defined ) {
+					conditiontext.push_back( expansion_token{ base + i, 0, tokens[ i ].spaced } );
+					continue;
+				}
+				uint32 at = i + 1;
+				while ( at < size && is_blank( tokens[ at ].id ) ) {
+					++at;
+				}
+				bool parenthesized = at < size && tokens[ at ].id == token_id::open_parenthesis;
+				if ( parenthesized ) {
+					++at;
+					while ( at < size && is_blank( tokens[ at ].id ) ) {
+						++at;
+					}
+				}
+				if ( at == size || tokens[ at ].id != token_id::identifier ) {
+					// Left as it is, for the compiler to say what is wrong with it
+					conditiontext.push_back( expansion_token{ base + i, 0, tokens[ i ].spaced } );
+					continue;
+				}
+				identifier_id name = identifier_of( tokens[ at++ ] );
+				if ( parenthesized ) {
+					while ( at < size && is_blank( tokens[ at ].id ) ) {
+						++at;
+					}
+					if ( at == size || tokens[ at ].id != token_id::close_parenthesis ) {
+						conditiontext.push_back( expansion_token{ base + i, 0, tokens[ i ].spaced } );
+						continue;
+					}
+					++at;
+				}
+				conditiontext.push_back( expansion_token{ defined_literal( is_defined( name ), tokens[ i ].where ), 0, tokens[ i ].spaced } );
+				i = at - 1;
+			}
+			level& l = level_at( 1 );
+			l.pending.clear();
+			l.cursor = 0;
+			l.limit = 0;
+			l.output.clear();
+			for ( std::size_t i = conditiontext.size(); i-- > 0; ) {
+				l.pending.push_back( conditiontext[ i ] );
+			}
+			expand( 1 );
+			scratchcode.clear();
+			condition_compiler compiler( scratchcode );
+			condition_program program = compiler.compile( expanded_condition{ *this, l.output } );
+			source_location where = tokens.empty() ? source_location() : tokens.front().where;
+			if ( !program.valid() ) {
+				report( parser_error( l.output.empty() ? where : token_at( l.output[ program.error_token ].index ).where, program.error ) );
+				return condition_result::invalid;
+			}
+			condition_names names{ *this, true, 0 };
+			condition_result result = evaluate_condition( scratchcode, program, conditionstack, names, value );
+			if ( result != condition_result::invalid ) {
+				return result;
+			}
+			const token& name = token_at( l.output[ names.invalidcall ].index );
+			// A call the expander could not make has been reported already
+			if ( !is_defined( identifier_of( name ) ) ) {
+				report( parser_error( name.where, "'" + spelling_of( name ) + "' is not a function-like macro, so it cannot be called in #if" ) );
+			}
+			return result;
+		}
+
+		// A conditional block is a block whose first child is its condition
+		template <typename Conditions>
+		void run_branch( uint32 branch, Conditions& conditions ) {
+			run_block( branch, conditions );
+		}
+
+	public:
+		explicit expander( const frozen_tree& frozen, pmr::memory_resource* resource = pmr::get_default_resource() )
+		: frozen( frozen ), source( frozen.tokens() ), resource( resource ),
+		synthesized( std::allocate_shared<token_arena>( pmr::polymorphic_allocator<token_arena>( resource ), resource ) ), spelling( resource ),
+		macros( resource ), hides( resource ),
+		expansioncount( 0 ), out( nullptr ),
+		caching( true ), generation( 0 ), namechanged( resource ), cacheentries( resource ), cachedtokens( resource ),
+		cachedependencies( resource ), cachedkeys( resource ), cachedkeybounds( resource ), objectcache( resource ),
+		callcache( 0, std::hash<uint64>(), std::equal_to<uint64>(), resource ), callstatistics( resource ), seencalls( resource ), dependencies( resource ), recording( 0 ), counters(),
+		valueprograms( resource ), valuecode( resource ), scratchcode( resource ), conditionstack( resource ), evaluating( resource ), conditiontext( resource ) {
+
+		}
+
+		const macro_definition* find( identifier_id name ) const {
+			if ( name.index >= macros.size() ) {
+				return nullptr;
+			}
+			const macro_definition& m = macros[ name.index ];
+			return m.node == frozen_node::none ? nullptr : &m;
+		}
+
+		bool is_defined( identifier_id name ) const {
+			return find( name ) != nullptr;
+		}
+
+		// condition is an #if or #elif condition node of the tree, whose compiled program is run against the macros defined now.
+		// Only a name or call whose value depends on how it expands sends the condition through the expander;
+		// errors are reported, and make it false
+		bool evaluate( const frozen_node& condition ) {
+			const condition_program* program = frozen.condition_of( static_cast<uint32>( &condition - frozen.nodes().data() ) );
+			if ( program == nullptr ) {
+				return false;
+			}
+			condition_value value{ 0, false };
+			condition_result result = condition_result::needs_expansion;
+			if ( program->valid() ) {
+				condition_names names{ *this, false, 0 };
+				result = evaluate_condition( frozen.condition_instructions(), *program, conditionstack, names, value );
+				if ( result == condition_result::value ) {
+					return value.value != 0;
+				}
+			}
+			// The tokens are only looked at from here on
+			buffer_view<const token> tokens = frozen.tokens_of( condition );
+			source_location where = tokens.empty() ? source_location() : tokens.front().where;
+			if ( !program->valid() && !names_macro( tokens ) ) {
+				// Expanding would not change a thing
+				report( parser_error( program->error_token < tokens.size() ? tokens[ program->error_token ].where : where, program->error ) );
+				return false;
+			}
+			if ( result == condition_result::needs_expansion ) {
+				result = evaluate_expanded( tokens, value );
+			}
+			if ( result == condition_result::division_by_zero ) {
+				report( parser_error( where, "division by zero in #if" ) );
+			}
+			return result == condition_result::value && value.value != 0;
+		}
+
+		// Where a variable or function node names its macro
+		source_location name_where( uint32 node ) const {
+			identifier_id name( frozen[ node ].payload );
+			buffer_view<const token> tokens = frozen.tokens_of( frozen[ node ] );
+			for ( const token& t : tokens ) {
+				if ( identifier_of( t ) == name ) {
+					return t.where;
+				}
+			}
+			return tokens.empty() ? source_location() : tokens.front().where;
+		}
+
+		// node is a variable or function node of the tree
+		void define( uint32 node ) {
+			const macro_program* program = frozen.program_of( node );
+			if ( program == nullptr ) {
+				return;
+			}
+			identifier_id name( frozen[ node ].payload );
+			if ( name.index >= macros.size() ) {
+				macros.resize( std::max<std::size_t>( name.index + 1, macros.size() * 2 ), macro_definition{ frozen_node::none, macro_program() } );
+			}
+			// Only definitions on taken branches get here, so only they are held to the previous one;
+			// the programs' hashes stand in for comparing the two. Reported or not, the new definition replaces the old one
+			const macro_definition& previous = macros[ name.index ];
+			if ( previous.node != frozen_node::none ) {
+				if ( previous.program.function_like != program->function_like ) {
+					report( parser_error( name_where( node ), program->function_like ? "object-like macro redefined as a function-like macro" : "function-like macro redefined as an object-like macro" ) );
+				}
+				else if ( previous.program.hash != program->hash ) {
+					report( parser_error( name_where( node ), "macro redefined with a different replacement" ) );
+				}
+			}
+			macros[ name.index ] = macro_definition{ node, *program };
+			changed( name );
+		}
+
+		void undefine( identifier_id name ) {
+			if ( name.index < macros.size() ) {
+				macros[ name.index ].node = frozen_node::none;
+			}
+			changed( name );
+		}
+
+		// Uses of object-like macros, and calls whose arguments are spelled alike, are expanded once and then spliced in.
+		// On by default; off, every use is expanded where it stands
+		void use_cache( bool enabled ) {
+			caching = enabled;
+		}
+
+		const expansion_cache_counters& cache_counters() const {
+			return counters;
+		}
+
+		std::size_t cache_size() const {
+			return cacheentries.size();
+		}
+
+		void report( parser_error e ) {
+			errorlist.push_back( std::move( e ) );
+		}
+
+		const std::vector<parser_error>& errors() const {
+			return errorlist;
+		}
+
+		// Macro uses replaced so far, across every run
+		std::size_t expansions() const {
+			return expansioncount;
+		}
+
+		const hide_set_table& hide_sets() const {
+			return hides;
+		}
+
+		// Expands the text of the branches conditions picks, applying #define and #undef as they come
+		template <typename Conditions>
+		expansion operator()( Conditions conditions ) {
+			expansion result( resource );
+			result.tokens = source;
+			result.synthesized = synthesized;
+			out = &result;
+			if ( !frozen.empty() ) {
+				run_block( 0, conditions );
+			}
+			out = nullptr;
+			return result;
+		}
+
+		expansion operator()() {
+			return ( *this )( definition_conditions() );
+		}
+	};
+
+	inline bool definition_conditions::operator()( expander& e, const frozen_tree& frozen, const frozen_node& condition ) const {
+		buffer_view<const token> tokens = frozen.tokens_of( condition );
+		identifier_id name;
+		for ( const token& t : tokens ) {
+			if ( t.id == token_id::identifier ) {
+				name = identifier_of( t );
+				break;
+			}
+		}
+		switch ( static_cast<conditional_origin>( condition.payload ) ) {
+		case conditional_origin::else_:
+			return true;
+		case conditional_origin::if_def:
+		case conditional_origin::else_if_def:
+			return e.is_defined( name );
+		case conditional_origin::if_n_def:
+		case conditional_origin::else_if_n_def:
+			return !e.is_defined( name );
+		default:
+			break;
+		}
+		return e.evaluate( condition );
+	}
+
+}}}
@@ -3,8 +3,11 @@
 #include "../../tagged.hpp"
 #include "../../variant.hpp"
 #include "../../constant_type.hpp"
+#include "../../memory_resource.hpp"
+#include "../../small_vector.hpp"
 #include "construct.hpp"
 #include "conditional_origin.hpp"
+#include "condition_program.hpp"
 #include "parser_error.hpp"
 
 namespace gld { namespace hlsl { namespace pp {
@@ -12,32 +15,29 @@ namespace gld { namespace hlsl { namespace pp {
 	template <typename T>
 	using index_ref = tagged<uintz, T>;
 
-	template <typename T>
-	inline string_view create_name( T& tokens ) {
-		if ( tokens.empty() )
-			return {};
-		auto first = tokens.front().lexeme.begin();
-		auto last = tokens.back().lexeme.end();
-		return string_view( first, last );
-	}
-
 	struct whitespace : sequence {
 
-		whitespace( buffer_view<const token> seq ) : sequence( seq ) {
+		whitespace( token_span seq ) : sequence( seq ) {
 
 		}
 
 	};
 
+	// Always a single token, whose spelling and interned name the parser reads out of the tree's tokens
 	struct symbol : sequence {
 
 		string_view name;
+		// Invalid for symbols that are not an interned identifier, like '...'
+		identifier_id id;
 
-		symbol( buffer_view<const token> seq ) : sequence( seq ), name( create_name( tokens ) ) {
+		symbol( token_span seq, string_view name, identifier_id id ) : sequence( seq ), name( name ), id( id ) {
 			
 		}
 
 		bool operator== ( const symbol& right ) const {
+			if ( id.valid() || right.id.valid() ) {
+				return id == right.id;
+			}
 			return name == right.name;
 		}
 
@@ -45,21 +45,21 @@ namespace gld { namespace hlsl { namespace pp {
 
 	struct integral_literal : sequence {
 		constant_type type;
-		integral_literal( buffer_view<const token> seq ) : sequence( seq ) {
+		integral_literal( token_span seq ) : sequence( seq ) {
 
 		}
 	};
 
 	struct floating_literal : sequence {
 		constant_type type;
-		floating_literal( buffer_view<const token> seq ) : sequence( seq ) {
+		floating_literal( token_span seq ) : sequence( seq ) {
 
 		}
 	};
 
 	struct boolean_literal : sequence {
 
-		boolean_literal( buffer_view<const token> seq ) : sequence( seq ) {
+		boolean_literal( token_span seq ) : sequence( seq ) {
 
 		}
 	};
@@ -68,14 +68,14 @@ namespace gld { namespace hlsl { namespace pp {
 
 		string_view value;
 
-		string_literal( buffer_view<const token> seq, string_view value ) : sequence( seq ), value(value) {
+		string_literal( token_span seq, string_view value ) : sequence( seq ), value(value) {
 			
 		}
 	};
 
 	struct char_literal : sequence {
 
-		char_literal( buffer_view<const token> seq ) : sequence( seq ) {
+		char_literal( token_span seq ) : sequence( seq ) {
 
 		}
 	};
@@ -83,7 +83,7 @@ namespace gld { namespace hlsl { namespace pp {
 	struct defined : sequence {
 		symbol target;
 
-		defined( buffer_view<const token> seq, symbol target ) : sequence( seq ), target( target ) {
+		defined( token_span seq, symbol target ) : sequence( seq ), target( target ) {
 
 		}
 	};
@@ -153,22 +153,22 @@ namespace gld { namespace hlsl { namespace pp {
 	> expression;
 
 	struct expression_chain : sequence {
-		std::vector<expression> expressions;
+		pmr::vector<expression> expressions;
 
-		expression_chain() : expression_chain( buffer_view<const token>() ) {
+		expression_chain() : expression_chain( token_span{ 0, 0 } ) {
 
 		}
 
-		expression_chain( buffer_view<const token> seq ) : sequence( seq ) {
+		expression_chain( token_span seq, pmr::memory_resource* resource = pmr::get_default_resource() ) : sequence( seq ), expressions( resource ) {
 
 		}
 	};
 
 	struct function_call : sequence {
-		std::vector<expression> parameters;
+		small_vector<expression, 4> parameters;
 
 		template <typename... Tn>
-		function_call( buffer_view<const token> seq, Tn&&... argn ) : sequence( seq ), parameters( std::forward<Tn>( argn )... ) {
+		function_call( token_span seq, Tn&&... argn ) : sequence( seq ), parameters( std::forward<Tn>( argn )... ) {
 
 		}
 
@@ -177,14 +177,23 @@ namespace gld { namespace hlsl { namespace pp {
 	struct conditional {
 		conditional_origin origin;
 		expression_chain operand;
+		// For #if and #elif, the operand compiled into the tree's condition_instructions
+		condition_program program;
 
-		conditional( conditional_origin origin, expression_chain operand ) : origin( origin ), operand( std::move( operand ) ) {
+		conditional( conditional_origin origin, expression_chain operand ) : origin( origin ), operand( std::move( operand ) ), program() {
 
 		}
 
 		bool can_evaluate_to_boolean() const {
-			// TODO: token validation and the like
-			return false;
+			switch ( origin ) {
+			case conditional_origin::if_:
+			case conditional_origin::else_if:
+				return program.valid();
+			default:
+				break;
+			}
+			// #ifdef and #ifndef only ask after a name, and #else always holds
+			return true;
 		}
 	};
 
@@ -0,0 +1,448 @@
+#pragma once
+
+#include "parse_tree.hpp"
+#include "../../numeric.hpp"
+#include "../../memory_resource.hpp"
+#include <vector>
+#include <memory>
+#include <iterator>
+#include <algorithm>
+#include <stdexcept>
+
+namespace gld { namespace hlsl { namespace pp {
+
+	enum class node_kind : uint8 {
+		// The stream itself is node 0; conditional branches are conditional_blocks instead
+		block,
+		symbol,
+		text_line,
+		undefinition,
+		variable,
+		function,
+		// A function's parameters, then its body as alternating arguments and text lines
+		parameter,
+		substitution_argument,
+		force_line,
+		inclusion,
+		pragma_construct,
+		error_construct,
+		parser_error,
+		// Children are its branches, in source order
+		if_elseif_else,
+		// Its condition first, then the branch's statements
+		conditional_block,
+		condition,
+	};
+
+	inline string_view to_string( node_kind kind ) {
+		switch ( kind ) {
+		case node_kind::block:
+			return "block";
+		case node_kind::symbol:
+			return "symbol";
+		case node_kind::text_line:
+			return "text line";
+		case node_kind::undefinition:
+			return "undefinition";
+		case node_kind::variable:
+			return "variable";
+		case node_kind::function:
+			return "function";
+		case node_kind::parameter:
+			return "parameter";
+		case node_kind::substitution_argument:
+			return "substitution argument";
+		case node_kind::force_line:
+			return "force line";
+		case node_kind::inclusion:
+			return "inclusion";
+		case node_kind::pragma_construct:
+			return "pragma";
+		case node_kind::error_construct:
+			return "error";
+		case node_kind::parser_error:
+			return "parser error";
+		case node_kind::if_elseif_else:
+			return "if elseif else";
+		case node_kind::conditional_block:
+			return "conditional block";
+		case node_kind::condition:
+			return "condition";
+		default:
+			break;
+		}
+		return "unknown";
+	}
+
+	struct frozen_node {
+		static const uint32 none = 0xFFFFFFFF;
+		static const uint8 variadic = 1 << 0;
+
+		node_kind kind;
+		// variadic, on functions whose last parameter is '...'
+		uint8 flags;
+		// Always the next node when there is one, as nodes are stored in pre-order
+		uint32 first_child;
+		uint32 next_sibling;
+		// The tokens the node covers, as offsets into the tree's token buffer
+		uint32 first_token;
+		uint32 token_count;
+		// By kind: the name's identifier_id index for symbol, undefinition, variable, function, parameter
+		// and substitution_argument; the conditional_origin for condition; the inclusion_style for inclusion;
+		// the index into frozen_tree::errors() for parser_error; otherwise 0
+		uint32 payload;
+
+		bool has_children() const {
+			return first_child != none;
+		}
+	};
+
+	// A variable or function node's compiled replacement
+	struct node_program {
+		uint32 node;
+		macro_program program;
+	};
+
+	// An #if or #elif condition node's compiled expression
+	struct node_condition {
+		uint32 node;
+		condition_program program;
+	};
+
+	// The parse tree after the fact, laid out for walking: one pre-order array of 24-byte nodes,
+	// linked by 32-bit child and sibling indices, in place of a vector per node kind and the lists inside each node.
+	// A whole walk is one forward scan; children() follows the sibling links when only one level is wanted.
+	// Shares the parse tree's tokens and source manager, so it may outlive the tree. Expansion reads tokens whole,
+	// so a tree parsed from packed tokens has them unpacked once here, into a buffer the frozen tree owns
+	class frozen_tree {
+	private:
+		pmr::vector<frozen_node> nodelist;
+		std::vector<parser_error> errorlist;
+		macro_code code;
+		// In node order, as definitions are met in pre-order
+		pmr::vector<node_program> programs;
+		condition_code conditioncode;
+		// In node order too
+		pmr::vector<node_condition> conditions;
+		buffer_view<const token> tokenbuffer;
+		std::shared_ptr<const void> tokenowner;
+		std::shared_ptr<const source_manager> sourcemanager;
+
+		friend class frozen_tree_builder;
+
+	public:
+		class child_iterator {
+		private:
+			const frozen_node* nodes;
+			uint32 at;
+
+		public:
+			typedef std::forward_iterator_tag iterator_category;
+			typedef uint32 value_type;
+			typedef std::ptrdiff_t difference_type;
+			typedef const uint32* pointer;
+			typedef uint32 reference;
+
+			child_iterator( const frozen_node* nodes, uint32 at ) : nodes( nodes ), at( at ) {
+
+			}
+
+			uint32 operator*() const {
+				return at;
+			}
+
+			child_iterator& operator++() {
+				at = nodes[ at ].next_sibling;
+				return *this;
+			}
+
+			child_iterator operator++( int ) {
+				child_iterator previous = *this;
+				++*this;
+				return previous;
+			}
+
+			friend bool operator==( const child_iterator& left, const child_iterator& right ) {
+				return left.at == right.at;
+			}
+
+			friend bool operator!=( const child_iterator& left, const child_iterator& right ) {
+				return left.at != right.at;
+			}
+		};
+
+		struct child_range {
+			child_iterator first;
+			child_iterator last;
+
+			child_iterator begin() const {
+				return first;
+			}
+
+			child_iterator end() const {
+				return last;
+			}
+		};
+
+		explicit frozen_tree( pmr::memory_resource* resource = pmr::get_default_resource() ) : nodelist( resource ), code( resource ), programs( resource ), conditioncode( resource ), conditions( resource ) {
+
+		}
+
+		// In pre-order; the root, when there is one, is node 0
+		buffer_view<const frozen_node> nodes() const {
+			return buffer_view<const frozen_node>( nodelist.data(), nodelist.size() );
+		}
+
+		std::size_t size() const {
+			return nodelist.size();
+		}
+
+		bool empty() const {
+			return nodelist.empty();
+		}
+
+		const frozen_node& operator[]( uint32 index ) const {
+			return nodelist[ index ];
+		}
+
+		// Indices of index's children
+		child_range children( uint32 index ) const {
+			const frozen_node* first = nodelist.data();
+			return child_range{ child_iterator( first, nodelist[ index ].first_child ), child_iterator( first, frozen_node::none ) };
+		}
+
+		buffer_view<const token> tokens_of( const frozen_node& node ) const {
+			return buffer_view<const token>( tokenbuffer.data() + node.first_token, node.token_count );
+		}
+
+		buffer_view<const token> tokens() const {
+			return tokenbuffer;
+		}
+
+		const std::vector<parser_error>& errors() const {
+			return errorlist;
+		}
+
+		// Null unless node is a variable or function
+		const macro_program* program_of( uint32 node ) const {
+			auto found = std::lower_bound( programs.begin(), programs.end(), node, []( const node_program& p, uint32 n ) {
+				return p.node < n;
+			} );
+			if ( found == programs.end() || found->node != node ) {
+				return nullptr;
+			}
+			return &found->program;
+		}
+
+		buffer_view<const macro_instruction> instructions_of( const macro_program& program ) const {
+			return buffer_view<const macro_instruction>( code.data() + program.first_instruction, program.instruction_count );
+		}
+
+		// Null unless node is the condition of an #if or #elif
+		const condition_program* condition_of( uint32 node ) const {
+			auto found = std::lower_bound( conditions.begin(), conditions.end(), node, []( const node_condition& c, uint32 n ) {
+				return c.node < n;
+			} );
+			if ( found == conditions.end() || found->node != node ) {
+				return nullptr;
+			}
+			return &found->program;
+		}
+
+		// What every condition_program indexes into
+		const condition_code& condition_instructions() const {
+			return conditioncode;
+		}
+
+		buffer_view<const condition_instruction> instructions_of( const condition_program& program ) const {
+			return buffer_view<const condition_instruction>( conditioncode.data() + program.first_instruction, program.instruction_count );
+		}
+
+		// Null when the caller keeps the manager alive itself (see parse_tree::sources)
+		const source_manager* sources() const {
+			return sourcemanager.get();
+		}
+	};
+
+	class frozen_tree_builder {
+	private:
+		const parse_tree& tree;
+		frozen_tree& frozen;
+
+		static uint32 offset_of( const token_span& seq ) {
+			if ( seq.count == 0 ) {
+				return 0;
+			}
+			return seq.first_token;
+		}
+
+		uint32 append( node_kind kind, const token_span& seq, uint32 payload = 0, uint8 flags = 0 ) {
+			if ( frozen.nodelist.size() >= frozen_node::none ) {
+				throw std::length_error( "frozen_tree: 32-bit node index space exhausted" );
+			}
+			uint32 index = static_cast<uint32>( frozen.nodelist.size() );
+			frozen.nodelist.push_back( frozen_node{ kind, flags, frozen_node::none, frozen_node::none, offset_of( seq ), seq.count, payload } );
+			return index;
+		}
+
+		// Appends child as the last of parent's children; previous is the child before it, or none
+		void link( uint32 parent, uint32& previous, uint32 child ) {
+			if ( previous == frozen_node::none ) {
+				frozen.nodelist[ parent ].first_child = child;
+			}
+			else {
+				frozen.nodelist[ previous ].next_sibling = child;
+			}
+			previous = child;
+		}
+
+		struct statement_visitor {
+			frozen_tree_builder& builder;
+
+			uint32 operator()( const symbol& s ) const {
+				return builder.append( node_kind::symbol, s.tokens, s.id.index );
+			}
+
+			uint32 operator()( const text_line& line ) const {
+				return builder.append( node_kind::text_line, line.tokens );
+			}
+
+			uint32 operator()( const undefinition& u ) const {
+				return builder.append( node_kind::undefinition, u.tokens, u.name.id.index );
+			}
+
+			uint32 operator()( const variable& v ) const {
+				uint32 self = builder.append( node_kind::variable, v.tokens, v.name.id.index );
+				builder.frozen.programs.push_back( node_program{ self, v.program } );
+				uint32 previous = frozen_node::none;
+				builder.link( self, previous, builder.append( node_kind::text_line, v.substitution.tokens ) );
+				return self;
+			}
+
+			uint32 operator()( const index_ref<function>& f ) const {
+				return builder.freeze( builder.tree[ f ] );
+			}
+
+			uint32 operator()( const force_line& line ) const {
+				return builder.append( node_kind::force_line, line.tokens );
+			}
+
+			uint32 operator()( const inclusion& i ) const {
+				return builder.append( node_kind::inclusion, i.tokens, static_cast<uint32>( i.style ) );
+			}
+
+			uint32 operator()( const pragma_construct& p ) const {
+				return builder.append( node_kind::pragma_construct, p.tokens );
+			}
+
+			uint32 operator()( const error_construct& e ) const {
+				return builder.append( node_kind::error_construct, e.tokens );
+			}
+
+			uint32 operator()( const parser_error& e ) const {
+				uint32 index = static_cast<uint32>( builder.frozen.errorlist.size() );
+				builder.frozen.errorlist.push_back( e );
+				return builder.append( node_kind::parser_error, token_span{ 0, 0 }, index );
+			}
+
+			uint32 operator()( const index_ref<block>& b ) const {
+				const block& nested = builder.tree[ b ];
+				uint32 self = builder.append( node_kind::block, nested.tokens );
+				builder.freeze_statements( self, nested );
+				return self;
+			}
+
+			uint32 operator()( const index_ref<if_elseif_else>& i ) const {
+				return builder.freeze( builder.tree[ i ] );
+			}
+		};
+
+		struct substitution_visitor {
+			frozen_tree_builder& builder;
+
+			uint32 operator()( const substitution_argument& arg ) const {
+				return builder.append( node_kind::substitution_argument, arg.tokens, arg.id.index );
+			}
+
+			uint32 operator()( const text_line& line ) const {
+				return builder.append( node_kind::text_line, line.tokens );
+			}
+		};
+
+		void freeze_statements( uint32 self, const block& b ) {
+			uint32 previous = frozen_node::none;
+			for ( const statement& s : b.statements ) {
+				link( self, previous, s.visit( statement_visitor{ *this } ) );
+			}
+		}
+
+		uint32 freeze( const function& f ) {
+			uint32 self = append( node_kind::function, f.tokens, f.name.id.index, f.variadic_argument ? frozen_node::variadic : 0 );
+			frozen.programs.push_back( node_program{ self, f.program } );
+			uint32 previous = frozen_node::none;
+			for ( const symbol& parameter : f.parameters ) {
+				link( self, previous, append( node_kind::parameter, parameter.tokens, parameter.id.index ) );
+			}
+			for ( const substitution_text& text : f.routine.text ) {
+				link( self, previous, text.visit( substitution_visitor{ *this } ) );
+			}
+			return self;
+		}
+
+		uint32 freeze( const if_elseif_else& branches ) {
+			uint32 self = append( node_kind::if_elseif_else, branches.tokens );
+			uint32 previous = frozen_node::none;
+			for ( const conditional_block& branch : branches.success_blocks ) {
+				uint32 branchindex = append( node_kind::conditional_block, branch.branch.tokens );
+				link( self, previous, branchindex );
+				uint32 previousinbranch = frozen_node::none;
+				const conditional& c = branch.condition;
+				uint32 conditionindex = append( node_kind::condition, c.operand.tokens, static_cast<uint32>( c.origin ) );
+				link( branchindex, previousinbranch, conditionindex );
+				if ( c.origin == conditional_origin::if_ || c.origin == conditional_origin::else_if ) {
+					frozen.conditions.push_back( node_condition{ conditionindex, c.program } );
+				}
+				for ( const statement& s : branch.branch.statements ) {
+					link( branchindex, previousinbranch, s.visit( statement_visitor{ *this } ) );
+				}
+			}
+			return self;
+		}
+
+	public:
+		frozen_tree_builder( const parse_tree& tree, frozen_tree& frozen ) : tree( tree ), frozen( frozen ) {
+
+		}
+
+		void operator()() {
+			frozen.nodelist.clear();
+			frozen.errorlist.clear();
+			frozen.programs.clear();
+			frozen.conditions.clear();
+			// Programs index into the code, so it is copied whole
+			frozen.code.assign( tree.macro_instructions().begin(), tree.macro_instructions().end() );
+			frozen.conditioncode.assign( tree.condition_instructions().begin(), tree.condition_instructions().end() );
+			if ( tree.packed() != nullptr ) {
+				auto owned = std::make_shared<const std::vector<token>>( tree.packed()->unpack() );
+				frozen.tokenbuffer = buffer_view<const token>( owned->data(), owned->size() );
+				frozen.tokenowner = std::move( owned );
+			}
+			else {
+				frozen.tokenbuffer = tree.token_buffer();
+				frozen.tokenowner = tree.token_owner();
+			}
+			frozen.sourcemanager = tree.source_owner();
+			uint32 root = append( node_kind::block, tree.tokens );
+			freeze_statements( root, tree );
+		}
+	};
+
+	// Built once, after parsing; the parse tree can be dropped afterwards
+	inline frozen_tree freeze( const parse_tree& tree, pmr::memory_resource* resource = pmr::get_default_resource() ) {
+		frozen_tree frozen( resource );
+		frozen_tree_builder builder( tree, frozen );
+		builder();
+		return frozen;
+	}
+
+}}}
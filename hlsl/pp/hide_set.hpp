@@ -0,0 +1,193 @@
+#pragma once
+
+#include "../identifier.hpp"
+#include "../../numeric.hpp"
+#include "../../range.hpp"
+#include "../../memory_resource.hpp"
+#include <functional>
+
+namespace gld { namespace hlsl { namespace pp {
+
+	// The macros a token came out of, which it may not expand again (its "blue paint"):
+	// an index into a hide_set_table, where 0 is the empty set
+	typedef uint32 hide_set;
+
+	// Every hide set an expansion makes, each a sorted run of identifier indices in one flat array.
+	// Sets are only as large as macros are nested, and the same few operations recur on every use of a macro,
+	// so results are memoized by operand pair: after warming up, most operations are one hash probe
+	class hide_set_table {
+	private:
+		struct extent {
+			uint32 first;
+			uint32 count;
+		};
+
+		typedef pmr::unordered_map<uint64, hide_set> memo;
+
+		pmr::vector<uint32> members;
+		pmr::vector<extent> sets;
+		memo insertions;
+		memo unions;
+		memo intersections;
+
+		static uint64 key_of( uint32 left, uint32 right ) {
+			return ( static_cast<uint64>( left ) << 32 ) | right;
+		}
+
+		// Sets are commutative, so each pair is looked up one way round
+		static uint64 unordered_key_of( uint32 left, uint32 right ) {
+			return left < right ? key_of( left, right ) : key_of( right, left );
+		}
+
+		// Seals the members appended since first into a new set
+		hide_set seal( std::size_t first ) {
+			hide_set s = static_cast<hide_set>( sets.size() );
+			sets.push_back( extent{ static_cast<uint32>( first ), static_cast<uint32>( members.size() - first ) } );
+			return s;
+		}
+
+		// members grows while the result is written, so both sets are read by position rather than by pointer
+		// keep: every member of either set, a union; otherwise only those in both, an intersection
+		hide_set merge( hide_set left, hide_set right, bool keep ) {
+			std::size_t first = members.size();
+			extent l = sets[ left ];
+			extent r = sets[ right ];
+			uint32 li = 0;
+			uint32 ri = 0;
+			while ( li < l.count && ri < r.count ) {
+				uint32 a = members[ l.first + li ];
+				uint32 b = members[ r.first + ri ];
+				if ( a == b ) {
+					members.push_back( a );
+					++li;
+					++ri;
+				}
+				else if ( a < b ) {
+					if ( keep ) {
+						members.push_back( a );
+					}
+					++li;
+				}
+				else {
+					if ( keep ) {
+						members.push_back( b );
+					}
+					++ri;
+				}
+			}
+			if ( keep ) {
+				for ( ; li < l.count; ++li ) {
+					uint32 a = members[ l.first + li ];
+					members.push_back( a );
+				}
+				for ( ; ri < r.count; ++ri ) {
+					uint32 b = members[ r.first + ri ];
+					members.push_back( b );
+				}
+			}
+			return seal( first );
+		}
+
+	public:
+		explicit hide_set_table( pmr::memory_resource* resource = pmr::get_default_resource() )
+		: members( resource ), sets( resource ),
+		insertions( 0, std::hash<uint64>(), std::equal_to<uint64>(), resource ),
+		unions( 0, std::hash<uint64>(), std::equal_to<uint64>(), resource ),
+		intersections( 0, std::hash<uint64>(), std::equal_to<uint64>(), resource ) {
+			sets.push_back( extent{ 0, 0 } );
+		}
+
+		buffer_view<const uint32> members_of( hide_set s ) const {
+			extent e = sets[ s ];
+			return buffer_view<const uint32>( members.data() + e.first, e.count );
+		}
+
+		bool contains( hide_set s, identifier_id name ) const {
+			extent e = sets[ s ];
+			const uint32* first = members.data() + e.first;
+			for ( uint32 i = 0; i < e.count; ++i ) {
+				if ( first[ i ] >= name.index ) {
+					return first[ i ] == name.index;
+				}
+			}
+			return false;
+		}
+
+		// s with name added
+		hide_set with( hide_set s, identifier_id name ) {
+			if ( contains( s, name ) ) {
+				return s;
+			}
+			uint64 key = key_of( s, name.index );
+			auto found = insertions.find( key );
+			if ( found != insertions.end() ) {
+				return found->second;
+			}
+			std::size_t first = members.size();
+			extent e = sets[ s ];
+			bool placed = false;
+			for ( uint32 i = 0; i < e.count; ++i ) {
+				uint32 member = members[ e.first + i ];
+				if ( !placed && name.index < member ) {
+					members.push_back( name.index );
+					placed = true;
+				}
+				members.push_back( member );
+			}
+			if ( !placed ) {
+				members.push_back( name.index );
+			}
+			hide_set result = seal( first );
+			insertions.emplace( key, result );
+			return result;
+		}
+
+		hide_set join( hide_set left, hide_set right ) {
+			if ( left == right || right == 0 ) {
+				return left;
+			}
+			if ( left == 0 ) {
+				return right;
+			}
+			uint64 key = unordered_key_of( left, right );
+			auto found = unions.find( key );
+			if ( found != unions.end() ) {
+				return found->second;
+			}
+			hide_set result = merge( left, right, true );
+			unions.emplace( key, result );
+			return result;
+		}
+
+		hide_set intersect( hide_set left, hide_set right ) {
+			if ( left == right ) {
+				return left;
+			}
+			if ( left == 0 || right == 0 ) {
+				return 0;
+			}
+			uint64 key = unordered_key_of( left, right );
+			auto found = intersections.find( key );
+			if ( found != intersections.end() ) {
+				return found->second;
+			}
+			hide_set result = merge( left, right, false );
+			intersections.emplace( key, result );
+			return result;
+		}
+
+		std::size_t size() const {
+			return sets.size();
+		}
+
+		void clear() {
+			members.clear();
+			sets.clear();
+			sets.push_back( extent{ 0, 0 } );
+			insertions.clear();
+			unions.clear();
+			intersections.clear();
+		}
+	};
+
+}}}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "../../keyword_table.hpp"
+#include "../token_id.hpp"
+
+namespace gld { namespace hlsl { namespace pp {
+
+	template <typename = void>
+	struct keyword_tables {
+		// Sorted by length, then bytewise: see keyword_table.hpp
+		static constexpr keyword<token_id> directives[] = {
+			make_keyword( "if", token_id::preprocessor_if ),
+			make_keyword( "...", token_id::dot_dot_dot ),
+			make_keyword( "elif", token_id::preprocessor_else_if ),
+			make_keyword( "else", token_id::preprocessor_else ),
+			make_keyword( "line", token_id::preprocessor_line ),
+			make_keyword( "endif", token_id::preprocessor_end_if ),
+			make_keyword( "error", token_id::preprocessor_error ),
+			make_keyword( "ifdef", token_id::preprocessor_if_def ),
+			make_keyword( "undef", token_id::preprocessor_un_def ),
+			make_keyword( "define", token_id::preprocessor_define ),
+			make_keyword( "ifndef", token_id::preprocessor_if_n_def ),
+			make_keyword( "pragma", token_id::preprocessor_pragma ),
+			make_keyword( "VA_ARGS", token_id::preprocessor_variadic_arguments ),
+			make_keyword( "defined", token_id::preprocessor_defined ),
+			make_keyword( "elifdef", token_id::preprocessor_else_if_def ),
+			make_keyword( "include", token_id::preprocessor_include ),
+			make_keyword( "warning", token_id::preprocessor_warning ),
+			make_keyword( "elifndef", token_id::preprocessor_else_if_n_def ),
+			make_keyword( "row_major", token_id::keyword_row_major ),
+			make_keyword( "packoffset", token_id::keyword_packoffset ),
+			make_keyword( "column_major", token_id::keyword_column_major )
+		};
+
+		static constexpr keyword<token_id> pragmas[] = {
+			make_keyword( "def", token_id::preprocessor_pragma_register_define ),
+			make_keyword( "once", token_id::preprocessor_pragma_once ),
+			make_keyword( "message", token_id::preprocessor_pragma_message ),
+			make_keyword( "warning", token_id::preprocessor_pragma_warning ),
+			make_keyword( "pack_matrix", token_id::preprocessor_pragma_pack_matrix )
+		};
+
+		// What ## may join two punctuators into
+		static constexpr keyword<token_id> pasted_punctuators[] = {
+			make_keyword( "!=", token_id::not_equal_to ),
+			make_keyword( "##", token_id::token_pasting ),
+			make_keyword( "%=", token_id::modulus_assignment ),
+			make_keyword( "&&", token_id::expression_and ),
+			make_keyword( "&=", token_id::boolean_and_assignment ),
+			make_keyword( "*=", token_id::multiply_assignment ),
+			make_keyword( "++", token_id::increment ),
+			make_keyword( "+=", token_id::add_assignment ),
+			make_keyword( "--", token_id::decrement ),
+			make_keyword( "-=", token_id::subtract_assignment ),
+			make_keyword( "/=", token_id::divide_assignment ),
+			make_keyword( "::", token_id::scope_access ),
+			make_keyword( "<<", token_id::left_shift ),
+			make_keyword( "<=", token_id::less_than_or_equal_to ),
+			make_keyword( "==", token_id::equal_to ),
+			make_keyword( ">=", token_id::greater_than_or_equal_to ),
+			make_keyword( ">>", token_id::right_shift ),
+			make_keyword( "^=", token_id::boolean_xor_assignment ),
+			make_keyword( "|=", token_id::boolean_or_assignment ),
+			make_keyword( "||", token_id::expression_or ),
+			make_keyword( "<<=", token_id::left_shift_assignment ),
+			make_keyword( ">>=", token_id::right_shift_assignment )
+		};
+
+		static_assert( is_keyword_table_sorted( directives ), "preprocessor keywords must be sorted by length, then by bytes" );
+		static_assert( is_keyword_table_sorted( pragmas ), "pragma keywords must be sorted by length, then by bytes" );
+		static_assert( is_keyword_table_sorted( pasted_punctuators ), "pasted punctuators must be sorted by length, then by bytes" );
+	};
+
+	template <typename T>
+	constexpr keyword<token_id> keyword_tables<T>::directives[];
+
+	template <typename T>
+	constexpr keyword<token_id> keyword_tables<T>::pragmas[];
+
+	template <typename T>
+	constexpr keyword<token_id> keyword_tables<T>::pasted_punctuators[];
+
+	typedef keyword_tables<> keywords;
+
+}}}
@@ -4,8 +4,42 @@
 
 namespace gld { namespace hlsl { namespace pp {
 
-	inline std::vector<token> lex( string origin, string_view source ) {
-		lexer l( std::move( origin ), source );
+	inline std::vector<token> lex( source_manager& sources, string origin, string_view source ) {
+		lexer l( sources, std::move( origin ), source );
+		return l();
+	}
+
+	inline std::vector<token> lex( source_manager& sources, file_id file ) {
+		lexer l( sources, file );
+		return l();
+	}
+
+	// Lexes only the significant tokens (newlines included, for line structure);
+	// whitespace and comments land in sidetable instead
+	inline std::vector<token> lex( source_manager& sources, file_id file, std::vector<trivia>& sidetable ) {
+		lexer l( sources, file, 4096, trivia_mode::side_table );
+		std::vector<token> tokens = l();
+		sidetable = l.take_side_table();
+		return tokens;
+	}
+
+	// Never throws for broken source: every problem lands in errors,
+	// and the tokens mark where with invalid_* stand-ins
+	inline std::vector<token> lex( source_manager& sources, file_id file, std::vector<lexer_error>& errors ) {
+		lexer l( sources, file, 4096, trivia_mode::tokens, error_mode::recover );
+		std::vector<token> tokens = l();
+		errors = l.take_errors();
+		return tokens;
+	}
+
+	// Token storage comes from resource, so a whole translation unit can share one arena
+	inline pmr::vector<token> lex( source_manager& sources, file_id file, pmr::memory_resource* resource ) {
+		pmr_lexer l( sources, file, 4096, trivia_mode::tokens, error_mode::exceptions, resource );
+		return l();
+	}
+
+	inline packed_tokens lex_packed( source_manager& sources, string origin, string_view source ) {
+		packed_lexer l( sources, std::move( origin ), source );
 		return l();
 	}
 
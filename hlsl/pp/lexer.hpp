@@ -2,135 +2,320 @@
 
 #include "../lexer_head.hpp"
 #include "../token.hpp"
+#include "../packed_tokens.hpp"
+#include "../literals.hpp"
+#include "../source_manager.hpp"
 #include "../lexer_error.hpp"
+#include "keywords.hpp"
+#include "trivia.hpp"
+#include "error_mode.hpp"
 #include "../../optional.hpp"
 #include "../../string.hpp"
 #include "../../unicode.hpp"
-#include "../../lexical_numeric_format.hpp"
-#include "../../lexical_character_format.hpp"
-#include <Furrovine++/scoped_destructor.hpp>
-#include <map>
-#include <unordered_map>
-#include <set>
-#include <unordered_set>
+#include "../../character_table.hpp"
+#include "../../byte_scan.hpp"
+#include "../../utf8.hpp"
+#include <vector>
+#include <limits>
 
 namespace gld { namespace hlsl { namespace pp {
 
-	class lexer {
+	template <typename Tokens = std::vector<token>>
+	class basic_lexer {
 	private:
 		typedef string_view view_type;
-		typedef Furrovine::tmp::range_cbegin_type_t<view_type> begin_iterator;
-		typedef Furrovine::tmp::range_cend_type_t<view_type> end_iterator;
-		typedef begin_iterator iterator;
+		// The lexer walks raw bytes and decodes only the multi-byte sequences it lands on;
+		// a byte that starts no well-formed sequence reads as U+FFFD and is reported (see report_invalid_utf8)
+		typedef utf8_iterator iterator;
+		typedef iterator end_iterator;
 		typedef lexer_head<iterator> read_head;
 		
-		string origin;
+		// stream_begin and stream_end carry it; the manager keeps the origin
+		file_id file;
 		view_type source;
+		// The file's backslash-newlines, which the heads step over as they reach them,
+		// and the copies of the lines they join, which spell any token broken across them
+		splice_map splices;
+		view_type spliced;
+		// Where splice_from last landed
+		mutable std::size_t splicehint;
+		source_location base;
+		// The next byte that is not well-formed UTF-8, or the end of the source when there is none left
+		const char* invalidat;
+		string_pool& names;
 		iterator begin;
 		end_iterator end;
 		
 		read_head consumed;
 		read_head peeked;
 		
-		std::map<string_view, token_id> pragma;
-		std::unordered_map<string_view, token_id> keywords;
-		std::unordered_set<code_point> symbolcharacters;
-		std::vector<token> tokens;
+		Tokens tokens;
+		trivia_mode triviamode;
+		std::vector<trivia> triviatable;
+		error_mode errormode;
+		std::vector<lexer_error> errorlist;
 
 		token_id macrotrigger;
-		bool inmacro, escaped;
-		intz escapecount;
+		bool inmacro;
 		intz blockid;
 
+		// Streaming state: tokens before readindex have been handed out,
+		// and the buffer is only refilled once all of them have been
+		std::size_t window;
+		std::size_t readindex;
+		std::size_t flushedcount;
+		string_view flushedlexeme;
+		bool started, finished;
+		// Trivia or a line break was just consumed, so the next token emit adds is marked spaced
+		bool spacednext;
+		// lex_step stops in front of the first token at or past this offset; see lex_until
+		std::size_t stopoffset;
+
 	public:
-		lexer(string origin, string_view source) 
-		: origin(origin), source(source), begin(adl_cbegin(source)), end(adl_cend(source)), 
-			consumed( adl_cbegin( source ) ),
-			peeked( adl_cbegin( source ) ),
-			inmacro( false ), escaped( false ),
-			escapecount( 0 ), blockid( 0 ) {
-			
-			symbolcharacters.insert( {
-				{ '#' },
-				{ '@' },
-				{ '>' },
-				{ '<' },
-				{ '=' },
-				{ '&' },
-				{ '|' },
-				{ '^' },
-				{ '(' },
-				{ ')' },
-				{ '[' },
-				{ ']' },
-				{ ',' },
-				{ '+' },
-				{ '*' },
-				{ '%' },
-				{ '/' },
-				{ '-' },
-				{ '\\' },
-				{ '"' },
-				{ '\'' },
-				{ ';' },
-				{ ',' },
-				{ '.' },
-				{ '!' },
-				{ '}' },
-				{ '{' }
-			} );
+		basic_lexer(source_manager& sources, string origin, string_view source, std::size_t window = 4096, trivia_mode triviamode = trivia_mode::tokens, error_mode errormode = error_mode::exceptions, pmr::memory_resource* resource = pmr::get_default_resource()) 
+		: basic_lexer( sources, sources.add( std::move( origin ), source ), window, triviamode, errormode, resource ) {
+
+		}
+
+		basic_lexer(source_manager& sources, file_id file, std::size_t window = 4096, trivia_mode triviamode = trivia_mode::tokens, error_mode errormode = error_mode::exceptions, pmr::memory_resource* resource = pmr::get_default_resource()) 
+		: basic_lexer( sources, file, sources.names(), window, triviamode, errormode, resource ) {
+
+		}
 
-			keywords.insert( {
-				{ "...", token_id::dot_dot_dot },
-				{ "VA_ARGS", token_id::preprocessor_variadic_arguments },
-				{ "define", token_id::preprocessor_define },
-				{ "defined", token_id::preprocessor_defined },
-				{ "undef", token_id::preprocessor_un_def },
-				{ "if", token_id::preprocessor_if },
-				{ "elif", token_id::preprocessor_else_if },
-				{ "ifdef", token_id::preprocessor_if_def },
-				{ "elifndef", token_id::preprocessor_else_if_n_def },
-				{ "elifdef", token_id::preprocessor_else_if_def },
-				{ "ifndef", token_id::preprocessor_if_n_def },
-				{ "else", token_id::preprocessor_else },
-				{ "endif", token_id::preprocessor_end_if },
-				{ "include", token_id::preprocessor_include },
-				{ "line", token_id::preprocessor_line },
-				{ "pragma", token_id::preprocessor_pragma },
-				{ "error", token_id::preprocessor_error },
-				{ "warning", token_id::preprocessor_warning },
-				{ "packoffset", token_id::keyword_packoffset },
-				{ "row_major", token_id::keyword_row_major },
-				{ "column_major", token_id::keyword_column_major },
-			});
-
-			pragma.insert({
-				{ "once", token_id::preprocessor_pragma_once },
-				{ "def", token_id::preprocessor_pragma_register_define },
-				{ "pack_matrix", token_id::preprocessor_pragma_pack_matrix },
-				{ "warning", token_id::preprocessor_pragma_warning },
-				{ "message", token_id::preprocessor_pragma_message },
-			});
+		// Interns into names rather than the session pool, for lexers running off the main thread
+		// With Tokens = pmr::vector<token>, the token storage is allocated from resource
+		basic_lexer(const source_manager& sources, file_id file, string_pool& names, std::size_t window = 4096, trivia_mode triviamode = trivia_mode::tokens, error_mode errormode = error_mode::exceptions, pmr::memory_resource* resource = pmr::get_default_resource()) 
+		: file( file ), source( sources.text_of( file ) ),
+			splices( sources.splices_of( file ) ), spliced( sources.spliced_lines_of( file ) ), splicehint( 0 ),
+			base( sources.location( file, 0 ) ),
+			invalidat( first_invalid_utf8_of( sources, file ) ),
+			names( names ),
+			begin( source.data(), source.data_end() ), end( source.data_end(), source.data_end() ), 
+			consumed( begin ),
+			peeked( begin ),
+			tokens( make_token_storage<Tokens>( source, spliced, base, resource ) ),
+			triviamode( triviamode ), errormode( errormode ),
+			inmacro( false ), blockid( 0 ),
+			window( window < 1 ? 1 : window ), readindex( 0 ), flushedcount( 0 ),
+			started( false ), finished( false ), spacednext( false ),
+			stopoffset( std::numeric_limits<std::size_t>::max() ) {
+			consumed.where = base;
+			peeked.where = base;
 		}
 
 		bool is_symbol( code_point u ) const {
-			return symbolcharacters.find( u ) != symbolcharacters.end();
+			return has_character_type( character_type_of( u ), character_type::symbol );
+		}
+
+		// Lexes everything at once
+		Tokens operator()() {
+			fill( std::numeric_limits<std::size_t>::max() );
+			return std::move( tokens );
+		}
+
+		// Pulls the next token, lexing at most another window's worth when the buffer runs dry
+		optional<token> next() {
+			if ( !refill() ) {
+				return none;
+			}
+			return token( tokens[ readindex++ ] );
+		}
+
+		// Hands up to maxtokens tokens to sink, one at a time;
+		// returns how many were handed out, which is 0 only once the stream is over
+		template <typename Sink>
+		std::size_t lex_into( Sink&& sink, std::size_t maxtokens ) {
+			std::size_t count = 0;
+			for ( ; count < maxtokens && refill(); ++count ) {
+				sink( tokens[ readindex++ ] );
+			}
+			return count;
+		}
+
+		bool done() const {
+			return finished && readindex == tokens.size();
+		}
+
+		// Whitespace and comments recorded so far in trivia_mode::side_table, in source order
+		const std::vector<trivia>& side_table() const {
+			return triviatable;
+		}
+
+		std::vector<trivia> take_side_table() {
+			return std::move( triviatable );
+		}
+
+		// Problems found so far in error_mode::recover, in source order
+		const std::vector<lexer_error>& errors() const {
+			return errorlist;
+		}
+
+		std::vector<lexer_error> take_errors() {
+			return std::move( errorlist );
+		}
+
+		// Pieces for lexing one file in chunks (see parallel_lex.hpp):
+		// a lexer can pick up at the start of any line as if everything before it had been lexed,
+		// and be run up to a later line start to check that it arrives there in that same state
+
+		// offset must be 0 or the first byte of a line that does not start with whitespace
+		// and does not carry on the line before it (see splice_map::continues)
+		void start_at( std::size_t offset ) {
+			if ( offset == 0 ) {
+				start();
+				return;
+			}
+			started = true;
+			// The stream-level block start() would have opened
+			++blockid;
+			consumed.at = iterator_at( source.data() + offset );
+			consumed.line_whitespace = true;
+			// The line break just before offset spaces whatever comes first
+			spacednext = true;
+			update( consumed );
+		}
+
+		// Lexes until the next token would start at or past offset. Returns true when that is
+		// exactly at offset with no directive open, which is precisely the state start_at( offset ) assumes
+		bool lex_until( std::size_t offset ) {
+			stopoffset = offset;
+			while ( consumed.available && static_cast<std::size_t>( consumed.offset ) < offset ) {
+				lex_step();
+			}
+			stopoffset = std::numeric_limits<std::size_t>::max();
+			std::size_t reached = static_cast<std::size_t>( std::distance( source.data(), position_of( consumed ) ) );
+			return reached == offset && !inmacro;
+		}
+
+		void end_stream() {
+			finish();
 		}
 
-		std::vector<token> operator()() {
-			tokens.emplace_back( token_id::stream_begin, consumed.where, string_view(), origin );
+		Tokens take_tokens() {
+			return std::move( tokens );
+		}
+
+		// Lexes the rest of the file into the buffer and hands over every token not pulled yet,
+		// dropping the ones already handed out in place rather than copying the rest somewhere else
+		Tokens take_remaining() {
+			fill( std::numeric_limits<std::size_t>::max() );
+			erase_front( tokens, readindex );
+			flushedcount += readindex;
+			readindex = 0;
+			return std::move( tokens );
+		}
+
+	private:
+		void start() {
+			started = true;
+			// The start of the file is the start of a line, so a directive can open it
+			consumed.line_whitespace = true;
+			update( consumed );
+			tokens.emplace_back( token_id::stream_begin, consumed.where, string_view(), file );
 			tokens.emplace_back( token_id::preprocessor_block_begin, consumed.where, string_view(), ++blockid );
-			lex();
+		}
+
+		void finish() {
+			finished = true;
+			report_invalid_utf8( source.data_end() );
 			tokens.emplace_back( token_id::preprocessor_block_end, consumed.where, string_view(), --blockid );
-			tokens.emplace_back( token_id::stream_end, consumed.where, string_view(), origin );
-			return std::move( tokens );
+			tokens.emplace_back( token_id::stream_end, consumed.where, string_view(), file );
 		}
 
+		// Lexes whole steps until at least count tokens are buffered or the input ends.
+		// A step never spans a refill, so fix-ups like consume_include's
+		// still find their tokens in the buffer
+		void fill( std::size_t count ) {
+			if ( !started ) {
+				start();
+			}
+			while ( !finished && tokens.size() < count ) {
+				if ( !lex_step() ) {
+					finish();
+				}
+			}
+		}
+
+		bool refill() {
+			if ( readindex < tokens.size() ) {
+				return true;
+			}
+			if ( finished ) {
+				return false;
+			}
+			if ( !tokens.empty() ) {
+				flushedlexeme = tokens.back().lexeme;
+			}
+			flushedcount += tokens.size();
+			tokens.clear();
+			readindex = 0;
+			fill( window );
+			return readindex < tokens.size();
+		}
+
+		// Every token but the zero-width markers goes through here
+		template <typename... Tn>
+		void emit( Tn&&... argn ) {
+			tokens.emplace_back( std::forward<Tn>( argn )... );
+			if ( spacednext ) {
+				mark_spaced( tokens, tokens.size() - 1 );
+				spacednext = false;
+			}
+		}
+
+		void emit_trivia( token_id id, source_location where, string_view text ) {
+			spacednext = true;
+			if ( triviamode == trivia_mode::tokens ) {
+				tokens.emplace_back( id, where, text );
+				return;
+			}
+			// stream_begin always comes first, so there is always a token to attach to
+			uint32 after = static_cast<uint32>( flushedcount + tokens.size() - 1 );
+			triviatable.push_back( trivia{ id, where, text, after } );
+		}
+
+		static const char* first_invalid_utf8_of( const source_manager& sources, file_id file ) {
+			view_type text = sources.text_of( file );
+			optional<uint32> invalid = sources.invalid_utf8_of( file );
+			return invalid ? text.data() + invalid.get() : text.data_end();
+		}
+
+		// Reports every ill-formed byte before position, each on its own as the heads step over them
+		void report_invalid_utf8( const char* position ) {
+			while ( invalidat < position ) {
+				const char* at = invalidat;
+				invalidat = find_invalid_utf8( at + 1, source.data_end() );
+				report( base.advanced( static_cast<uint32>( std::distance( source.data(), at ) ) ), "source text is not well-formed UTF-8" );
+			}
+		}
+
+		// Throws in error_mode::exceptions; otherwise records the problem, and the caller
+		// marks the spot with an invalid_* token and carries on
+		void report( source_location where, string message ) {
+			lexer_error e( where, std::move( message ) );
+			if ( errormode == error_mode::exceptions ) {
+				throw e;
+			}
+			errorlist.push_back( std::move( e ) );
+		}
+
+		string_view previous_lexeme() const {
+			return tokens.empty() ? flushedlexeme : tokens.back().lexeme;
+		}
+
+	public:
+
 		void update( read_head& r ) const {
+			if ( !splices.empty() ) {
+				skip_splices( r.at );
+			}
 			r.after_available = r.available = r.at != end;
 			if ( !r.available ) {
+				r.offset = r.offset_after = std::distance( source.data(), source.data_end() );
+				r.where = base.advanced( static_cast<uint32>( r.offset ) );
 				r.c = static_cast<code_point>(-1);
 				r.after_c = static_cast<code_point>(-1);
+				r.type = character_type::none;
 				r.previous_line_whitespace = r.line_whitespace;
 				r.line_whitespace = false;
 				r.white_space = false;
@@ -140,15 +325,20 @@ namespace gld { namespace hlsl { namespace pp {
 			}
 			r.after_at = r.at;
 			++r.after_at;
+			if ( !splices.empty() ) {
+				skip_splices( r.after_at );
+			}
 			r.after_available = r.after_at != end;
 			if ( r.after_available ) {
 				r.after_c = *r.after_at;
 			}
-			r.where.offset = std::distance( begin.base(), r.at.base() );
-			r.where.offset_after = std::distance( begin.base(), r.after_at.base() );
+			r.offset = std::distance( begin.base(), r.at.base() );
+			r.offset_after = std::distance( begin.base(), r.after_at.base() );
+			r.where = base.advanced( static_cast<uint32>( r.offset ) );
 			r.c = *r.at;
-			r.line_terminator = Unicode::is_line_terminator( r.c );
-			r.white_space = r.line_terminator || Unicode::is_white_space( r.c );
+			r.type = character_type_of( r.c );
+			r.line_terminator = has_character_type( r.type, character_type::line_terminator );
+			r.white_space = has_character_type( r.type, character_type::whitespace );
 			r.previous_line_whitespace = r.line_whitespace;
 			if ( !r.white_space ) {
 				r.line_whitespace = false;
@@ -165,19 +355,104 @@ namespace gld { namespace hlsl { namespace pp {
 			if ( !r.available ) {
 				return false;
 			}
-			if ( r.line_terminator ) {
-				if ( !r.compound_line_terminator ) {
-					++r.where.line;
-					++r.where.processed_line;
-					r.where.column = 0;
-				}
-			}
+			// Lines and columns are not tracked here: source_manager
+			// derives them from the token's location when something asks
 			++r.at;
-			++r.where.column;
 			update( r );
 			return true;
 		}
 
+		const char* position_of( const read_head& r ) const {
+			return r.available ? source.data() + r.offset : source.data_end();
+		}
+
+		string_view view_of( iterator first, iterator last ) const {
+			if ( splices.empty() ) {
+				return string_view( first.base(), last.base() );
+			}
+			uint32 from = static_cast<uint32>( std::distance( source.data(), first.base() ) );
+			uint32 to = static_cast<uint32>( std::distance( source.data(), last.base() ) );
+			std::size_t i = splice_from( from );
+			if ( i == splices.size() || splices.entries()[ i ].physical >= to ) {
+				return string_view( first.base(), last.base() );
+			}
+			return splices.spelling( source.data(), spliced.data(), from, to );
+		}
+
+		// Index of the first splice at or past offset; the heads mostly move forward
+		// a little at a time, so the search starts where the last one ended
+		std::size_t splice_from( std::size_t offset ) const {
+			const std::vector<line_splice>& entries = splices.entries();
+			while ( splicehint > 0 && entries[ splicehint - 1 ].physical >= offset ) {
+				--splicehint;
+			}
+			while ( splicehint < entries.size() && entries[ splicehint ].physical < offset ) {
+				++splicehint;
+			}
+			return splicehint;
+		}
+
+		// Moves at past the splices that start right where it is, if any
+		void skip_splices( iterator& at ) const {
+			const std::vector<line_splice>& entries = splices.entries();
+			std::size_t offset = static_cast<std::size_t>( std::distance( source.data(), at.base() ) );
+			std::size_t i = splice_from( offset );
+			if ( i == entries.size() || entries[ i ].physical != offset ) {
+				return;
+			}
+			std::size_t skipped = offset;
+			for ( ; i < entries.size() && entries[ i ].physical == skipped; ++i ) {
+				skipped += entries[ i ].length;
+			}
+			at = iterator_at( source.data() + skipped );
+		}
+
+		// How far a raw scan from r may read: up to the next splice, which the heads have to step over
+		const char* scan_limit( const read_head& r ) const {
+			if ( splices.empty() || !r.available ) {
+				return source.data_end();
+			}
+			std::size_t i = splice_from( static_cast<std::size_t>( r.offset ) );
+			if ( i == splices.size() || splices.entries()[ i ].physical >= static_cast<std::size_t>( std::distance( source.data(), source.data_end() ) ) ) {
+				return source.data_end();
+			}
+			return source.data() + splices.entries()[ i ].physical;
+		}
+
+		// As track_line_whitespace, without taking the line terminators of splices in [first, last) for line ends
+		bool track_spliced_line_whitespace( const char* first, const char* last, bool linewhitespace ) const {
+			const std::vector<line_splice>& entries = splices.entries();
+			for ( std::size_t i = splice_from( static_cast<std::size_t>( std::distance( source.data(), first ) ) ); first != last; ++i ) {
+				const char* stop = i < entries.size() && entries[ i ].physical < static_cast<std::size_t>( std::distance( source.data(), last ) ) ? source.data() + entries[ i ].physical : last;
+				linewhitespace = track_line_whitespace( first, stop, linewhitespace );
+				first = stop == last ? last : stop + entries[ i ].length;
+			}
+			return linewhitespace;
+		}
+
+		iterator iterator_at( const char* target ) const {
+			return iterator( begin.base() + std::distance( source.data(), target ), end.base() );
+		}
+
+		// Moves r forward to target in one step, fixing up the line-whitespace state
+		// as if advance had been called on every code point between
+		void seek( read_head& r, const char* target ) {
+			const char* first = position_of( r );
+			if ( target <= first ) {
+				return;
+			}
+			r.line_whitespace = splices.empty() ? track_line_whitespace( first, target, r.previous_line_whitespace )
+				: track_spliced_line_whitespace( first, target, r.previous_line_whitespace );
+			r.at = iterator_at( target );
+			update( r );
+		}
+
+		bool skip_blanks( read_head& r ) {
+			const char* first = position_of( r );
+			seek( r, find_blank_end( first, scan_limit( r ) ) );
+			return position_of( r ) != first;
+		}
+
 		template <typename Predicate>
 		void advance_if( read_head& r, Predicate&& predicate ) {
 			while ( predicate( r ) ) {
@@ -220,7 +495,8 @@ namespace gld { namespace hlsl { namespace pp {
 				foundnewline = true;
 			}
 			if ( addtokens && foundnewline )
-				tokens.emplace_back( token_id::newlines, beginwhere, source.subview( beginat, consumed.at ) );
+				emit( token_id::newlines, beginwhere, view_of( beginat, consumed.at ) );
+			spacednext |= foundnewline;
 			return foundnewline;
 		}
 
@@ -232,13 +508,14 @@ namespace gld { namespace hlsl { namespace pp {
 				if ( consumed.line_terminator ) {
 					foundwhitespace |= consume_newlines();
 					beginat = consumed.at;
+					beginwhere = consumed.where;
 				}
-				else {
+				else if ( !skip_blanks( consumed ) ) {
 					consume();
 				}
 			}
 			if ( beginat != consumed.at ) {
-				tokens.emplace_back( token_id::whitespace, beginwhere, source.subview( beginat, consumed.at ) );
+				emit_trivia( token_id::whitespace, beginwhere, view_of( beginat, consumed.at ) );
 				foundwhitespace |= true;
 			}
 			return foundwhitespace;
@@ -249,10 +526,12 @@ namespace gld { namespace hlsl { namespace pp {
 			auto beginwhere = consumed.where;
 			while ( consumed.available && consumed.white_space 
 				&& !consumed.line_terminator ) {
-				consume();
+				if ( !skip_blanks( consumed ) ) {
+					consume();
+				}
 			}
 			if ( beginat != consumed.at ) {
-				tokens.emplace_back( token_id::whitespace, beginwhere, source.subview( beginat, consumed.at ) );
+				emit_trivia( token_id::whitespace, beginwhere, view_of( beginat, consumed.at ) );
 				return true;
 			}
 			return false;
@@ -261,9 +540,9 @@ namespace gld { namespace hlsl { namespace pp {
 		string_view read_non_whitespace( read_head& target ) {
 			auto beginat = target.at;
 			advance_if( target, []( read_head& r ) {
-				return r.available && !Unicode::is_white_space( r.c );
+				return r.available && !r.white_space;
 			} );
-			return source.subview( beginat, target.at );
+			return view_of( beginat, target.at );
 		}
 
 		string_view peek_non_whitespace() {
@@ -276,51 +555,61 @@ namespace gld { namespace hlsl { namespace pp {
 
 		string_view read_identifier( read_head& target )  {
 			auto beginat = target.at;
-			if ( !target.available || !Unicode::ucd::is_id_start( target.c ) ) {
-				return source.subview( beginat, target.at );
+			if ( !target.available || !has_character_type( target.type, character_type::id_start ) ) {
+				return view_of( beginat, target.at );
 			}
 			advance_if( target, []( read_head& r ) {
-				return r.available && Unicode::ucd::is_id_continue( r.c );
+				return r.available && has_character_type( r.type, character_type::id );
 			} );
-			return source.subview( beginat, target.at );
+			return view_of( beginat, target.at );
 		}
 
-		void consume_comment( token_id commentstyle, occurrence startwhere, string_view start ) {
+		void consume_comment( token_id commentstyle, source_location startwhere, string_view start ) {
 			auto beginat = consumed.at;
 			auto beginwhere = consumed.where;
 			switch ( commentstyle ) {
 			case token_id::line_comment_begin:
-				tokens.emplace_back( token_id::line_comment_begin, startwhere, start );
-				while ( !Unicode::is_line_terminator( consumed.c ) ) {
-					consume();
+				emit_trivia( token_id::line_comment_begin, startwhere, start );
+				for ( ; ; ) {
+					// Stops on ASCII terminators and on any multi-byte character,
+					// which may be one of the Unicode terminators; a splice just carries the comment on
+					const char* limit = scan_limit( consumed );
+					const char* stop = find_line_end( position_of( consumed ), limit );
+					seek( consumed, stop );
+					if ( !consumed.available || consumed.line_terminator ) {
+						break;
+					}
+					if ( stop != limit ) {
+						consume();
+					}
 				}
-				tokens.emplace_back( token_id::comment_text, beginwhere, source.subview( beginat, consumed.at ) );
-				tokens.emplace_back( token_id::line_comment_end, consumed.where, source.subview( consumed.at, consumed.at ) );
+				emit_trivia( token_id::comment_text, beginwhere, view_of( beginat, consumed.at ) );
+				emit_trivia( token_id::line_comment_end, consumed.where, view_of( consumed.at, consumed.at ) );
 				break;
 			case token_id::block_comment_begin:
-				tokens.emplace_back( token_id::block_comment_begin, startwhere, start );
-				sync_peeked( consumed, 1 );
-				while ( !(peeked.c == '/' && consumed.c == '*') ) {
-					if ( !peeked.available || !consumed.available ) {
+				emit_trivia( token_id::block_comment_begin, startwhere, start );
+				{
+					const char* commentend = find_comment_end( consumed );
+					if ( commentend == source.data_end() ) {
 						// if we reach the end of input, this is a lexing error?
 						// e.g., no end of comment was found
 						// can you start a comment in one file, #include that file elsewhere,
 						// and then end the comment after the #include ? Must look into...
 						// No, you can't, because the #include for a block comment would
 						// be considered a comment, not a preprocessing directive
-						// TODO: actually write a proper error here...
-						throw lexer_error();
-					}
-					if ( Unicode::is_line_terminator( consumed.c ) ) {
-						consume_newlines( false );
-						// Re-align peek and consumed heads
-						sync_peeked( consumed, 1 );
+						report( startwhere, "unterminated block comment" );
+						// The comment swallows the rest of the input, and is closed with a marker instead of "*/"
+						seek( consumed, commentend );
+						emit_trivia( token_id::comment_text, beginwhere, view_of( beginat, consumed.at ) );
+						emit_trivia( token_id::invalid_comment, consumed.where, view_of( consumed.at, consumed.at ) );
+						break;
 					}
-					consume();
-					peek();
+					seek( consumed, commentend );
+					sync_peeked( consumed, 1 );
 				}
-				tokens.emplace_back( token_id::comment_text, beginwhere, source.subview( beginat, consumed.at ) );
-				tokens.emplace_back( token_id::block_comment_end, consumed.where, source.subview( consumed.at, peeked.after_at ) );
+				emit_trivia( token_id::comment_text, beginwhere, view_of( beginat, consumed.at ) );
+				emit_trivia( token_id::block_comment_end, consumed.where, view_of( consumed.at, peeked.after_at ) );
+				sync_consumed( peeked, 1 );
 				break;
 			default:
 				// TODO: proper error
@@ -330,6 +619,23 @@ namespace gld { namespace hlsl { namespace pp {
 			}
 		}
 
+		// Where the "*/" that closes a block comment begins, or the end of the text. The scan stops at each splice,
+		// since a "*" before one and a "/" after it close the comment as well
+		const char* find_comment_end( read_head r ) {
+			const char* from = position_of( r );
+			for ( ; ; ) {
+				const char* limit = scan_limit( r );
+				const char* found = find_block_comment_end( position_of( r ), limit );
+				if ( found != limit || limit == source.data_end() ) {
+					return found;
+				}
+				seek( r, limit );
+				if ( limit - 1 >= from && limit[ -1 ] == '*' && r.available && r.c == '/' ) {
+					return limit - 1;
+				}
+			}
+		}
+
 		bool consume_comment() {
 			auto beginwhere = consumed.where;
 			if ( consumed.c != '/' ) {
@@ -337,13 +643,13 @@ namespace gld { namespace hlsl { namespace pp {
 			}
 			sync_peeked( consumed, 1 );
 			if ( peeked.c == '/' ) {
-				auto start = source.subview( consumed.at, peeked.after_at );
-				sync_consumed( peeked );
+				auto start = view_of( consumed.at, peeked.after_at );
+				sync_consumed( peeked, 1 );
 				consume_comment( token_id::line_comment_begin, beginwhere, start );
 			}
 			else if ( peeked.c == '*' ) {
-				auto start = source.subview( consumed.at, peeked.after_at );
-				sync_consumed( peeked );
+				auto start = view_of( consumed.at, peeked.after_at );
+				sync_consumed( peeked, 1 );
 				consume_comment( token_id::block_comment_begin, beginwhere, start );
 			}
 			else {
@@ -364,6 +670,11 @@ namespace gld { namespace hlsl { namespace pp {
 			case token_id::preprocessor_if:
 			case token_id::preprocessor_if_def:
 			case token_id::preprocessor_if_n_def:
+			case token_id::preprocessor_else_if:
+			case token_id::preprocessor_else_if_def:
+			case token_id::preprocessor_else_if_n_def:
+			case token_id::preprocessor_else:
+				// Each branch gets its own block; the next #elif, #else or #endif closes it
 				tokens.emplace_back( token_id::preprocessor_block_begin, consumed.where, view_type() );
 				macrotrigger = token_id::whitespace;
 				break;
@@ -375,9 +686,9 @@ namespace gld { namespace hlsl { namespace pp {
 			consume_whitespace_notnewline();
 			auto beginwhere = consumed.where;
 			string_view keyword = consume_non_whitespace();
-			auto pragmafind = pragma.find( keyword );
+			optional<token_id> pragmafind = find_keyword( keywords::pragmas, keyword );
 			token_id tokenid = token_id::preprocessor_pragma_custom;
-			if ( pragmafind == pragma.end() ) {
+			if ( !pragmafind ) {
 				// TODO: are unknown pragmas supposed to be ignored?
 				// I think they are. So technically, this should be a lex_warning,
 				// but you can't throw warnings, so we need
@@ -387,9 +698,9 @@ namespace gld { namespace hlsl { namespace pp {
 				// throw lexer_error();
 			}
 			else {
-				tokenid = pragmafind->second;
+				tokenid = pragmafind.get();
 			}
-			tokens.emplace_back( tokenid, beginwhere, keyword );
+			emit( tokenid, beginwhere, keyword );
 		}
 
 		void consume_include() {
@@ -397,20 +708,18 @@ namespace gld { namespace hlsl { namespace pp {
 			consume_whitespace();
 			// If it's not a quotes-based string...
 			if ( consume_string( '"', '"' ) ) {
-				token& t = tokens[ idx ];
-				t.value = inclusion_style::quote;
+				assign_value( tokens, idx, inclusion_style::quote );
 				return;
 			}
 			// Then it's a bracket based one. Maybe.
 			if ( !consume_string( '<', '>' ) ) {
-				// TODO: proper lexer error
-				// invalid format for #include
 				// TODO: shut off error throwing if
 				// in an invalid block, maybe?
-				throw lexer_error();
+				report( consumed.where, "expected \"file\" or <file> after #include" );
+				emit( token_id::invalid_include, consumed.where, view_of( consumed.at, consumed.at ) );
+				return;
 			}
-			token& t = tokens[ idx ];
-			t.value = inclusion_style::angle_bracket;
+			assign_value( tokens, idx, inclusion_style::angle_bracket );
 		}
 
 		void consume_macro( token_id preprocessorid ) {
@@ -446,214 +755,88 @@ namespace gld { namespace hlsl { namespace pp {
 			}
 		}
 
+		bool ends_block( token_id preprocessorid ) const {
+			switch ( preprocessorid ) {
+			case token_id::preprocessor_end_if:
+			case token_id::preprocessor_else:
+			case token_id::preprocessor_else_if:
+			case token_id::preprocessor_else_if_def:
+			case token_id::preprocessor_else_if_n_def:
+				return true;
+			default:
+				break;
+			}
+			return false;
+		}
+
 		bool consume_preprocessor() {
 			if ( !consumed.previous_line_whitespace || consumed.c != '#' )
 				return false;
 			auto beginat = consumed.at;
 			auto beginwhere = consumed.where;
+			// Read the directive name ahead with the peek head before emitting anything,
+			// so a block end can be appended in front of the hash rather than
+			// inserted behind it later: the token stream only ever grows at the back
+			sync_peeked( consumed );
+			peek();
+			advance_if( peeked, []( read_head& r ) {
+				return r.available && r.white_space && !r.line_terminator;
+			} );
+			auto keywordwhere = peeked.where;
+			string_view keyword = peek_non_whitespace();
+			optional<token_id> keywordsfind = find_keyword( keywords::directives, keyword );
+			if ( keywordsfind && ends_block( keywordsfind.get() ) ) {
+				tokens.emplace_back( token_id::preprocessor_block_end, beginwhere, view_of( beginat, peeked.at ) );
+			}
 			consume();
-			auto blockendtarget = tokens.size();
-			tokens.emplace_back( token_id::preprocessor_hash, beginwhere, source.subview( beginat, consumed.at ) );
+			emit( token_id::preprocessor_hash, beginwhere, view_of( beginat, consumed.at ) );
 			if ( !consumed.available ) {
 				// TODO: throw lex error or
 				// let parser catch Unexpected Stream End?
 				return false;
 			}
 			consume_whitespace_notnewline();
-			sync_peeked( consumed );
-			beginwhere = consumed.where;
-			string_view keyword = peek_non_whitespace();
 			if ( keyword.empty() ) {
 				// TODO: throw lex error or
 				// let parser catch Unexpected Stream End?
 				return false;
 			}
 			sync_consumed( peeked );
-			auto keywordsfind = keywords.find( keyword );
-			if ( keywordsfind == keywords.end() ) {
-				// TODO: proper lex error
-				// Bad keyword for preprocessor (only pragmas can handle unknown preprocessors, right?)
-				throw lexer_error();
-			}
-			switch ( keywordsfind->second ) {
-			case token_id::preprocessor_end_if:
-			case token_id::preprocessor_else:
-			case token_id::preprocessor_else_if:
-			case token_id::preprocessor_else_if_def:
-			case token_id::preprocessor_else_if_n_def:
-				tokens.emplace( tokens.begin() + blockendtarget, token_id::preprocessor_block_end, beginwhere, source.subview( beginat, consumed.at ) );
-				break;
+			if ( !keywordsfind ) {
+				// Only pragmas can carry unknown names; a bad directive still spans its line,
+				// so the parser can skip it as one statement
+				report( keywordwhere, "unknown preprocessor directive" );
+				emit( token_id::invalid_directive, keywordwhere, keyword );
+				activate_macro( token_id::invalid_directive );
+				return true;
 			}
-			tokens.emplace_back( keywordsfind->second, beginwhere, keyword );
-			consume_macro( keywordsfind->second );
+			emit( keywordsfind.get(), keywordwhere, keyword );
+			consume_macro( keywordsfind.get() );
 			return true;
 		}
 
 		void consume_numeric() {
 			auto beginat = consumed.at;
 			auto beginwhere = consumed.where;
-			bool floating = false;
-			bool suffix = false;
-			bool invalid = false;
-			bool negative = false;
-			bool negativeexponent = false;
-			bool exponentiation = false;
-			lexical_numeric_format format = lexical_numeric_format::decimal;
-
-			if ( consumed.available && consumed.c == '-' ) {
-				negative = true;
-				consume();
+			const char* first = position_of( consumed );
+			const char* limit = scan_limit( consumed );
+			const char* last = scan_numeric_literal( first, limit );
+			if ( last == limit && limit != source.data_end() ) {
+				// The literal may go on past the splice: scan it again in its line's copy, where it is whole
+				uint32 offset = static_cast<uint32>( std::distance( source.data(), first ) );
+				string_view line = splices.spliced_from( spliced.data(), offset );
+				uint32 length = static_cast<uint32>( std::distance( line.data(), scan_numeric_literal( line.data(), line.data_end() ) ) );
+				last = source.data() + splices.physical_offset( splices.logical_offset( offset ) + length );
 			}
-			if ( consumed.available && consumed.c == '0' ) {
-				consume();
-				if ( consumed.c == 'x' ) {
-					format = lexical_numeric_format::hex;
-					consume();
-				}
-				else if ( consumed.c == 'b' ) {
-					format = lexical_numeric_format::binary;
-					consume();
-				}
-				else if ( consumed.c == 'o' ) {
-
-				}
-				else {
-					format = lexical_numeric_format::octal;
-				}
-
-			}
-			switch ( format ) {
-			case lexical_numeric_format::hex:
-				for ( ; consumed.available && !consumed.white_space; consume() ) {
-					switch ( consumed.c ) {
-					case '0':
-					case '1':
-					case '2':
-					case '3':
-					case '4':
-					case '5':
-					case '6':
-					case '7':
-					case '8':
-					case '9':
-					case 'a':
-					case 'A':
-					case 'b':
-					case 'B':
-					case 'c':
-					case 'C':
-					case 'e':
-					case 'E':
-					case 'd':
-					case 'D':
-					case 'f':
-					case 'F':
-						continue;
-					default:
-						invalid = true;
-						break;
-					}
-					break;
-				}
-				break;
-			case lexical_numeric_format::binary:
-				for ( ; consumed.available && !consumed.white_space; consume() ) {
-					switch ( consumed.c ) {
-					case '0':
-					case '1':
-						continue;
-					default:
-						invalid = true;
-						break;
-					}
-					break;
-				}
-				break;
-			case lexical_numeric_format::octal:
-				for ( ; consumed.available && !consumed.white_space; consume() ) {
-					switch ( consumed.c ) {
-					case '0':
-					case '1':
-					case '2':
-					case '3':
-					case '4':
-					case '5':
-					case '6':
-					case '7':
-						continue;
-					default:
-						invalid = true;
-						break;
-					}
-					break;
-				}
-				break;
-			case lexical_numeric_format::decimal:
-				for ( ; consumed.available && !consumed.white_space; consume() ) {
-					switch ( consumed.c ) {
-					case '0': case '1': case '2':
-					case '3': case '4': case '5':
-					case '6': case '7': case '8':
-					case '9':
-						continue;
-					case '.':
-					case 'e':
-					case 'E':
-						break;
-					default:
-						invalid = true;
-						continue;
-					}
-					break;
-				}
-				if ( consumed.c == '.' ) {
-					consume();
-					for ( ; consumed.available && !consumed.white_space; consume() ) {
-						switch ( consumed.c ) {
-						case '0': case '1': case '2':
-						case '3': case '4': case '5':
-						case '6': case '7': case '8':
-						case '9':
-							continue;
-						case 'e': case 'E':
-							break;
-						default:
-							invalid = true;
-							continue;
-						}
-						break;
-					}
-				}
-				if ( consumed.c == 'e' || consumed.c == 'E' ) {
-					consume();
-					exponentiation = true;
-					if ( consumed.available && consumed.c == '-' ) {
-						negativeexponent = true;
-						consume();
-					}
-					for ( ; consumed.available && !consumed.white_space; consume() ) {
-						switch ( consumed.c ) {
-						case '0': case '1': case '2':
-						case '3': case '4': case '5':
-						case '6': case '7': case '8':
-						case '9':
-							continue;
-						default:
-							invalid = true;
-							continue;
-						}
-						break;
-					}
-				}
-				break;
+			seek( consumed, last );
+			auto numeric = view_of( beginat, consumed.at );
+			// Decode once here so constant folding and #if evaluation never re-parse the lexeme
+			numeric_literal literal = decode_numeric_literal( numeric.data(), numeric.data_end() );
+			if ( literal.value.is<unit>() ) {
+				emit( literal.id, beginwhere, numeric );
+				return;
 			}
-			// TODO: properly serialize a value
-			// into the token for use with constant expression folding and the like
-			// TODO: generic storage mechanism inside "token" ? unique_ptr the token
-			// or do we create a Small Buffer (the size of a pointer) and any struct that's
-			// larger than that pointer is stored as a pointer, while rest of by-value...?
-			auto numeric = source.subview( beginat, consumed.at );
-			tokens.emplace_back( invalid ? token_id::invalid_literal : floating ? token_id::float_literal : token_id::integer_literal, beginwhere, numeric );
+			emit( literal.id, beginwhere, numeric, std::move( literal.value ) );
 		}
 
 		void consume_char() {
@@ -662,134 +845,32 @@ namespace gld { namespace hlsl { namespace pp {
 			}
 			auto beginat = consumed.at;
 			auto beginwhere = consumed.where;
-			lexical_character_format format = lexical_character_format::normal;
-			bool checkoctal = false;
-			bool invalid = false;
 			consume();
-			tokens.emplace_back( token_id::character_literal_begin, beginwhere, source.subview( beginat, consumed.at ) );
+			emit( token_id::character_literal_begin, beginwhere, view_of( beginat, consumed.at ) );
 			beginat = consumed.at;
 			beginwhere = consumed.where;
 
-			for ( bool charescaped = false; consumed.available && ( charescaped || consumed.c != '\'' ); consume() ) {
-				if ( charescaped ) {
-					if ( consumed.c == 'x' ) {
-						format = lexical_character_format::hex;
-					}
-					else {
-						checkoctal = true;
-					}
-				}
-				else if ( consumed.c == '\\' ) {
-					charescaped = true;
-					continue;
-				}
-				charescaped = false;
+			for ( bool charescaped = false; consumed.available && !consumed.line_terminator && ( charescaped || consumed.c != '\'' ); consume() ) {
+				charescaped = !charescaped && consumed.c == '\\';
 			}
 
-			if ( !consumed.available )
+			auto characterlexeme = view_of( beginat, consumed.at );
+			if ( !consumed.available || consumed.line_terminator ) {
+				emit( token_id::invalid_literal, beginwhere, characterlexeme );
 				return;
-
-			auto characterlexeme = source.subview( beginat, consumed.at );
-			auto characterlexemewhere = beginwhere;
-			
-			if ( checkoctal ) {
-				auto target = characterlexeme.begin();
-				// TODO:
-				// Perhaps a more-clear expression might be
-				// in order...
-				format = characterlexeme.size() == 4 
-					&& Unicode::is_numeric( *++target )
-					&& Unicode::is_numeric( *++target ) 
-					&& Unicode::is_numeric( *++target ) ?
-					lexical_character_format::octal 
-					: format;
-			}
-			else if ( format == lexical_character_format::hex ) {
-				auto characterlexemeend = characterlexeme.end();
-				intz tickcount = 0;
-				for ( auto it = ++characterlexeme.begin(); it != characterlexemeend; ++it ) {
-					if ( tickcount == 2 ) {
-						invalid = true;
-						break;
-					}
-					code_point cp = *it;
-					switch ( cp ) {
-					case '0': case '1': case '2':
-					case '3': case '4': case '5':
-					case '6': case '7': case '8':
-					case '9': case 'A': case 'B':
-					case 'C': case 'D': case 'E':
-					case 'F': case 'a': case 'b':
-					case 'c': case 'd': case 'e':
-					case 'f':
-						continue;
-					case '\'':
-						++tickcount;
-						if ( tickcount < 2 ) {
-							continue;
-						}
-						invalid = true;
-						break;
-					default:
-						// Bad character format
-						invalid = true;
-						break;
-					}
-					break;
-				}
+			}
+			optional<code_point> value = decode_character_literal( characterlexeme.data(), characterlexeme.data_end() );
+			if ( value ) {
+				emit( token_id::character_literal, beginwhere, characterlexeme, value.get() );
+			}
+			else {
+				emit( token_id::invalid_literal, beginwhere, characterlexeme );
 			}
 
 			beginat = consumed.at;
 			beginwhere = consumed.where;
-			Furrovine::make_destructor(
-				[&]() {
-					consume();
-					tokens.emplace_back( token_id::character_literal_end, beginwhere, source.subview( beginat, consumed.at ) );
-				}
-			);
-
-			if ( invalid ) {
-				tokens.emplace_back( token_id::character_literal, characterlexemewhere, characterlexeme );
-				return;
-			}
-			
-			// TODO: need to handle character literals
-			// and serialize / save that information with the token
-			code_point value = 0;
-			intz shift = 0;
-			switch ( format ) {
-			case lexical_character_format::octal: {
-				const char* start = characterlexeme.data();
-				const char* desiredend = characterlexeme.data_end() - 1;
-				char* end = nullptr;
-				++start;
-				value = std::strtoul( start, &end, 8 );
-				if ( end != desiredend ) {
-					invalid = true;
-				}
-				break; }
-			case lexical_character_format::hex: {
-				const char* start = characterlexeme.data();
-				const char* desiredend = characterlexeme.data_end() - 1;
-				char* end = nullptr;
-				++++start;
-				value = std::strtoul( start, &end, 16 );
-				if ( end != desiredend ) {
-					invalid = true;
-				}
-				break; }
-			case lexical_character_format::normal:
-			default: {
-				// TODO: properly handle multi-character literals?
-				// TODO: unicode character literals?
-				auto it = ++characterlexeme.begin();
-				auto characterlexemeend = --characterlexeme.end();
-				for ( ; it != characterlexemeend; ++it, shift += 8 ) {
-					value = value |= (uint8)(*++characterlexeme.begin() << shift);
-				}
-				break; }
-			}
-			tokens.emplace_back( token_id::character_literal, beginwhere, characterlexeme, value );
+			consume();
+			emit( token_id::character_literal_end, beginwhere, view_of( beginat, consumed.at ) );
 		}
 
 		bool consume_raw_string() {
@@ -812,12 +893,27 @@ namespace gld { namespace hlsl { namespace pp {
 			auto beginat = consumed.at;
 			auto beginwhere = consumed.where;
 			consume();
-			tokens.emplace_back( token_id::string_literal_begin, beginwhere, source.subview( beginat, consumed.at ) );
+			emit( token_id::string_literal_begin, beginwhere, view_of( beginat, consumed.at ) );
 			beginat = consumed.at;
+			beginwhere = consumed.where;
 			for ( bool stringescaped = false; stringescaped ? true : consumed.c != enddelimeter; consume() ) {
+				if ( !stringescaped ) {
+					// Scans on past any splices, which stop the scan without ending anything
+					for ( ; ; ) {
+						const char* limit = scan_limit( consumed );
+						const char* stop = find_string_stop( position_of( consumed ), limit, enddelimeter );
+						seek( consumed, stop );
+						if ( stop != limit || limit == source.data_end() ) {
+							break;
+						}
+					}
+					if ( consumed.c == enddelimeter ) {
+						break;
+					}
+				}
 				if ( !consumed.available ) {
 					// Broken string literal, how to indicate it's a bad value that's consumed all input?
-					// tokens.emplace_back( token_id::string_literal, beginwhere, source.subview( beginat, consumed.at ) );
+					// tokens.emplace_back( token_id::string_literal, beginwhere, view_of( beginat, consumed.at ) );
 					// introduce string literal markers: 
 					// we just check for if there's a matching string_literal_end for every string_literal_begin
 					return false;
@@ -833,10 +929,11 @@ namespace gld { namespace hlsl { namespace pp {
 				}
 				stringescaped = false;
 			}
-			tokens.emplace_back( token_id::string_literal, beginwhere, source.subview( beginat, consumed.at ) );
+			emit( token_id::string_literal, beginwhere, view_of( beginat, consumed.at ) );
 			beginat = consumed.at;
+			beginwhere = consumed.where;
 			consume();
-			tokens.emplace_back( token_id::string_literal_end, beginwhere, source.subview( beginat, consumed.at ) );
+			emit( token_id::string_literal_end, beginwhere, view_of( beginat, consumed.at ) );
 			return true;
 		}
 
@@ -847,265 +944,267 @@ namespace gld { namespace hlsl { namespace pp {
 			string_view identifier = read_identifier( peeked );
 			if ( !identifier.empty() ) {
 				sync_consumed( peeked );
-				auto keywordsfind = keywords.find( identifier );
-				if ( keywordsfind != keywords.end() ) {
-					tokens.emplace_back( keywordsfind->second, beginwhere, identifier );
+				optional<token_id> keywordsfind = find_keyword( keywords::directives, identifier );
+				if ( keywordsfind ) {
+					emit( keywordsfind.get(), beginwhere, identifier );
 					return;
 				}
-				tokens.emplace_back( token_id::identifier, beginwhere, identifier );
+				// Interned once here, so every later macro lookup and name comparison is an integer compare
+				emit( token_id::identifier, beginwhere, identifier, names.intern( identifier ) );
 				return;
 			}
 			consume();
-			tokens.emplace_back( token_id::identifier, beginwhere, source.subview( beginat, consumed.at ) );
+			identifier = view_of( beginat, consumed.at );
+			emit( token_id::identifier, beginwhere, identifier, names.intern( identifier ) );
 		}
 
-		void lex ( ) {
-			update( consumed );
-			if ( !consumed.available ) {
-				return;
-			}
-			
-			// Now we're ready to roll
-			for ( ; consumed.available; ) {
-				if ( inmacro ) {
-					consume_whitespace_notnewline();
-					if ( consumed.line_terminator ) {
-						if ( consumed.compound_line_terminator ) {
-							continue;
-						}
-						if ( escaped ) {
-							auto escapedat = consumed.at;
-							auto escapedwhere = consumed.where;
-							consume();
-							tokens.emplace_back( token_id::preprocessor_escaped_newline, escapedwhere, source.subview( escapedat, consumed.at ) );
-							escaped = false;
-							continue;
-						}
-						deactivate_macro();
-						continue;
+		// Lexes one construct (or one run of whitespace); returns false once the input is exhausted
+		bool lex_step ( ) {
+			if ( inmacro ) {
+				consume_whitespace_notnewline();
+				if ( consumed.line_terminator ) {
+					if ( consumed.compound_line_terminator ) {
+						// Step onto the '\n' so the pair ends the directive once
+						consume();
+						return true;
 					}
+					deactivate_macro();
+					return true;
 				}
-				else {
-					consume_whitespace();
-				}
+			}
+			else {
+				consume_whitespace();
+			}
 
-				if ( !consumed.available )
-					break;
+			if ( !consumed.available )
+				return false;
+			if ( static_cast<std::size_t>( consumed.offset ) >= stopoffset )
+				return true;
+			// Ill-formed bytes inside comments and literals the last step swallowed
+			report_invalid_utf8( position_of( consumed ) );
 
-				auto beginat = consumed.at;
-				auto beginwhere = consumed.where;
-				switch ( consumed.c ) {
-				case '\\':
-					consume();
-					if ( inmacro ) {
-						tokens.emplace_back( token_id::escape, beginwhere, source.subview( beginat, consumed.at ) );
-						escaped = true;
-					}
-					else if ( escaped ) {
-						tokens.emplace_back( token_id::back_slash, beginwhere, source.subview( beginat, consumed.at ) );
-					}
-					else {
-						tokens.emplace_back( token_id::escape, beginwhere, source.subview( beginat, consumed.at ) );
-					}
-					continue;
-				case '0': case '1': case '2':
-				case '3': case '4': case '5':
-				case '6': case '7': case '8':
-				case '9':
-					consume_numeric();
-					break;
-				case '>':
-					consume();
-					if ( consumed.c == '=' ) {
-						consume();
-						tokens.emplace_back( token_id::greater_than_or_equal_to, beginwhere, source.subview( beginat, consumed.at ) );
-						break;
-					}
-					else if ( peeked.c == '>' ) {
-						consume();
-						tokens.emplace_back( token_id::right_shift, beginwhere, source.subview( beginat, consumed.at ) );
-						break;
-					}
-					tokens.emplace_back( token_id::greater_than, beginwhere, source.subview( beginat, consumed.at ) );
-					break;
-				case '<':
-					consume();
-					if ( peeked.c == '=' ) {
-						consume();
-						tokens.emplace_back( token_id::less_than_or_equal_to, beginwhere, source.subview( beginat, consumed.at ) );
-						break;
-					}
-					else if ( peeked.c == '<' ) {
-						consume();
-						tokens.emplace_back( token_id::left_shift, beginwhere, source.subview( beginat, consumed.at ) );
-						break;
-					}
-					tokens.emplace_back( token_id::less_than, beginwhere, source.subview( beginat, consumed.at ) );
-					break;
-				case '=':
-					consume();
-					if ( consumed.available && consumed.c == '=' ) {
-						consume();
-						tokens.emplace_back( token_id::equal_to, beginwhere, source.subview( beginat, consumed.at ) );
-						break;
-					}
-					tokens.emplace_back( token_id::assignment, beginwhere, source.subview( beginat, consumed.at ) );
-					break;
-				case '&':
-					consume();
-					if ( consumed.available && consumed.c == '&' ) {
-						consume();
-						tokens.emplace_back( token_id::expression_and, beginwhere, source.subview( beginat, consumed.at ) );
-						break;
-					}
-					tokens.emplace_back( token_id::boolean_and, beginwhere, source.subview( beginat, consumed.at ) );
-					break;
-				case '|':
-					consume();
-					if ( consumed.available && consumed.c == '|' ) {
-						consume();
-						tokens.emplace_back( token_id::expression_or, beginwhere, source.subview( beginat, consumed.at ) );
-						break;
-					}
-					tokens.emplace_back( token_id::boolean_or, beginwhere, source.subview( beginat, consumed.at ) );
-					break;
-				case '^':
-					consume();
-					tokens.emplace_back( token_id::boolean_xor, beginwhere, source.subview( beginat, consumed.at ) );
-					break;
-				case '!':
-					consume();
-					if ( consumed.available && consumed.c == '=' ) {
-						consume();
-						tokens.emplace_back( token_id::not_equal_to, beginwhere, source.subview( beginat, consumed.at ) );
-						break;
-					}
-					tokens.emplace_back( token_id::expression_negation, beginwhere, source.subview( beginat, consumed.at ) );
-					break;
-				case '~':
-					consume();
-					tokens.emplace_back( token_id::boolean_complement, beginwhere, source.subview( beginat, consumed.at ) );
-					break;
-				case '(':
-					consume();
-					tokens.emplace_back( token_id::open_parenthesis, beginwhere, source.subview( beginat, consumed.at ) );
-					break;
-				case ')':
+			auto beginat = consumed.at;
+			auto beginwhere = consumed.where;
+			switch ( consumed.c ) {
+			case '\\':
+				// Never a line continuation: the heads step over those before they get here
+				consume();
+				emit( token_id::escape, beginwhere, view_of( beginat, consumed.at ) );
+				return true;
+			case '0': case '1': case '2':
+			case '3': case '4': case '5':
+			case '6': case '7': case '8':
+			case '9':
+				consume_numeric();
+				break;
+			case '>':
+				consume();
+				if ( consumed.available && consumed.c == '=' ) {
 					consume();
-					tokens.emplace_back( token_id::close_parenthesis, beginwhere, source.subview( beginat, consumed.at ) );
+					emit( token_id::greater_than_or_equal_to, beginwhere, view_of( beginat, consumed.at ) );
 					break;
-				case '{':
+				}
+				else if ( consumed.available && consumed.c == '>' ) {
 					consume();
-					tokens.emplace_back( token_id::open_curly_bracket, beginwhere, source.subview( beginat, consumed.at ) );
+					emit( token_id::right_shift, beginwhere, view_of( beginat, consumed.at ) );
 					break;
-				case '}':
+				}
+				emit( token_id::greater_than, beginwhere, view_of( beginat, consumed.at ) );
+				break;
+			case '<':
+				consume();
+				if ( consumed.available && consumed.c == '=' ) {
 					consume();
-					tokens.emplace_back( token_id::close_curly_bracket, beginwhere, source.subview( beginat, consumed.at ) );
+					emit( token_id::less_than_or_equal_to, beginwhere, view_of( beginat, consumed.at ) );
 					break;
-				case '[':
+				}
+				else if ( consumed.available && consumed.c == '<' ) {
 					consume();
-					tokens.emplace_back( token_id::open_square_bracket, beginwhere, source.subview( beginat, consumed.at ) );
+					emit( token_id::left_shift, beginwhere, view_of( beginat, consumed.at ) );
 					break;
-				case ']':
+				}
+				emit( token_id::less_than, beginwhere, view_of( beginat, consumed.at ) );
+				break;
+			case '=':
+				consume();
+				if ( consumed.available && consumed.c == '=' ) {
 					consume();
-					tokens.emplace_back( token_id::close_square_bracket, beginwhere, source.subview( beginat, consumed.at ) );
+					emit( token_id::equal_to, beginwhere, view_of( beginat, consumed.at ) );
 					break;
-				case ',':
+				}
+				emit( token_id::assignment, beginwhere, view_of( beginat, consumed.at ) );
+				break;
+			case '&':
+				consume();
+				if ( consumed.available && consumed.c == '&' ) {
 					consume();
-					tokens.emplace_back( token_id::comma, beginwhere, source.subview( beginat, consumed.at ) );
+					emit( token_id::expression_and, beginwhere, view_of( beginat, consumed.at ) );
 					break;
-				case ';':
+				}
+				emit( token_id::boolean_and, beginwhere, view_of( beginat, consumed.at ) );
+				break;
+			case '|':
+				consume();
+				if ( consumed.available && consumed.c == '|' ) {
 					consume();
-					tokens.emplace_back( token_id::semi_colon, beginwhere, source.subview( beginat, consumed.at ) );
+					emit( token_id::expression_or, beginwhere, view_of( beginat, consumed.at ) );
 					break;
-				case ':':
+				}
+				emit( token_id::boolean_or, beginwhere, view_of( beginat, consumed.at ) );
+				break;
+			case '^':
+				consume();
+				emit( token_id::boolean_xor, beginwhere, view_of( beginat, consumed.at ) );
+				break;
+			case '!':
+				consume();
+				if ( consumed.available && consumed.c == '=' ) {
 					consume();
-					tokens.emplace_back( token_id::colon, beginwhere, source.subview( beginat, consumed.at ) );
+					emit( token_id::not_equal_to, beginwhere, view_of( beginat, consumed.at ) );
 					break;
-				case '.':
-					consume();
-					if ( consumed.c == '.' ) {
-						sync_peeked( consumed, 1 );
-						if ( peeked.c == '.' ) {
-							peek();
-							sync_consumed( peeked );
-							tokens.emplace_back( token_id::dot_dot_dot, beginwhere, source.subview( beginat, consumed.at ) );
-							break;
-						}
+				}
+				emit( token_id::expression_negation, beginwhere, view_of( beginat, consumed.at ) );
+				break;
+			case '~':
+				consume();
+				emit( token_id::boolean_complement, beginwhere, view_of( beginat, consumed.at ) );
+				break;
+			case '(':
+				consume();
+				emit( token_id::open_parenthesis, beginwhere, view_of( beginat, consumed.at ) );
+				break;
+			case ')':
+				consume();
+				emit( token_id::close_parenthesis, beginwhere, view_of( beginat, consumed.at ) );
+				break;
+			case '{':
+				consume();
+				emit( token_id::open_curly_bracket, beginwhere, view_of( beginat, consumed.at ) );
+				break;
+			case '}':
+				consume();
+				emit( token_id::close_curly_bracket, beginwhere, view_of( beginat, consumed.at ) );
+				break;
+			case '[':
+				consume();
+				emit( token_id::open_square_bracket, beginwhere, view_of( beginat, consumed.at ) );
+				break;
+			case ']':
+				consume();
+				emit( token_id::close_square_bracket, beginwhere, view_of( beginat, consumed.at ) );
+				break;
+			case ',':
+				consume();
+				emit( token_id::comma, beginwhere, view_of( beginat, consumed.at ) );
+				break;
+			case ';':
+				consume();
+				emit( token_id::semi_colon, beginwhere, view_of( beginat, consumed.at ) );
+				break;
+			case ':':
+				consume();
+				emit( token_id::colon, beginwhere, view_of( beginat, consumed.at ) );
+				break;
+			case '?':
+				consume();
+				emit( token_id::question_mark, beginwhere, view_of( beginat, consumed.at ) );
+				break;
+			case '.':
+				consume();
+				if ( consumed.c == '.' ) {
+					sync_peeked( consumed, 1 );
+					if ( peeked.c == '.' ) {
+						peek();
+						sync_consumed( peeked );
+						emit( token_id::dot_dot_dot, beginwhere, view_of( beginat, consumed.at ) );
+						break;
 					}
-					tokens.emplace_back( token_id::dot, beginwhere, source.subview( beginat, consumed.at ) );
-					break;
-				case '%':
+				}
+				emit( token_id::dot, beginwhere, view_of( beginat, consumed.at ) );
+				break;
+			case '%':
+				consume();
+				emit( token_id::modulus, beginwhere, view_of( beginat, consumed.at ) );
+				break;
+			case '+':
+				consume();
+				if ( consumed.available && consumed.c == '+' ) {
 					consume();
-					tokens.emplace_back( token_id::modulus, beginwhere, source.subview( beginat, consumed.at ) );
+					emit( token_id::increment, beginwhere, view_of( beginat, consumed.at ) );
 					break;
-				case '+':
+				}
+				emit( token_id::plus, beginwhere, view_of( beginat, consumed.at ) );
+				break;
+			case '-':
+				consume();
+				if ( consumed.available && consumed.c == '-' ) {
 					consume();
-					if ( consumed.c == '+' ) {
-						tokens.emplace_back( token_id::increment, beginwhere, source.subview( beginat, consumed.at ) );
-						break;
-					}
-					tokens.emplace_back( token_id::plus, beginwhere, source.subview( beginat, consumed.at ) );
+					emit( token_id::decrement, beginwhere, view_of( beginat, consumed.at ) );
 					break;
-				case '-':
-					consume();
-					if ( consumed.c == '-' ) {
-						tokens.emplace_back( token_id::decrement, beginwhere, source.subview( beginat, consumed.at ) );
-						break;
-					}
-					tokens.emplace_back( token_id::minus, beginwhere, source.subview( beginat, consumed.at ) );
+				}
+				emit( token_id::minus, beginwhere, view_of( beginat, consumed.at ) );
+				break;
+			case '*':
+				consume();
+				emit( token_id::multiply, beginwhere, view_of( beginat, consumed.at ) );
+				break;
+			case '/':
+				if ( consume_comment() ) {
 					break;
-				case '*':
-					consume();
-					tokens.emplace_back( token_id::multiply, beginwhere, source.subview( beginat, consumed.at ) );
+				}
+				consume();
+				emit( token_id::divide, beginwhere, view_of( beginat, consumed.at ) );
+				break;
+			case '@':
+				consume();
+				if ( consumed.available && consumed.c == '#' ) {
+					emit( token_id::charizing, beginwhere, view_of( beginat, consumed.at ) );
 					break;
-				case '/':
-					if ( consume_comment() ) {
-						break;
-					}
-					consume();
-					tokens.emplace_back( token_id::divide, beginwhere, source.subview( beginat, consumed.at ) );
+				}
+				consume_identifier();
+				break;
+			case '#':
+				if ( consume_preprocessor() ) {
 					break;
-				case '@':
+				}
+				consume();
+				if ( consumed.available && consumed.c == '#' ) {
 					consume();
-					if ( consumed.available && consumed.c == '#' ) {
-						tokens.emplace_back( token_id::charizing, beginwhere, source.subview( beginat, consumed.at ) );
-						break;
-					}
-					consume_identifier();
+					emit( token_id::token_pasting, beginwhere, view_of( beginat, consumed.at ) );
 					break;
-				case '#':
-					if ( consume_preprocessor() ) {
-						break;
-					}
+				}
+				else {
+					emit( token_id::hash, beginwhere, view_of( beginat, consumed.at ) );
+				}
+				break;
+			case '\'':
+				consume_char();
+				break;
+			case '"':
+				if ( previous_lexeme() == 'R' ) {
+					consume_raw_string();
+				}
+				else {
+					consume_string( '"', '"' );
+				}
+				break;
+			default:
+				if ( position_of( consumed ) == invalidat ) {
+					// An ill-formed byte starts no token, so it becomes one of its own and lexing goes on after it
+					report_invalid_utf8( invalidat + 1 );
 					consume();
-					if ( consumed.available && consumed.c == '#' ) {
-						consume();
-						tokens.emplace_back( token_id::token_pasting, beginwhere, source.subview( beginat, consumed.at ) );
-						break;
-					}
-					else {
-						tokens.emplace_back( token_id::hash, beginwhere, source.subview( beginat, consumed.at ) );
-					}
-					break;
-				case '\'':
-					consume_char();
-					break;
-				case '"':
-					if ( tokens.size() > 0 && tokens.back().lexeme == 'R' ) {
-						consume_raw_string();
-					}
-					else {
-						consume_string( '"', '"' );
-					}
-					break;
-				default:
-					consume_identifier();
+					emit( token_id::invalid_identifier, beginwhere, view_of( beginat, consumed.at ) );
 					break;
 				}
-				escaped = false;
+				consume_identifier();
+				break;
 			}
+			return consumed.available;
 		}
 	};
 
+	typedef basic_lexer<> lexer;
+	typedef basic_lexer<packed_tokens> packed_lexer;
+	typedef basic_lexer<pmr::vector<token>> pmr_lexer;
+
 }}}
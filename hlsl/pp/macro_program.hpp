@@ -0,0 +1,265 @@
+#pragma once
+
+#include "expression.hpp"
+#include "../token.hpp"
+#include "../identifier.hpp"
+#include "../../numeric.hpp"
+#include "../../range.hpp"
+#include "../../memory_resource.hpp"
+
+namespace gld { namespace hlsl { namespace pp {
+
+	enum class macro_op : uint8 {
+		// operand is the first token, as an offset into the token buffer; count is how many
+		copy,
+		// operand is the parameter
+		argument,
+		// operand is the parameter, spelled as a string literal
+		stringize,
+		// Joins the last token of the instruction before to the first of the instruction after;
+		// operand is the ## token
+		paste,
+		// Everything passed for '...', commas included; operand is its parameter
+		variadic_arguments,
+	};
+
+	struct macro_instruction {
+		static const uint8 verbatim = 1 << 0;
+		static const uint8 spaced = 1 << 1;
+
+		macro_op op;
+		// verbatim, on arguments beside a ##: those are pasted as written rather than expanded first;
+		// spaced, on arguments and strings written after whitespace, which their first token takes on
+		uint8 flags;
+		uint32 operand;
+		uint32 count;
+	};
+
+	// A macro's replacement, compiled once at its #define: a run of instructions in a code array shared by every macro
+	struct macro_program {
+		uint32 first_instruction;
+		uint32 instruction_count;
+		// Over the parameters and the replacement's tokens, with whitespace counted only as there or not,
+		// so two definitions hash alike when one may legally repeat the other
+		uint64 hash;
+		// '...' included
+		uint32 parameter_count;
+		bool function_like;
+		bool variadic;
+	};
+
+	typedef pmr::vector<macro_instruction> macro_code;
+
+	// Compiles replacements into a macro_code. Parameters are found by identifier index in a table
+	// that is only filled while one macro's body is compiled, so matching a name is one load.
+	// Tokens are read by position through id(), identifier(), lexeme() and spaced(), so they may be packed
+	class macro_compiler {
+	private:
+		static const uint32 none = 0xFFFFFFFF;
+
+		macro_code& code;
+		// Parameter + 1 by identifier index; 0 for every name that is not a parameter of the macro being compiled
+		pmr::vector<uint32> slots;
+		uint32 variadicslot;
+
+		static bool is_blank( token_id id ) {
+			switch ( id ) {
+			case token_id::whitespace:
+			case token_id::newlines:
+			case token_id::preprocessor_escaped_newline:
+			case token_id::block_comment_begin:
+			case token_id::block_comment_end:
+			case token_id::line_comment_begin:
+			case token_id::line_comment_end:
+			case token_id::comment_text:
+				return true;
+			default:
+				break;
+			}
+			return false;
+		}
+
+		template <typename Tokens>
+		static uint32 skip_blanks( const Tokens& tokens, uint32 first, uint32 last ) {
+			while ( first != last && is_blank( tokens.id( first ) ) ) {
+				++first;
+			}
+			return first;
+		}
+
+		template <typename Tokens>
+		static uint32 trim_blanks( const Tokens& tokens, uint32 first, uint32 last ) {
+			while ( last != first && is_blank( tokens.id( last - 1 ) ) ) {
+				--last;
+			}
+			return last;
+		}
+
+		// FNV-1a, 64-bit
+		static void mix( uint64& h, const void* data, std::size_t size ) {
+			const uint8* bytes = static_cast<const uint8*>( data );
+			for ( std::size_t i = 0; i < size; ++i ) {
+				h ^= bytes[ i ];
+				h *= 1099511628211ull;
+			}
+		}
+
+		static void mix( uint64& h, uint32 value ) {
+			mix( h, &value, sizeof( value ) );
+		}
+
+		void emit( macro_op op, uint32 operand, uint32 count = 0, bool spaced = false ) {
+			code.push_back( macro_instruction{ op, spaced ? macro_instruction::spaced : uint8( 0 ), operand, count } );
+		}
+
+		void emit_copy( uint32 first, uint32 last ) {
+			if ( first != last ) {
+				emit( macro_op::copy, first, last - first );
+			}
+		}
+
+	public:
+		static const uint32 not_a_parameter = none;
+
+		macro_compiler( macro_code& code, pmr::memory_resource* scratch = pmr::get_default_resource() )
+		: code( code ), slots( scratch ), variadicslot( none ) {
+
+		}
+
+		// Parameters stay bound until unbind, so the parser can ask parameter_of while it builds the body's pieces.
+		// When variadic, the last parameter is '...'
+		void bind( buffer_view<const symbol> parameters, bool variadic ) {
+			uint32 p = 0;
+			for ( const symbol& parameter : parameters ) {
+				if ( parameter.id.valid() ) {
+					if ( parameter.id.index >= slots.size() ) {
+						slots.resize( parameter.id.index + 1, 0 );
+					}
+					slots[ parameter.id.index ] = p + 1;
+				}
+				++p;
+			}
+			if ( variadic && p != 0 ) {
+				variadicslot = p - 1;
+			}
+		}
+
+		void unbind( buffer_view<const symbol> parameters ) {
+			for ( const symbol& parameter : parameters ) {
+				if ( parameter.id.valid() ) {
+					slots[ parameter.id.index ] = 0;
+				}
+			}
+			variadicslot = none;
+		}
+
+		// not_a_parameter unless the token at t names a bound parameter, or is VA_ARGS in a variadic macro
+		template <typename Tokens>
+		uint32 parameter_of( const Tokens& tokens, uint32 t ) const {
+			switch ( tokens.id( t ) ) {
+			case token_id::identifier:
+			{
+				identifier_id name = tokens.identifier( t );
+				if ( name.index < slots.size() && slots[ name.index ] != 0 ) {
+					return slots[ name.index ] - 1;
+				}
+				break;
+			}
+			case token_id::preprocessor_variadic_arguments:
+				return variadicslot;
+			default:
+				break;
+			}
+			return none;
+		}
+
+		// For a function-like macro, its parameters must be bound
+		template <typename Tokens>
+		macro_program compile( buffer_view<const symbol> parameters, bool functionlike, bool variadic, const Tokens& tokens, token_span replacement ) {
+			macro_program program{ static_cast<uint32>( code.size() ), 0, 14695981039346656037ull, static_cast<uint32>( parameters.size() ), functionlike, variadic };
+			uint64& h = program.hash;
+			mix( h, ( functionlike ? 1u : 0u ) | ( variadic ? 2u : 0u ) );
+			mix( h, program.parameter_count );
+			for ( const symbol& parameter : parameters ) {
+				mix( h, parameter.id.index );
+			}
+
+			uint32 first = skip_blanks( tokens, replacement.first_token, replacement.first_token + replacement.count );
+			uint32 last = trim_blanks( tokens, first, replacement.first_token + replacement.count );
+			uint32 run = first;
+			for ( uint32 t = first; t != last; ) {
+				token_id id = tokens.id( t );
+				if ( is_blank( id ) ) {
+					t = skip_blanks( tokens, t, last );
+					continue;
+				}
+				// Whitespace separates or it does not; how much of it there is never matters.
+				// Only the spaced flag is hashed, so the blanks may as well be in the side table
+				bool spaced = t != first && tokens.spaced( t );
+				if ( spaced ) {
+					mix( h, 0xFFFFFFFFu );
+				}
+				if ( functionlike && ( id == token_id::hash || id == token_id::stringizing ) ) {
+					uint32 operand = skip_blanks( tokens, t + 1, last );
+					uint32 parameter = operand != last ? parameter_of( tokens, operand ) : none;
+					if ( parameter != none ) {
+						emit_copy( run, t );
+						emit( macro_op::stringize, parameter, 0, spaced );
+						mix( h, 0xFFFFFFFEu );
+						mix( h, tokens.spaced( operand ) ? 1u : 0u );
+						mix( h, parameter );
+						t = operand + 1;
+						run = t;
+						continue;
+					}
+				}
+				if ( id == token_id::token_pasting ) {
+					// Whitespace either side of ## is not part of either operand
+					emit_copy( run, trim_blanks( tokens, run, t ) );
+					emit( macro_op::paste, t );
+					mix( h, 0xFFFFFFFDu );
+					t = skip_blanks( tokens, t + 1, last );
+					run = t;
+					continue;
+				}
+				uint32 parameter = functionlike ? parameter_of( tokens, t ) : none;
+				if ( parameter != none ) {
+					emit_copy( run, t );
+					emit( id == token_id::preprocessor_variadic_arguments ? macro_op::variadic_arguments : macro_op::argument, parameter, 0, spaced );
+					mix( h, 0xFFFFFFFCu );
+					mix( h, parameter );
+					++t;
+					run = t;
+					continue;
+				}
+				mix( h, static_cast<uint32>( id ) );
+				if ( id == token_id::identifier ) {
+					mix( h, tokens.identifier( t ).index );
+				}
+				else {
+					string_view lexeme = tokens.lexeme( t );
+					mix( h, lexeme.data(), static_cast<std::size_t>( lexeme.data_end() - lexeme.data() ) );
+				}
+				++t;
+			}
+			emit_copy( run, last );
+
+			program.instruction_count = static_cast<uint32>( code.size() - program.first_instruction );
+			// Operands of ## are pasted as written
+			macro_instruction* instructions = code.data() + program.first_instruction;
+			for ( uint32 i = 0; i < program.instruction_count; ++i ) {
+				if ( instructions[ i ].op != macro_op::paste ) {
+					continue;
+				}
+				if ( i > 0 ) {
+					instructions[ i - 1 ].flags |= macro_instruction::verbatim;
+				}
+				if ( i + 1 < program.instruction_count ) {
+					instructions[ i + 1 ].flags |= macro_instruction::verbatim;
+				}
+			}
+			return program;
+		}
+	};
+
+}}}
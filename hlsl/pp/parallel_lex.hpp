@@ -0,0 +1,201 @@
+#pragma once
+
+#include "lexer.hpp"
+#include <thread>
+#include <exception>
+#include <memory>
+#include <vector>
+#include <iterator>
+
+namespace gld { namespace hlsl { namespace pp {
+
+	namespace detail {
+
+		inline bool is_ascii_blank( char c ) {
+			return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+		}
+
+		// The first line start at or after from whose first byte is plainly not whitespace,
+		// or last if there is none; multi-byte lead bytes are skipped, since they might be Unicode whitespace
+		inline const char* find_chunk_start( const char* first, const char* from, const char* last ) {
+			for ( const char* p = from; p < last; ++p ) {
+				if ( *p != '\n' && *p != '\r' ) {
+					continue;
+				}
+				if ( p == first ) {
+					continue;
+				}
+				// Never split a "\r\n" pair
+				if ( *p == '\r' && p + 1 < last && p[ 1 ] == '\n' ) {
+					continue;
+				}
+				const char* start = p + 1;
+				if ( start < last && !is_ascii_blank( *start ) && static_cast<uint8>( *start ) < 0x80 ) {
+					return start;
+				}
+			}
+			return last;
+		}
+
+		// errors is null in error_mode::exceptions
+		inline std::vector<token> lex_parallel( source_manager& sources, file_id file, std::size_t threads, error_mode errormode, std::vector<lexer_error>* errors );
+
+	}
+
+	// Lexes one file on several threads, with a result token-for-token identical to pp::lex
+	//
+	// The spliced source is cut at line starts into one chunk per thread, and every chunk is lexed speculatively,
+	// as if the lexer arrived at its first byte with nothing open: no block comment, no raw string,
+	// no directive. Each chunk lexer then runs up to the next cut and reports
+	// whether it reached it in that same state. If it did, the next chunk's speculation was right and
+	// its tokens are kept; if not, the next chunk's tokens are thrown away and the current lexer simply
+	// carries on through it, exactly as the sequential lexer would have
+	//
+	// Chunk lexers intern into their own string pools so they never share state across threads;
+	// each kept chunk's names are interned into the session pool once apiece, in source order, which gives the same ids,
+	// and its tokens are moved over with their ids looked up in the table that builds
+	inline std::vector<token> lex_parallel( source_manager& sources, file_id file, std::size_t threads = std::thread::hardware_concurrency() ) {
+		return detail::lex_parallel( sources, file, threads, error_mode::exceptions, nullptr );
+	}
+
+	// Never throws for broken source, as pp::lex with an error list: the kept chunks' problems land in errors, in source order
+	inline std::vector<token> lex_parallel( source_manager& sources, file_id file, std::vector<lexer_error>& errors, std::size_t threads = std::thread::hardware_concurrency() ) {
+		return detail::lex_parallel( sources, file, threads, error_mode::recover, &errors );
+	}
+
+	inline std::vector<token> detail::lex_parallel( source_manager& sources, file_id file, std::size_t threads, error_mode errormode, std::vector<lexer_error>* errors ) {
+		// Below this, starting threads costs more than lexing
+		const std::size_t minimum_chunk_size = 1 << 18;
+		string_view text = sources.text_of( file );
+		const splice_map& splices = sources.splices_of( file );
+		const char* first = text.data();
+		const char* last = text.data_end();
+		std::size_t size = static_cast<std::size_t>( std::distance( first, last ) );
+		if ( threads > size / minimum_chunk_size ) {
+			threads = size / minimum_chunk_size;
+		}
+		// Ill-formed text ends the lexing early, which only the sequential lexer knows how to do
+		if ( threads < 2 || sources.invalid_utf8_of( file ) ) {
+			lexer l( sources, file, 4096, trivia_mode::tokens, errormode );
+			std::vector<token> tokens = l();
+			if ( errors != nullptr ) {
+				*errors = l.take_errors();
+			}
+			return tokens;
+		}
+
+		std::vector<std::size_t> cuts;
+		cuts.push_back( 0 );
+		for ( std::size_t i = 1; i < threads; ++i ) {
+			const char* from = first + std::max( size * i / threads, cuts.back() + 1 );
+			std::size_t cut = static_cast<std::size_t>( std::distance( first, detail::find_chunk_start( first, from, last ) ) );
+			// A line joined onto the one before by a splice is no place to start
+			while ( cut < size && splices.continues( static_cast<uint32>( cut ) ) ) {
+				cut = static_cast<std::size_t>( std::distance( first, detail::find_chunk_start( first, first + cut, last ) ) );
+			}
+			if ( cut >= size ) {
+				break;
+			}
+			cuts.push_back( cut );
+		}
+		cuts.push_back( size );
+		std::size_t chunks = cuts.size() - 1;
+
+		std::vector<std::unique_ptr<string_pool>> pools;
+		std::vector<std::unique_ptr<lexer>> lexers;
+		for ( std::size_t i = 0; i < chunks; ++i ) {
+			pools.emplace_back( i == 0 ? nullptr : new string_pool() );
+			lexers.emplace_back( new lexer( sources, file, i == 0 ? sources.names() : *pools.back(), 4096, trivia_mode::tokens, errormode ) );
+		}
+
+		// Results are written as plain chars, one per chunk, each by only its own thread
+		std::vector<char> clean( chunks, 0 );
+		std::vector<std::exception_ptr> failures( chunks );
+		std::vector<std::thread> workers;
+		workers.reserve( chunks - 1 );
+		for ( std::size_t i = 1; i < chunks; ++i ) {
+			workers.emplace_back( [ &, i ]() {
+				try {
+					lexers[ i ]->start_at( cuts[ i ] );
+					clean[ i ] = lexers[ i ]->lex_until( cuts[ i + 1 ] ) ? 1 : 0;
+				}
+				catch ( ... ) {
+					// A chunk that started in the wrong state can trip over anything;
+					// this only matters if the chunk turns out to be needed
+					failures[ i ] = std::current_exception();
+				}
+			} );
+		}
+		struct joiner {
+			std::vector<std::thread>& workers;
+			~joiner() {
+				for ( std::thread& worker : workers ) {
+					if ( worker.joinable() ) {
+						worker.join();
+					}
+				}
+			}
+		} joinall{ workers };
+
+		lexers[ 0 ]->start_at( 0 );
+		clean[ 0 ] = lexers[ 0 ]->lex_until( cuts[ 1 ] ) ? 1 : 0;
+		for ( std::thread& worker : workers ) {
+			worker.join();
+		}
+
+		// Reconcile: walk the cuts in order, handing each chunk either to its own lexer
+		// (the previous owner arrived cleanly) or to the previous owner, which lexes straight through it
+		std::vector<std::size_t> owners;
+		owners.push_back( 0 );
+		std::size_t owner = 0;
+		bool ownerclean = clean[ 0 ] != 0;
+		for ( std::size_t i = 1; i < chunks; ++i ) {
+			if ( ownerclean ) {
+				if ( failures[ i ] ) {
+					std::rethrow_exception( failures[ i ] );
+				}
+				owner = i;
+				owners.push_back( i );
+				ownerclean = clean[ i ] != 0;
+				continue;
+			}
+			ownerclean = lexers[ owner ]->lex_until( cuts[ i + 1 ] );
+		}
+		lexers[ owner ]->end_stream();
+
+		std::vector<std::vector<token>> pieces;
+		std::size_t total = 0;
+		for ( std::size_t i : owners ) {
+			pieces.push_back( lexers[ i ]->take_tokens() );
+			total += pieces.back().size();
+			if ( errors != nullptr ) {
+				const std::vector<lexer_error>& chunkerrors = lexers[ i ]->errors();
+				errors->insert( errors->end(), chunkerrors.begin(), chunkerrors.end() );
+			}
+		}
+		std::vector<token> tokens;
+		tokens.reserve( total );
+		// The first chunk interned straight into the session pool, so its tokens are kept as they are
+		tokens.insert( tokens.end(), std::make_move_iterator( pieces[ 0 ].begin() ), std::make_move_iterator( pieces[ 0 ].end() ) );
+		string_pool& names = sources.names();
+		// Chunk id to session id, 0 until the name first turns up
+		std::vector<uint32> remap;
+		for ( std::size_t p = 1; p < pieces.size(); ++p ) {
+			const string_pool& local = *pools[ owners[ p ] ];
+			remap.assign( local.size() + 1, 0 );
+			for ( token& t : pieces[ p ] ) {
+				if ( t.value.is<identifier_id>() ) {
+					identifier_id& name = t.value.get<identifier_id>();
+					uint32& mapped = remap[ name.index ];
+					if ( mapped == 0 ) {
+						mapped = names.intern( local.name_of( name ) ).index;
+					}
+					name.index = mapped;
+				}
+				tokens.push_back( std::move( t ) );
+			}
+		}
+		return tokens;
+	}
+
+}}}
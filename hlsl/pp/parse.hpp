@@ -2,15 +2,92 @@
 
 #include "lex.hpp"
 #include "parser.hpp"
+#include <algorithm>
 
 namespace gld { namespace hlsl { namespace pp {
 
-	inline parse_tree parse( std::vector<token> tokens ) {
-		symbol_table symbols;
-		parse_tree tree;
-		parser p( tokens, tree, symbols );
+	namespace detail {
+
+		// The lexer's problems join the parser's in the tree's list, which stays in source order
+		inline void adopt_lexer_errors( parse_tree& tree, std::vector<lexer_error> errors ) {
+			if ( errors.empty() ) {
+				return;
+			}
+			std::size_t parsed = tree.errors.size();
+			tree.errors.reserve( parsed + errors.size() );
+			for ( lexer_error& e : errors ) {
+				tree.errors.emplace_back( e.where, std::move( e.message ) );
+			}
+			std::inplace_merge( tree.errors.begin(), tree.errors.begin() + parsed, tree.errors.end(), []( const parser_error& left, const parser_error& right ) {
+				return left.where.raw < right.where.raw;
+			} );
+		}
+
+	}
+
+	// The tree takes the tokens: lex-then-parse copies none of them, and the tree's views stay good after this returns
+	inline parse_tree parse( std::vector<token> tokens, error_mode errormode = error_mode::exceptions, pmr::memory_resource* resource = pmr::get_default_resource() ) {
+		symbol_table symbols( resource );
+		parse_tree tree( resource );
+		parser p( tree.adopt_tokens( std::move( tokens ) ), tree, symbols, errormode );
+		p();
+		return tree;
+	}
+
+	// The tree and symbols are allocated from the same resource as the tokens,
+	// so the tree lives exactly as long as the caller keeps that resource around
+	inline parse_tree parse( pmr::vector<token> tokens, error_mode errormode = error_mode::exceptions ) {
+		pmr::memory_resource* resource = tokens.get_allocator().resource();
+		symbol_table symbols( resource );
+		parse_tree tree( resource );
+		parser p( tree.adopt_tokens( std::move( tokens ) ), tree, symbols, errormode );
 		p();
 		return tree;
 	}
 
+	// Lexes and parses file into a tree that also holds on to sources,
+	// so nothing it points into can go away while it is cached or handed to another thread.
+	// In error_mode::recover, tree.errors lists the lexer's problems along with the parser's
+	inline parse_tree parse( std::shared_ptr<source_manager> sources, file_id file, error_mode errormode = error_mode::exceptions, pmr::memory_resource* resource = pmr::get_default_resource() ) {
+		pmr_lexer l( *sources, file, 4096, trivia_mode::tokens, errormode, resource );
+		parse_tree tree = parse( l(), errormode );
+		detail::adopt_lexer_errors( tree, l.take_errors() );
+		tree.adopt_sources( std::move( sources ) );
+		return tree;
+	}
+
+	// The tree keeps the tokens packed and the parser reads them in place; only freezing the tree
+	// for expansion spells them out whole
+	inline parse_tree parse( packed_tokens tokens, error_mode errormode = error_mode::exceptions, pmr::memory_resource* resource = pmr::get_default_resource() ) {
+		symbol_table symbols( resource );
+		parse_tree tree( resource );
+		packed_parser p( tree.adopt_tokens( std::move( tokens ) ), tree, symbols, errormode );
+		p();
+		return tree;
+	}
+
+	namespace detail {
+
+		template <typename Tokens>
+		inline parse_tree parse_taken( Tokens tokens, error_mode errormode, pmr::memory_resource* resource ) {
+			return parse( std::move( tokens ), errormode, resource );
+		}
+
+		// These already carry the resource the tree is allocated from
+		inline parse_tree parse_taken( pmr::vector<token> tokens, error_mode errormode, pmr::memory_resource* ) {
+			return parse( std::move( tokens ), errormode );
+		}
+
+	}
+
+	// Parses whatever l has not handed out yet. This is not a streaming parse: the tree, the macro programs
+	// and the expander all index the tokens as one array, so the lexer lexes the rest of the file into its own buffer
+	// and the tree takes that buffer over, in whatever storage the lexer keeps, without copying a token
+	template <typename Tokens>
+	inline parse_tree parse_remaining( basic_lexer<Tokens>& l, error_mode errormode = error_mode::exceptions, pmr::memory_resource* resource = pmr::get_default_resource() ) {
+		parse_tree tree = detail::parse_taken( l.take_remaining(), errormode, resource );
+		detail::adopt_lexer_errors( tree, l.take_errors() );
+		return tree;
+	}
+
 }}}
@@ -52,38 +52,40 @@ namespace gld { namespace hlsl { namespace pp {
 		parse_result( parse_result&& ) = default;
 		parse_result& operator=( parse_result&& ) = default;
 
-		template <typename T>
-		parse_result( const parse_result<T>& r ) : parse_result( r.valid( ) ? parse_result( r.get( ) ) : parse_result( r.exception() ) ) { 
+		template <typename U>
+		parse_result( const parse_result<U>& r ) : parse_result( r.valid( ) ? parse_result( r.get( ) ) : parse_result( r.exception() ) ) { 
 		
 		}
 		
-		template <typename T>
-		parse_result& operator=( const parse_result<T>& r ) {
+		template <typename U>
+		parse_result& operator=( const parse_result<U>& r ) {
 			if ( r.valid( ) ) {
 				operator=( r.get( ) );
 			}
 			else {
 				operator=( r.exception( ) );
 			}
+			return *this;
 		}
 
-		template <typename T>
-		parse_result( parse_result<T>&& r ) : parse_result( r.valid( ) ? parse_result( std::move( r.get( ) ) ) : parse_result( std::move( r.exception() ) ) ) {
+		template <typename U>
+		parse_result( parse_result<U>&& r ) : parse_result( r.valid( ) ? parse_result( std::move( r.get( ) ) ) : parse_result( std::move( r.exception() ) ) ) {
 		
 		}
 
-		template <typename T>
-		parse_result& operator=( parse_result<T>&& r ) {
+		template <typename U>
+		parse_result& operator=( parse_result<U>&& r ) {
 			if ( r.valid( ) ) {
 				operator=( std::move( r.get( ) ) );
 			}
 			else {
 				operator=( std::move( r.exception( ) ) );
 			}
+			return *this;
 		}
 
 		bool valid() const {
-			return result.is<T>();
+			return result.template is<T>();
 		}
 
 		explicit operator bool() const {
@@ -107,11 +109,11 @@ namespace gld { namespace hlsl { namespace pp {
 		}
 
 		parser_error& exception() {
-			return result.get<parser_error>();
+			return result.template get<parser_error>();
 		}
 
 		const parser_error& exception() const {
-			return result.get<parser_error>();
+			return result.template get<parser_error>();
 		}
 	};
 
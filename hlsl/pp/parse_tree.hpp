@@ -4,13 +4,28 @@
 #include "construct.hpp"
 #include "expression.hpp"
 #include "statement.hpp"
+#include "../token.hpp"
+#include "../packed_tokens.hpp"
+#include "../source_manager.hpp"
 #include <vector>
+#include <memory>
+#include <type_traits>
 
 namespace gld { namespace hlsl { namespace pp {
 
 	struct parse_tree : public block {
+	private:
+		// Declared ahead of the storage, which is allocated from it
+		pmr::memory_resource* memoryresource;
+		// What every sequence in the tree indexes: held by pointer, so the tokens stay put
+		// however the tree is moved. Tokens handed over packed stay packed, and unpackedtokens is empty
+		std::shared_ptr<const void> tokenowner;
+		unpacked_tokens unpackedtokens;
+		const packed_tokens* packedtokens;
+		std::shared_ptr<const source_manager> sourcemanager;
+
 #define GLD_STORAGE( x ) \
-		private: std::vector<x> x##_storage; \
+		private: pmr::vector<x> x##_storage = pmr::vector<x>( memoryresource ); \
 		public: x& operator[]( index_ref<x> i ) { return x##_storage[i.get()]; } \
 		public: const x& operator[]( index_ref<x> i ) const { return x##_storage[i.get()]; } \
 		public: template <typename... Tn> index_ref<x> make_##x ( Tn&&... argn ) { index_ref<x> i = x##_storage.size(); x##_storage.emplace_back( std::forward<Tn>( argn )... ); return i; }
@@ -39,15 +54,109 @@ namespace gld { namespace hlsl { namespace pp {
 		GLD_STORAGE( token_pasting_expression );
 
 		// Statement Storage
+		GLD_STORAGE( function );
 		GLD_STORAGE( block );
 		GLD_STORAGE( if_elseif_else );
 
 #undef GLD_STORAGE
 
+		// Every macro's compiled replacement; programs index into it
+		macro_code macroinstructions = macro_code( memoryresource );
+		// Every #if's and #elif's compiled condition
+		condition_code conditioninstructions = condition_code( memoryresource );
+
 	public:
+		// Everything reported while parsing in error_mode::recover, in source order
+		std::vector<parser_error> errors;
 		
-		parse_tree( ) {
+		// Every node, and every list inside one the parser builds, is allocated from resource
+		explicit parse_tree( pmr::memory_resource* resource = pmr::get_default_resource() ) : block( resource ), memoryresource( resource ), packedtokens( nullptr ) {
+
+		}
+
+		// A copy's storage would land on the default resource while memoryresource still named the arena,
+		// and assigning would mix the two; a tree only ever moves, and keeps its resource when it does
+		parse_tree( parse_tree&& ) = default;
+		parse_tree( const parse_tree& ) = delete;
+		parse_tree& operator=( const parse_tree& ) = delete;
+		parse_tree& operator=( parse_tree&& ) = delete;
+
+		pmr::memory_resource* resource() const {
+			return memoryresource;
+		}
+
+		macro_code& macro_instructions() {
+			return macroinstructions;
+		}
+
+		const macro_code& macro_instructions() const {
+			return macroinstructions;
+		}
+
+		buffer_view<const macro_instruction> instructions_of( const macro_program& program ) const {
+			return buffer_view<const macro_instruction>( macroinstructions.data() + program.first_instruction, program.instruction_count );
+		}
+
+		condition_code& condition_instructions() {
+			return conditioninstructions;
+		}
+
+		const condition_code& condition_instructions() const {
+			return conditioninstructions;
+		}
+
+		buffer_view<const condition_instruction> instructions_of( const condition_program& program ) const {
+			return buffer_view<const condition_instruction>( conditioninstructions.data() + program.first_instruction, program.instruction_count );
+		}
+
+		// Moving a vector keeps its buffer where it is, so taking the lexer's tokens copies none of them;
+		// returns what to hand the parser
+		template <typename Tokens>
+		const unpacked_tokens& adopt_tokens( Tokens&& tokens ) {
+			static_assert( !std::is_lvalue_reference<Tokens>::value, "parse_tree: move the tokens in" );
+			auto owned = std::make_shared<const std::decay_t<Tokens>>( std::move( tokens ) );
+			unpackedtokens = unpacked_tokens( buffer_view<const token>( owned->data(), owned->size() ) );
+			packedtokens = nullptr;
+			tokenowner = std::move( owned );
+			return unpackedtokens;
+		}
+
+		const packed_tokens& adopt_tokens( packed_tokens&& tokens ) {
+			auto owned = std::make_shared<const packed_tokens>( std::move( tokens ) );
+			unpackedtokens = unpacked_tokens();
+			packedtokens = owned.get();
+			tokenowner = std::move( owned );
+			return *packedtokens;
+		}
+
+		// The tokens the tree was parsed from, when they were handed over whole; empty when packed
+		buffer_view<const token> token_buffer() const {
+			return buffer_view<const token>( unpackedtokens.data(), unpackedtokens.size() );
+		}
+
+		// Null unless the tree was parsed from packed tokens
+		const packed_tokens* packed() const {
+			return packedtokens;
+		}
+
+		// For views of the tree that outlive it, like a frozen_tree
+		std::shared_ptr<const void> token_owner() const {
+			return tokenowner;
+		}
+
+		std::shared_ptr<const source_manager> source_owner() const {
+			return sourcemanager;
+		}
+
+		// Lexemes and identifiers point into the manager's files and pool
+		void adopt_sources( std::shared_ptr<const source_manager> sources ) {
+			sourcemanager = std::move( sources );
+		}
 
+		// Null when the caller keeps the manager alive itself.
+		// Resolving locations only reads the manager, so several threads may share it
+		const source_manager* sources() const {
+			return sourcemanager.get();
 		}
 
 	};
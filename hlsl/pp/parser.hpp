@@ -6,64 +6,151 @@
 #include "construct.hpp"
 #include "conditional_origin.hpp"
 #include "precedence.hpp"
+#include "error_mode.hpp"
 #include "../token.hpp"
 #include "../parser_head.hpp"
 #include "../parser_error.hpp"
 #include "../../string.hpp"
 #include "../../optional.hpp"
 #include "../../range.hpp"
-#include "../../stack.hpp"
+#include "../../small_vector.hpp"
 
 namespace gld { namespace hlsl { namespace pp {
 
-	class parser {
+	// Reads the tokens by position, through id(), location(), lexeme(), identifier(), spaced() and value(),
+	// so packed_tokens are parsed where they lie, without being expanded into whole tokens first
+	template <typename Tokens>
+	class basic_parser {
 	private:
-		typedef buffer_view<const token> token_view;
-		typedef token_view view_type;
-		typedef Furrovine::tmp::range_cbegin_type_t<view_type> begin_iterator;
-		typedef Furrovine::tmp::range_cend_type_t<view_type> end_iterator;
-		typedef begin_iterator iterator;
+		typedef uint32 iterator;
 		typedef parser_head<iterator> read_head;
 
-		view_type source;
-		begin_iterator begin;
-		end_iterator end;
+		const Tokens& source;
+		iterator begin;
+		iterator end;
 
 		read_head consumed;
 		
 		parse_tree& tree;
 		symbol_table& symbols;
+		error_mode errormode;
+		// The tree's resource: every list the parser builds is allocated from it
+		pmr::memory_resource* resource;
+		// Writes each #define's program into the tree
+		macro_compiler compiler;
+		// And each #if's and #elif's
+		condition_compiler conditioncompiler;
+		// A packed condition's tokens, rebuilt whole once, since the condition_compiler reads each more than once
+		std::vector<token> conditiontokens;
 		
 	public:
-		parser( view_type tokens, parse_tree& tree, symbol_table& symbols ) : source( std::move( tokens ) ),
-		begin( adl_cbegin( source ) ), end( adl_cend( source ) ),
+		basic_parser( const Tokens& tokens, parse_tree& tree, symbol_table& symbols, error_mode errormode = error_mode::exceptions ) : source( tokens ),
+		begin( 0 ), end( static_cast<iterator>( tokens.size() ) ),
 		consumed( begin ),
-		tree( tree ), symbols( symbols ) {
+		tree( tree ), symbols( symbols ), errormode( errormode ), resource( tree.resource() ),
+		compiler( tree.macro_instructions() ), conditioncompiler( tree.condition_instructions() ) {
 			
 		}
 
 	private:
+		static token_span span( iterator first, iterator last ) {
+			return token_span{ first, last - first };
+		}
+
+		// Past the end, r still refers to the last token
+		iterator current( const read_head& r ) const {
+			return r.available ? r.at : r.at - 1;
+		}
+
+		symbol symbol_at( iterator at ) const {
+			return symbol( span( at, at + 1 ), source.lexeme( at ), source.identifier( at ) );
+		}
+
+		condition_program compile_condition( const unpacked_tokens& tokens, token_span seq ) {
+			return conditioncompiler.compile( buffer_view<const token>( tokens.data() + seq.first_token, seq.count ) );
+		}
+
+		condition_program compile_condition( const packed_tokens& tokens, token_span seq ) {
+			conditiontokens.clear();
+			tokens.unpack_into( seq.first_token, seq.count, conditiontokens );
+			return conditioncompiler.compile( conditiontokens );
+		}
+
 		template <typename... Tn>
-		void expected_error ( const read_head& r, Tn&&... argn ) {
+		bool expected( const read_head& r, Tn... ids ) const {
 			if ( !r.available ) {
-				// TODO: proper error
-				// expected token, but stream terminated
-				throw parser_error();
+				return false;
+			}
+			const token_id candidates[] = { ids... };
+			return std::find( std::begin( candidates ), std::end( candidates ), r.id ) != std::end( candidates );
+		}
+
+		// Throws in error_mode::exceptions; otherwise the error is handed back, and travels up
+		// as a parse_result to the enclosing statement, which records it and resynchronizes
+		parser_error fail( const read_head& r, string message ) {
+			source_location where = r.available || r.at != begin ? source.location( current( r ) ) : source_location();
+			parser_error e( where, std::move( message ) );
+			if ( errormode == error_mode::exceptions ) {
+				throw e;
+			}
+			return e;
+		}
+
+		void record( parser_error e ) {
+			tree.errors.push_back( std::move( e ) );
+		}
+
+		static bool is_invalid( token_id id ) {
+			switch ( id ) {
+			case token_id::invalid_directive:
+			case token_id::invalid_include:
+			case token_id::invalid_comment:
+				return true;
+			default:
+				break;
+			}
+			return false;
+		}
+
+		// Skips the rest of the directive r is in, or up to the next line or block marker outside of one
+		void synchronize( read_head& r ) {
+			for ( ; r.available; advance( r ) ) {
+				switch ( r.id ) {
+				case token_id::preprocessor_statement_end:
+					advance( r );
+					return;
+				case token_id::newlines:
+				case token_id::preprocessor_hash:
+				case token_id::preprocessor_block_begin:
+				case token_id::preprocessor_block_end:
+				case token_id::stream_end:
+					return;
+				default:
+					break;
+				}
 			}
-			expected_error( r.t, { std::forward<Tn>( argn )... } );
 		}
 
-		template <typename T0, typename T1, typename... Tn>
-		void expected_error( const token& t, T0&& arg0, T1&& arg1, Tn&&... argn ) {
-			expected_error( t, { std::forward<T0>( arg0 ), std::forward<T1>( arg1 ), std::forward<Tn>( argn )... } );
+		// A directive that failed to parse becomes a parser_error statement. It is only recorded
+		// if the lexer did not already flag something in it with an invalid_* token
+		statement failed_directive( const read_head& hashtokenreadhead, read_head& r, parser_error e ) {
+			synchronize( r );
+			bool lexerreported = false;
+			for ( auto it = hashtokenreadhead.at; it != r.at; ++it ) {
+				lexerreported |= is_invalid( source.id( it ) );
+			}
+			if ( !lexerreported ) {
+				record( e );
+			}
+			return statement( std::move( e ) );
 		}
 
-		void expected_error( const token& t, std::initializer_list<token_id> ids ) {
-			if ( std::find( ids.begin(), ids.end(), t.id ) == ids.end() ) {
-				// TODO: proper error
-				// Expected 'blah', received 'blah'
-				throw parser_error();
+		template <typename T>
+		statement directive( const read_head& hashtokenreadhead, read_head& r, parse_result<T>&& result ) {
+			if ( !result ) {
+				return failed_directive( hashtokenreadhead, r, std::move( result.exception() ) );
 			}
+			return statement( std::move( result.get() ) );
 		}
 
 		bool update( read_head& r ) {
@@ -71,8 +158,7 @@ namespace gld { namespace hlsl { namespace pp {
 			if ( !r.available ) {
 				return false;
 			}
-			r.t = *r.at;
-			r.id = r.t.get().id;
+			r.id = source.id( r.at );
 			r.prevlinewhitespace = r.linewhitespace;
 			switch ( r.id ) {
 			case token_id::newlines:
@@ -85,6 +171,10 @@ namespace gld { namespace hlsl { namespace pp {
 			case token_id::line_comment_end:
 			case token_id::whitespace:
 			case token_id::preprocessor_escaped_newline:
+			// Markers the lexer inserts take up no room on the line
+			case token_id::stream_begin:
+			case token_id::preprocessor_block_begin:
+			case token_id::preprocessor_block_end:
 				break;
 			default:
 				r.linewhitespace = false;
@@ -105,8 +195,7 @@ namespace gld { namespace hlsl { namespace pp {
 		whitespace parse_whitespace( read_head& r ) {
 			auto beginat = r.at;
 			for ( ; r.available; ) {
-				const token& t = r.t;
-				switch ( t.id ) {
+				switch ( r.id ) {
 				case token_id::whitespace:
 					advance( r );
 					continue;
@@ -115,107 +204,101 @@ namespace gld { namespace hlsl { namespace pp {
 					continue;
 				case token_id::block_comment_begin:
 					advance( r );
-					if ( !r.available || r.id != token_id::comment_text ) {
-						// TODO: proper parsing error
-						// Expected comment text after block begin
-						throw parser_error();
+					if ( !expected( r, token_id::comment_text ) ) {
+						record( fail( r, "expected comment text after '/*'" ) );
+						continue;
 					}
 					advance( r );
-					if ( !r.available || r.id != token_id::block_comment_end ) {
-						// TODO: proper parsing error
-						// Expected comment end after block begin/text
-						throw parser_error();
+					// An unterminated comment was already reported by the lexer
+					if ( !expected( r, token_id::block_comment_end, token_id::invalid_comment ) ) {
+						record( fail( r, "expected '*/' after comment text" ) );
+						continue;
 					}
+					advance( r );
 					continue;
 				case token_id::line_comment_begin:
 					advance( r );
-					if ( !r.available || r.id != token_id::comment_text ) {
-						// TODO: proper parsing error
-						// Expected comment text after block begin
-						throw parser_error();
+					if ( !expected( r, token_id::comment_text ) ) {
+						record( fail( r, "expected comment text after '//'" ) );
+						continue;
 					}
 					advance( r );
-					if ( !r.available || r.id != token_id::line_comment_end ) {
-						// TODO: proper parsing error
-						// Expected comment end after block begin/text
-						throw parser_error( );
+					if ( !expected( r, token_id::line_comment_end ) ) {
+						record( fail( r, "expected the end of the line comment" ) );
+						continue;
 					}
+					advance( r );
 					continue;
 				default:
 					break;
 				}
 				break;
 			}
-			token_view seq( beginat, r.at );
-			return whitespace( seq );
+			return whitespace( span( beginat, r.at ) );
 		}
 
-		floating_literal parse_floating_literal( read_head& r ) {
-			expected_error( r, token_id::float_literal );
-			const read_head literalr = r;
-			token_view literalseq( literalr.at, 1 );
+		parse_result<floating_literal> parse_floating_literal( read_head& r ) {
+			if ( !expected( r, token_id::float_literal ) ) {
+				return fail( r, "expected a floating point literal" );
+			}
+			token_span literalseq = span( r.at, r.at + 1 );
 			advance( r );
 			return floating_literal( literalseq );
 		}
 
-		integral_literal parse_integral_literal( read_head& r ) {
-			expected_error( r, token_id::integer_literal, token_id::integer_hex_literal, token_id::integer_octal_literal );
-			const read_head literalr = r;
-			token_view literalseq( literalr.at, 1 );
+		parse_result<integral_literal> parse_integral_literal( read_head& r ) {
+			if ( !expected( r, token_id::integer_literal, token_id::integer_hex_literal, token_id::integer_octal_literal ) ) {
+				return fail( r, "expected an integer literal" );
+			}
+			token_span literalseq = span( r.at, r.at + 1 );
 			advance( r );
 			return integral_literal( literalseq );
 		}
 
-		string_literal parse_string_literal( read_head& r ) {
-			expected_error( r, token_id::string_literal_begin );
+		parse_result<string_literal> parse_string_literal( read_head& r ) {
+			if ( !expected( r, token_id::string_literal_begin ) ) {
+				return fail( r, "expected a string literal" );
+			}
 			const read_head literalr = r;
 			advance( r );
-			expected_error( r, token_id::string_literal );
-			const token& literaltoken = r.t;
-			advance( r );
-			expected_error( r, token_id::string_literal_end );
-			token_view literalseq( literalr.at, 3 );
+			if ( !expected( r, token_id::string_literal ) ) {
+				return fail( r, "expected the text of the string literal" );
+			}
+			iterator literalat = r.at;
 			advance( r );
-			return string_literal( literalseq, literaltoken.lexeme );
-		}
-
-		variable parse_define_variable( const read_head& hashtokenreadhead, const read_head& idtokenreadhead, read_head& r ) {
-			token_view idseq( idtokenreadhead.at, 1 );
-			symbol id( idseq );
-			auto definitionfind = symbols.definitions.find( id.name );
-			if ( definitionfind != symbols.definitions.end() ) {
-				definition& d = definitionfind->second;
-				if ( !d.is<variable>() ) {
-					// TODO: proper error
-					// redeclaration of a preexisting type in this scope
-					throw parser_error();
-				}
-				// TODO: proper error
-				// Error/warning: redeclaring an already-defined symbol
-				// TODO: warning ONLY if the actual defined symbol is different
-				throw parser_error();
+			if ( !expected( r, token_id::string_literal_end ) ) {
+				return fail( r, "unterminated string literal" );
 			}
+			token_span literalseq = span( literalr.at, literalr.at + 3 );
+			advance( r );
+			return string_literal( literalseq, source.lexeme( literalat ) );
+		}
+
+		parse_result<variable> parse_define_variable( const read_head& hashtokenreadhead, const read_head& idtokenreadhead, read_head& r ) {
+			symbol id = symbol_at( idtokenreadhead.at );
 			text_line substitutionline = parse_text_line( r );
-			expected_error( r, token_id::preprocessor_statement_end );
+			if ( !expected( r, token_id::preprocessor_statement_end ) ) {
+				return fail( r, "expected the end of the #define" );
+			}
 			advance( r );
-			token_view seq( hashtokenreadhead.at, r.at );
-			return variable( seq, id, std::move( substitutionline ) );
+			macro_program program = compiler.compile( buffer_view<const symbol>(), false, false, source, substitutionline.tokens );
+			symbols.define( id.id, program );
+			return variable( span( hashtokenreadhead.at, r.at ), id, std::move( program ), std::move( substitutionline ) );
 		}
 
-		function parse_define_function( const read_head& hashtokenreadhead, const read_head& idtokenreadhead, read_head& r ) {
-			symbol id( token_view( idtokenreadhead.at, 1 ) );
+		parse_result<function> parse_define_function( const read_head& hashtokenreadhead, const read_head& idtokenreadhead, read_head& r ) {
+			symbol id = symbol_at( idtokenreadhead.at );
 			parse_whitespace( r );
-			expected_error( r, token_id::open_parenthesis );
+			if ( !expected( r, token_id::open_parenthesis ) ) {
+				return fail( r, "expected '(' to start the macro's parameters" );
+			}
 			advance( r );
 			bool foundargument = false;
-			std::vector<symbol> parameters;
-			parameters.reserve( 16 );
+			parameter_list parameters( resource );
 			optional<const symbol&> variablearguments = none;
 			for ( ; consumed.available; ) {
 				parse_whitespace( r );
-				const token& t = r.t;
-				token_view tseq( &t, &t + 1 );
-				switch ( t.id ) {
+				switch ( r.id ) {
 				case token_id::close_parenthesis:
 					advance( r );
 					break;
@@ -224,34 +307,31 @@ namespace gld { namespace hlsl { namespace pp {
 					continue;
 				case token_id::dot_dot_dot:
 					if ( variablearguments ) {
-						// TODO: proper error
-						// Argument expression already has a variable argument statement '...'
-						throw parser_error();
+						return fail( r, "a macro can only have one '...' parameter" );
 					}
-					parameters.emplace_back( tseq );
+					parameters.emplace_back( symbol_at( r.at ) );
 					variablearguments = parameters.back();
 					foundargument = true;
 					advance( r );
 					continue;
 				case token_id::identifier:
 					if ( variablearguments ) {
-						// TODO: proper error
-						// Argument expression already has a variable argument statement '...'
-						// And must end on that statement
-						throw parser_error();
+						return fail( r, "'...' must be the last macro parameter" );
 					}
-					parameters.emplace_back( tseq );
+					parameters.emplace_back( symbol_at( r.at ) );
 					foundargument = true;
 					advance( r );
 					continue;
 				default:
-					// TODO: proper error
-					// Unexpected token, expected ')' or '...' or Identifier
-					throw parser_error();
+					return fail( r, "expected ')', '...' or a parameter name" );
 				}
 				break;
 			}
-			substitution routine = parse_substitution( parameters, r );
+			buffer_view<const symbol> parameterview( parameters.data(), parameters.size() );
+			compiler.bind( parameterview, static_cast<bool>( variablearguments ) );
+			substitution routine = parse_substitution( r );
+			macro_program compiled = compiler.compile( parameterview, true, static_cast<bool>( variablearguments ), source, routine.tokens );
+			compiler.unbind( parameterview );
 			if ( !foundargument ) {
 				// TODO: is it an error if there are parenthesis, but no arguments?
 				// I can imagine sometimes you might want to have () be part of the macro's interface
@@ -263,68 +343,81 @@ namespace gld { namespace hlsl { namespace pp {
 				// Create substitutions and find items
 			}
 
-			expected_error( r, token_id::preprocessor_statement_end );
+			if ( !expected( r, token_id::preprocessor_statement_end ) ) {
+				return fail( r, "expected the end of the #define" );
+			}
 			advance( r );
 
-			token_view seq( hashtokenreadhead.at, r.at );
-			function f( seq, id, std::move( parameters ), std::move( routine ) );
-			auto definitionfind = symbols.definitions.find( f.name.name );
-			if ( definitionfind != symbols.definitions.end() ) {
-				definition& d = definitionfind->second;
-				if ( !d.is<function>() ) {
-					// TODO: proper error
-					// redeclaration of a preexisting type in this scope
-					throw parser_error();
-				}
-				// TODO: warning/error only if the definition is different from the first
-				// throw parser_error();
-			}
-			return f;
+			symbols.define( id.id, compiled );
+			return function( span( hashtokenreadhead.at, r.at ), id, std::move( parameters ), std::move( routine ), std::move( compiled ) );
 		}
 
-		definition parse_define( const read_head& hashtokenreadhead, read_head& r ) {
-			expected_error( r, token_id::preprocessor_define );
+		parse_result<definition> parse_define( const read_head& hashtokenreadhead, read_head& r ) {
+			if ( !expected( r, token_id::preprocessor_define ) ) {
+				return fail( r, "expected #define" );
+			}
 			advance( r );
-			expected_error( r, token_id::preprocessor_statement_begin );
+			if ( !expected( r, token_id::preprocessor_statement_begin ) ) {
+				return fail( r, "expected the body of the #define" );
+			}
 			advance( r );
 			parse_whitespace( r );
-			expected_error( r, token_id::identifier );
+			if ( !expected( r, token_id::identifier ) ) {
+				return fail( r, "expected a macro name after #define" );
+			}
 			const read_head id = r;
 			advance( r );
-			parse_whitespace( r );
+			// Only a '(' right against the name opens a parameter list;
+			// after whitespace it is the start of an object-like macro's replacement.
+			// The flag rather than r.id tells them apart, since blanks may be in the side table
 			switch ( r.id ) {
 			case token_id::open_parenthesis: 
-				return parse_define_function( hashtokenreadhead, id, r );
+			{
+				if ( source.spaced( r.at ) ) {
+					break;
+				}
+				parse_result<function> f = parse_define_function( hashtokenreadhead, id, r );
+				if ( !f ) {
+					return f.exception();
+				}
+				return definition( std::move( f.get() ) );
+			}
 			default:
 				break;
 			}
-			return parse_define_variable( hashtokenreadhead, id, r );
+			parse_whitespace( r );
+			parse_result<variable> v = parse_define_variable( hashtokenreadhead, id, r );
+			if ( !v ) {
+				return v.exception();
+			}
+			return definition( std::move( v.get() ) );
 		}
 
-		undefinition parse_undef( const read_head& hashtokenreadhead, read_head& r ) {
-			expected_error( r, token_id::preprocessor_un_def );
+		parse_result<undefinition> parse_undef( const read_head& hashtokenreadhead, read_head& r ) {
+			if ( !expected( r, token_id::preprocessor_un_def ) ) {
+				return fail( r, "expected #undef" );
+			}
+			advance( r );
+			if ( !expected( r, token_id::preprocessor_statement_begin ) ) {
+				return fail( r, "expected the body of the #undef" );
+			}
 			advance( r );
 			parse_whitespace( r );
-			expected_error( r, token_id::identifier );
-			const token& idtoken = r.t;
-			token_view idseq( &idtoken, 1 );
-			symbol id( idseq );
+			if ( !expected( r, token_id::identifier ) ) {
+				return fail( r, "expected a macro name after #undef" );
+			}
+			symbol id = symbol_at( r.at );
 			advance( r );
-			token_view seq( hashtokenreadhead.at, r.at );
-			undefinition u( seq, id );
+			undefinition u( span( hashtokenreadhead.at, r.at ), id );
 			parse_whitespace( r );
-			expected_error( r, token_id::preprocessor_statement_end );
+			if ( !expected( r, token_id::preprocessor_statement_end ) ) {
+				return fail( r, "expected the end of the #undef after the macro name" );
+			}
+			advance( r );
 
-			std::size_t count = symbols.definitions.erase( id.name );
-			if ( count == 0 ) {
+			if ( !symbols.undefine( id.id ) ) {
 				// TODO: warning that 'undef'ing a symbol that doesn't exist?
 			}
-			else if ( count > 1 ) {
-				// Should never hit this condition ever
-				// TODO: proper error
-				// multiply defined symbols being removed
-				throw parser_error();
-			}
 			return u;
 		}
 
@@ -344,79 +437,120 @@ namespace gld { namespace hlsl { namespace pp {
 			return is_macro_end( r.id );
 		}
 
-		function_call parse_function_call( read_head& r, const read_head& symbolstartreadhead, const function& function ) {
-			expected_error( r, token_id::open_parenthesis );
+		parse_result<function_call> parse_function_call( read_head& r, const read_head& symbolstartreadhead ) {
+			if ( !expected( r, token_id::open_parenthesis ) ) {
+				return fail( r, "expected '(' to start the macro's arguments" );
+			}
 			advance( r );
-			std::vector<expression> arguments;
-			for ( ;; advance( r ) ) {
-				switch ( r.id ) {
-				case token_id::whitespace:
-					continue;
-				case token_id::comma:
-					continue;
-				default:
-					// TODO: proper error
-					// unexpected token while parsing function call X
-					throw parser_error();
+			small_vector<expression, 4> arguments( resource );
+			// Arguments are text for the macro rather than expressions, so only their parentheses are followed;
+			// the call stops on its ')', which the enclosing chain steps over
+			for ( uint32 parentheses = 1; ; advance( r ) ) {
+				if ( !r.available || is_macro_end( r ) ) {
+					return fail( r, "unterminated macro call" );
+				}
+				if ( r.id == token_id::open_parenthesis ) {
+					++parentheses;
+				}
+				else if ( r.id == token_id::close_parenthesis && --parentheses == 0 ) {
+					break;
 				}
 			}
 
-			token_view seq( symbolstartreadhead.at, r.at );
-			function_call fc( seq, std::move( arguments ) );
+			function_call fc( span( symbolstartreadhead.at, r.at ), std::move( arguments ) );
 			return fc;
 		}
 
-		expression_chain parse_expression_chain( read_head& r, optional<conditional_origin> origin = none ) {
-			expression_chain expr( token_view( r.at, r.at ) );
-			token_view& seq = expr.tokens;
+		// Nothing after a broken piece of an expression can be trusted: it is recorded,
+		// kept in the chain as a parser_error term, and the rest of the directive is skipped
+		void abandon_expression( expression_chain& expr, read_head& r, parser_error e ) {
+			record( e );
+			expr.expressions.emplace_back( std::move( e ) );
+			while ( !is_macro_end( r ) ) {
+				advance( r );
+			}
+			// Still the whole directive, for whatever goes over it again
+			expr.tokens = span( expr.tokens.first_token, r.at );
+		}
+
+		// A parenthesized chain stops in front of its ')', which the enclosing chain steps over
+		expression_chain parse_expression_chain( read_head& r, optional<conditional_origin> origin = none, bool parenthesized = false ) {
+			expression_chain expr( span( r.at, r.at ), resource );
+			token_span& seq = expr.tokens;
 			const read_head ebeginr = r;
-			stack<operator_precedence> operations;
+			// Scratch space that dies with the call, so it spills to the default resource rather than the tree's
+			small_vector<operator_precedence, 8> operations;
 			// @ ## # 
 			// * / + - ^ % | &  
 			// || &&
 			// != == < <= > >= 
-			stack<std::reference_wrapper<const token>> terms;
+			small_vector<iterator, 8> terms;
 			// Symbols, keywords
-			optional<const read_head&> maybelastr;
+			optional<read_head> maybelastr;
 			optional<operation> maybeop;
 
 			for ( ; ; advance( r ) ) {
 				bool macroend = is_macro_end( r );
 				if ( macroend ) {
-
+					if ( parenthesized ) {
+						abandon_expression( expr, r, fail( r, "expected ')' to close the sub-expression" ) );
+					}
+					seq = span( ebeginr.at, r.at );
 					return expr;
 				}
 				switch ( r.id ) {
 				case token_id::whitespace:
+				case token_id::character_literal_begin:
+				case token_id::character_literal_end:
 					continue;
 				case token_id::identifier:
-					terms.push_back( r.t );
+				case token_id::integer_literal:
+				case token_id::integer_octal_literal:
+				case token_id::integer_hex_literal:
+				case token_id::float_literal:
+				case token_id::character_literal:
+					terms.push_back( r.at );
 					break;
 				case token_id::close_parenthesis:
+					if ( !parenthesized ) {
+						abandon_expression( expr, r, fail( r, "unbalanced ')' in a preprocessor expression" ) );
+						return expr;
+					}
 					// We are IMMEDIATELY done
-					// Check stack
-					break;
+					// TODO: Check stack
+					seq = span( ebeginr.at, r.at );
+					return expr;
 				case token_id::open_parenthesis:
 				{
-					if ( !maybelastr )
-						break;
-					const read_head& lastr = maybelastr.get();
-					const token& lasttoken = lastr.t;
-					optional<definition&> symbol = symbols[ lasttoken.lexeme ];
-					if ( symbol && symbol->is<function>() ) {
-						// Parse function call
-						expression callexpression = parse_function_call( r, lastr, symbol->get<function>() );
+					if ( maybelastr && maybelastr.get().id == token_id::identifier ) {
+						const read_head& lastr = maybelastr.get();
+						optional<macro_program&> symbol = symbols[ source.identifier( lastr.at ) ];
+						if ( symbol && symbol->function_like ) {
+							// Parse function call
+							parse_result<function_call> call = parse_function_call( r, lastr );
+							if ( !call ) {
+								abandon_expression( expr, r, std::move( call.exception() ) );
+								return expr;
+							}
+							break;
+						}
 					}
-					else {
-						// Parse sub-expression
-						expression subexpression = parse_expression_chain( r );
+					// Parse sub-expression
+					advance( r );
+					expression_chain subexpression = parse_expression_chain( r, none, true );
+					if ( is_macro_end( r ) ) {
+						// The inner chain gave up, and has already said why
+						seq = span( ebeginr.at, r.at );
+						return expr;
 					}
 					break;
 				}
 				// binary
 				case token_id::add:
+				case token_id::plus:
 				//case token_id::add_assignment:
 				case token_id::subtract:
+				case token_id::minus:
 				//case token_id::subtract_assignment:
 				case token_id::multiply:
 				//case token_id::multiply_assignment:
@@ -438,6 +572,8 @@ namespace gld { namespace hlsl { namespace pp {
 				//case token_id::boolean_xor_assignment:
 				case token_id::expression_and:
 				case token_id::expression_or:
+				case token_id::left_shift:
+				case token_id::right_shift:
 				case token_id::token_pasting:
 					maybeop = operator_of( r.id );
 					if ( maybeop ) {
@@ -448,6 +584,7 @@ namespace gld { namespace hlsl { namespace pp {
 					break;
 				// Unary
 				case token_id::boolean_complement:
+				case token_id::expression_negation:
 				case token_id::charizing:
 				case token_id::stringizing:
 					maybeop = operator_of( r.id );
@@ -457,6 +594,11 @@ namespace gld { namespace hlsl { namespace pp {
 						operations.push_back( precedence );
 					}
 					break;
+				// The condition_compiler matches each '?' to its ':'
+				case token_id::question_mark:
+				case token_id::colon:
+					operations.push_back( precedence_of( operation::ternary_expression ) );
+					break;
 				// "Function" calls
 				case token_id::preprocessor_defined:
 				{
@@ -464,46 +606,72 @@ namespace gld { namespace hlsl { namespace pp {
 					break;
 				}
 				default:
-					// TODO: proper error
-					// unexpected token in expression, expected {}
-					throw parser_error();
+					abandon_expression( expr, r, fail( r, "unexpected token in a preprocessor expression" ) );
+					return expr;
 				}
-				lasttoken = r.t;
+				maybelastr = r;
 			}
-			token_view seq( ebeginr.at, r.at );
-			return expr;
 		}
 
 		conditional parse_conditional( conditional_origin origin, read_head& r ) {
 			expression_chain e = parse_expression_chain( r, origin );
-			return conditional( origin, std::move( e ) );
+			conditional c( origin, std::move( e ) );
+			switch ( origin ) {
+			case conditional_origin::if_:
+			case conditional_origin::else_if:
+				// Compiled once here, so evaluating it under any set of macros never walks the chain
+				c.program = compile_condition( source, c.operand.tokens );
+				break;
+			default:
+				break;
+			}
+			return c;
 		}
 
-		conditional_block parse_conditional_branch( conditional_origin origin, read_head& r ) {
-			expected_error( r, token_id::preprocessor_statement_begin );
+		parse_result<conditional_block> parse_conditional_branch( conditional_origin origin, read_head& r ) {
+			if ( !expected( r, token_id::preprocessor_statement_begin ) ) {
+				return fail( r, "expected the directive's condition" );
+			}
 			advance( r );
 			conditional condition = parse_conditional( origin, r );
+			if ( !expected( r, token_id::preprocessor_statement_end ) ) {
+				return fail( r, "expected the end of the directive after its condition" );
+			}
+			advance( r );
 			block block = parse_block( r );
 			return conditional_block( std::move( condition ), std::move( block ) );
 		}
 
-		if_elseif_else parse_if_elseif_else( const read_head& hashtokenreadhead, conditional_origin origin, read_head& r ) {
-			if_elseif_else branches;
-			token_view& seq = branches.tokens;
+		parse_result<if_elseif_else> parse_if_elseif_else( const read_head& hashtokenreadhead, conditional_origin origin, read_head& r ) {
+			if_elseif_else branches( resource );
+			token_span& seq = branches.tokens;
 			switch ( origin ) {
 			case conditional_origin::if_:
 			case conditional_origin::if_def:
 			case conditional_origin::if_n_def:
 				break;
 			default:
-				// TODO: proper error
-				// cannot have else(if) as first engagement of block
-				throw parser_error();
+				return fail( r, "#elif and #else cannot start a conditional" );
 			}
 			advance( r );
-			branches.success_blocks.push_back( parse_conditional_branch( origin, r ) );
+			parse_result<conditional_block> first = parse_conditional_branch( origin, r );
+			if ( !first ) {
+				return first.exception();
+			}
+			branches.success_blocks.push_back( std::move( first.get() ) );
 			
+			// Every branch's block has been closed by the block end in front of the next directive's hash
 			for ( bool endiftrigger = false; !endiftrigger; ) {
+				parse_whitespace( r );
+				if ( !r.available || r.id == token_id::preprocessor_block_end || r.id == token_id::stream_end ) {
+					// Cut off by the end of the file, which the branch's block has already reported
+					seq = span( hashtokenreadhead.at, r.at );
+					return branches;
+				}
+				if ( !expected( r, token_id::preprocessor_hash ) ) {
+					return fail( r, "expected #elif, #else or #endif" );
+				}
+				advance( r );
 				parse_whitespace( r );
 				switch ( r.id ) {
 				case token_id::preprocessor_end_if:
@@ -512,9 +680,7 @@ namespace gld { namespace hlsl { namespace pp {
 				case token_id::preprocessor_if:
 				case token_id::preprocessor_if_n_def:
 				case token_id::preprocessor_if_def:
-					// TODO: proper error
-					// Cannot have if/ifndef/ifdef blocks chained when if/ifndef/ifdef has already been used
-					throw parser_error();
+					return fail( r, "#if, #ifdef and #ifndef cannot continue a conditional" );
 				case token_id::preprocessor_else_if:
 					origin = conditional_origin::else_if;
 					break;
@@ -527,103 +693,122 @@ namespace gld { namespace hlsl { namespace pp {
 				case token_id::preprocessor_else:
 					origin = conditional_origin::else_;
 					break;
+				default:
+					return fail( r, "expected #elif, #else or #endif" );
 				}
 				advance( r );
-				branches.success_blocks.push_back( parse_conditional_branch( origin, r ) );
+				parse_result<conditional_block> branch = parse_conditional_branch( origin, r );
+				if ( !branch ) {
+					return branch.exception();
+				}
+				branches.success_blocks.push_back( std::move( branch.get() ) );
+			}
+			// Step over the #endif and its empty statement
+			advance( r );
+			if ( !expected( r, token_id::preprocessor_statement_begin ) ) {
+				return fail( r, "expected the end of the #endif" );
 			}
-			seq = token_view( hashtokenreadhead.at, r.at );
+			advance( r );
+			parse_whitespace( r );
+			if ( !expected( r, token_id::preprocessor_statement_end ) ) {
+				return fail( r, "unexpected text after #endif" );
+			}
+			advance( r );
+			seq = span( hashtokenreadhead.at, r.at );
 			return branches;
 		}
 
-		if_elseif_else parse_if( const read_head& hashtokenreadhead, read_head& r ) {
+		parse_result<if_elseif_else> parse_if( const read_head& hashtokenreadhead, read_head& r ) {
 			return parse_if_elseif_else( hashtokenreadhead, conditional_origin::if_, r );
 		}
 
-		if_elseif_else parse_ifdef( const read_head& hashtokenreadhead, read_head& r ) {
+		parse_result<if_elseif_else> parse_ifdef( const read_head& hashtokenreadhead, read_head& r ) {
 			return parse_if_elseif_else( hashtokenreadhead, conditional_origin::if_def, r );
 		}
 
-		if_elseif_else parse_ifndef( const read_head& hashtokenreadhead, read_head& r ) {
+		parse_result<if_elseif_else> parse_ifndef( const read_head& hashtokenreadhead, read_head& r ) {
 			return parse_if_elseif_else( hashtokenreadhead, conditional_origin::if_n_def, r );
 		}
 
-		force_line parse_line_directive( const read_head& hashtokenreadhead, read_head& r ) {
-			expected_error( r, token_id::preprocessor_statement_begin );
+		parse_result<force_line> parse_line_directive( read_head& r ) {
+			if ( !expected( r, token_id::preprocessor_statement_begin ) ) {
+				return fail( r, "expected the line number after #line" );
+			}
 			advance( r );
 			
 			// TODO: implement line directive reading
-			throw parser_error();
-
-			expected_error( r, token_id::preprocessor_statement_end );
-			advance( r );
+			return fail( r, "#line is not supported yet" );
 		}
 
-		inclusion parse_include( const read_head& hashtokenreadhead, read_head& r ) {
-			const token& includetoken = r.t;
+		parse_result<inclusion> parse_include( const read_head& hashtokenreadhead, read_head& r ) {
+			iterator includeat = r.at;
 			advance( r );
 			
-			expected_error( r, token_id::preprocessor_statement_begin );
+			if ( !expected( r, token_id::preprocessor_statement_begin ) ) {
+				return fail( r, "expected the file name after #include" );
+			}
 			advance( r );
 			parse_whitespace( r );
 			
-			string_literal includeliteral = parse_string_literal( r );
-			inclusion_style style = includetoken.value.get<inclusion_style>( );
+			parse_result<string_literal> includeliteral = parse_string_literal( r );
+			if ( !includeliteral ) {
+				return includeliteral.exception();
+			}
+			const token_value& includevalue = source.value( includeat );
+			inclusion_style style = includevalue.get<inclusion_style>( );
 			
-			expected_error( r, token_id::preprocessor_statement_end );
+			if ( !expected( r, token_id::preprocessor_statement_end ) ) {
+				return fail( r, "unexpected text after the #include file name" );
+			}
 			advance( r );
 
-			token_view seq( hashtokenreadhead.at, r.at );
-
-			return inclusion( seq, includeliteral, style );
+			return inclusion( span( hashtokenreadhead.at, r.at ), includeliteral.get(), style );
 		}
 
-		pragma_construct parse_pragma( const read_head& hashtokenreadhead, read_head& r ) {
+		parse_result<pragma_construct> parse_pragma( const read_head& hashtokenreadhead, read_head& r ) {
 			advance( r );
 			
-			expected_error( r, token_id::preprocessor_statement_begin );
+			if ( !expected( r, token_id::preprocessor_statement_begin ) ) {
+				return fail( r, "expected the body of the #pragma" );
+			}
 			advance( r );
 			
 			for ( ; r.available; advance( r ) ) {
-				const token& t = r.t;
-				if ( t.id == token_id::preprocessor_statement_end ) {
+				if ( r.id == token_id::preprocessor_statement_end ) {
 					break;
 				}
 			}
 			
-			expected_error( r, token_id::preprocessor_statement_end );
+			if ( !expected( r, token_id::preprocessor_statement_end ) ) {
+				return fail( r, "unterminated #pragma" );
+			}
 			advance( r );
 			
-			token_view seq( hashtokenreadhead.at, r.at );
-			return pragma_construct( seq );
+			return pragma_construct( span( hashtokenreadhead.at, r.at ) );
 		}
 
-		substitution parse_substitution( buffer_view<const symbol> parameters, read_head& r ) {
+		// The macro's parameters are bound in compiler, which tells them apart from other names
+		substitution parse_substitution( read_head& r ) {
 			// TODO: can this... ever really fail?
 			auto beginat = r.at;
 			auto lineat = r.at;
-			std::vector<substitution_text> substitutiontext;
+			substitution_text_list substitutiontext( resource );
 			auto commitline = [&]() {
 				if ( lineat == r.at )
 					return;
-				token_view seq( lineat, r.at );
-				substitutiontext.emplace_back( in_place_of<text_line>(), seq );
+				substitutiontext.emplace_back( in_place_of<text_line>(), span( lineat, r.at ) );
 			};
 			for ( ; r.available; ) {
-				auto symbolfind = [ lexeme = r.t.get( ).lexeme ]( const symbol& s ) {
-					return s.name == lexeme;
-				};
 				switch ( r.id ) {
 				case token_id::preprocessor_variadic_arguments:
 				case token_id::identifier:
-					if ( !parameters.empty()
-						&& std::find_if( parameters.begin(), parameters.end(), symbolfind ) != parameters.end() ) {
+					if ( compiler.parameter_of( source, r.at ) != macro_compiler::not_a_parameter ) {
 						commitline();
-						substitutiontext.emplace_back( in_place_of<substitution_argument>(), token_view( r.at, 1 ) );
+						substitutiontext.emplace_back( in_place_of<substitution_argument>(), symbol_at( r.at ) );
+						advance( r );
+						lineat = r.at;
+						continue;
 					}
-					advance( r );
-					lineat = r.at;
-					continue;
-				case token_id::whitespace:
 					advance( r );
 					continue;
 				case token_id::preprocessor_statement_end:
@@ -631,12 +816,13 @@ namespace gld { namespace hlsl { namespace pp {
 				case token_id::newlines:
 					break;
 				default:
+					advance( r );
 					continue;
 				}
 				break;
 			}
-			token_view seq( beginat, r.at );
-			return substitution( seq, std::move( substitutiontext ) );
+			commitline();
+			return substitution( span( beginat, r.at ), std::move( substitutiontext ) );
 		}
 
 		text_line parse_text_line( read_head& r ) {
@@ -652,8 +838,7 @@ namespace gld { namespace hlsl { namespace pp {
 				}
 				break;
 			}
-			token_view seq( beginat, r.at );
-			return text_line( seq );
+			return text_line( span( beginat, r.at ) );
 		}
 
 		statement parse_preprocessor( read_head& r ) {
@@ -662,45 +847,54 @@ namespace gld { namespace hlsl { namespace pp {
 			parse_whitespace( r );
 			switch ( r.id ) {
 			case token_id::preprocessor_un_def:
-				return parse_undef( hashtokenreadhead, r );
+				return directive( hashtokenreadhead, r, parse_undef( hashtokenreadhead, r ) );
 			case token_id::preprocessor_define:
 				{
-					definition d = parse_define( hashtokenreadhead, r );
-					switch ( d.class_index() ) {
+					parse_result<definition> d = parse_define( hashtokenreadhead, r );
+					if ( !d ) {
+						return failed_directive( hashtokenreadhead, r, std::move( d.exception() ) );
+					}
+					switch ( d.get().class_index() ) {
 					case definition::index<function>::value:
-						return std::move( d.get<function>() );
+						return tree.make_function( std::move( d.get().get<function>() ) );
 					case definition::index<variable>::value:
 					default:
-						return std::move( d.get<variable>() );
+						return std::move( d.get().get<variable>() );
 					}
 				}
 				break;
 			case token_id::preprocessor_if:
-				return tree.make_if_elseif_else( parse_if( hashtokenreadhead, r ) );
+				return conditional_directive( hashtokenreadhead, r, parse_if( hashtokenreadhead, r ) );
 			case token_id::preprocessor_if_def:
-				return tree.make_if_elseif_else( parse_ifdef( hashtokenreadhead, r ) );
+				return conditional_directive( hashtokenreadhead, r, parse_ifdef( hashtokenreadhead, r ) );
 			case token_id::preprocessor_if_n_def:
-				return tree.make_if_elseif_else( parse_ifndef( hashtokenreadhead, r ) );
+				return conditional_directive( hashtokenreadhead, r, parse_ifndef( hashtokenreadhead, r ) );
 			case token_id::preprocessor_else_if:
 			case token_id::preprocessor_else_if_def:
 			case token_id::preprocessor_else_if_n_def:
 			case token_id::preprocessor_else:
 			case token_id::preprocessor_end_if:
-				// TODO: proper error
-				// cannot else_if/else/endif without starting if/ifdef/ifndef
-				throw parser_error();
-				break;
+				return failed_directive( hashtokenreadhead, r, fail( r, "#elif, #else or #endif without a matching #if" ) );
 			case token_id::preprocessor_include:
-				return parse_include( hashtokenreadhead, r );
+				return directive( hashtokenreadhead, r, parse_include( hashtokenreadhead, r ) );
 			case token_id::preprocessor_line:
-				return parse_line_directive( hashtokenreadhead, r );
+				return directive( hashtokenreadhead, r, parse_line_directive( r ) );
 			case token_id::preprocessor_pragma:
-				return parse_pragma( hashtokenreadhead, r );
+				return directive( hashtokenreadhead, r, parse_pragma( hashtokenreadhead, r ) );
+			case token_id::invalid_directive:
+				// Already reported by the lexer: keep the line as text and move on
+				synchronize( r );
+				return text_line( span( hashtokenreadhead.at, r.at ) );
 			default:
-				// Placeholder
-				throw parser_error();
-				break;
+				return failed_directive( hashtokenreadhead, r, fail( r, "unsupported preprocessor directive" ) );
+			}
+		}
+
+		statement conditional_directive( const read_head& hashtokenreadhead, read_head& r, parse_result<if_elseif_else>&& result ) {
+			if ( !result ) {
+				return failed_directive( hashtokenreadhead, r, std::move( result.exception() ) );
 			}
+			return tree.make_if_elseif_else( std::move( result.get() ) );
 		}
 
 		statement parse_statement( read_head& r ) {
@@ -721,55 +915,95 @@ namespace gld { namespace hlsl { namespace pp {
 		}
 
 		block parse_block( read_head& r ) {
-			block resultblock;
+			block resultblock( resource );
 			parse_block( r, resultblock );
 			return resultblock;
 		}
 
+		// Every iteration of a statement loop must move forward, even over a token nothing knows how to parse
+		void parse_statement_into( read_head& r, block& resultblock ) {
+			auto beginat = r.at;
+			statement statement = parse_statement( r );
+			if ( r.at == beginat ) {
+				record( fail( r, "unexpected token" ) );
+				advance( r );
+				return;
+			}
+			resultblock.statements.push_back( std::move( statement ) );
+		}
+
 		void parse_block( read_head& r, block& resultblock ) {
-			expected_error( r, token_id::preprocessor_block_begin );
-			const token& blockbegintoken = r.t;
-			intz blockid = blockbegintoken.value.get<intz>();
+			if ( !expected( r, token_id::preprocessor_block_begin ) ) {
+				record( fail( r, "expected the start of a block" ) );
+				return;
+			}
+			const token_value& blockbegin = source.value( r.at );
+			// Only the stream-level block is numbered; conditional blocks are closed by the next directive
+			intz blockid = blockbegin.is<intz>() ? blockbegin.get<intz>() : 0;
 			advance( r );
 			for ( ;; ) {
 				parse_whitespace( r );
+				if ( !r.available || r.id == token_id::stream_end ) {
+					record( fail( r, "unterminated preprocessor block" ) );
+					return;
+				}
 				switch ( r.id ) {
 				case token_id::preprocessor_block_end:
 				{
-					const token& blockendtoken = r.t;
-					intz endblockid = blockbegintoken.value.get<intz>();
+					const token_value& blockend = source.value( r.at );
+					intz endblockid = blockend.is<intz>() ? blockend.get<intz>() + 1 : blockid;
 					if ( blockid != endblockid ) {
-						// TODO: proper error
-						// mismatched block beginning at X, check to see if blocks are properly closed
-						throw parser_error();
+						// The stream-level block end: the file ran out inside a conditional, which is
+						// reported here once and left for the stream-level block to close
+						record( fail( r, "#if without a matching #endif" ) );
+						return;
 					}
+					advance( r );
 					break;
 				}
 				case token_id::preprocessor_block_begin:
 					advance( r );
 				default:
-				{
-					statement statement = parse_statement( r );
-					resultblock.statements.push_back( std::move( statement ) );
+					parse_statement_into( r, resultblock );
 					continue;
 				}
-				}
 				break;
 			}
 		}
 
 		void parse_stream( read_head& r, block& targetblock ) {
-			token_view& rootsequence = targetblock.tokens;
+			token_span& rootsequence = targetblock.tokens;
 			auto beginat = r.at;
-			expected_error( r, token_id::stream_begin );
-			advance( r );
-			rootsequence = token_view( beginat, 1 );
+			if ( !expected( r, token_id::stream_begin ) ) {
+				record( fail( r, "expected the start of a token stream" ) );
+			}
+			else {
+				advance( r );
+			}
+			rootsequence = span( beginat, beginat + 1 );
 			
 			parse_block( r, targetblock );
+			// A stray #else or #endif closes the stream-level block early; the directive
+			// itself has been reported, so whatever follows is still parsed into the root
+			for ( ;; ) {
+				parse_whitespace( r );
+				if ( !r.available || r.id == token_id::stream_end ) {
+					break;
+				}
+				if ( r.id == token_id::preprocessor_block_end ) {
+					advance( r );
+					continue;
+				}
+				parse_statement_into( r, targetblock );
+			}
 			
-			expected_error( r, token_id::stream_end );
-			advance( r );
-			rootsequence = token_view( source.data(), &r.t.get() );
+			if ( !expected( r, token_id::stream_end ) ) {
+				record( fail( r, "expected the end of the token stream" ) );
+			}
+			else {
+				advance( r );
+			}
+			rootsequence = span( begin, r.at == begin ? begin : current( r ) );
 		}
 
 	public:
@@ -780,4 +1014,7 @@ namespace gld { namespace hlsl { namespace pp {
 		}
 	};
 
+	typedef basic_parser<unpacked_tokens> parser;
+	typedef basic_parser<packed_tokens> packed_parser;
+
 }}}
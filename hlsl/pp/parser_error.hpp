@@ -1,19 +1,20 @@
 #pragma once
 
-#include "../string.hpp"
+#include "../source_location.hpp"
+#include "../../string.hpp"
 #include <exception>
 
 namespace gld { namespace hlsl { namespace pp {
 
 	struct parser_error : public std::exception {
 		string message;
-		occurrence where;
+		source_location where;
 
-		parser_error( occurrence where = {}, string message = "undescribed parsing failure" ) : where( where ), message(message) {
+		parser_error( source_location where = {}, string message = "undescribed parsing failure" ) : where( where ), message(message) {
 
 		}
 
-		virtual const char* what() const override {
+		virtual const char* what() const noexcept override {
 			return message.c_str();
 		}
 	};
@@ -38,8 +38,8 @@ namespace gld { namespace hlsl { namespace pp {
 			{ operation::right_shift_assignment, 0, associativity::right },
 			// Expression operators
 			{ operation::expression_negation, 8192, associativity::right },
-			{ operation::expression_or, 16, associativity::left },
-			{ operation::expression_and, 8, associativity::left },
+			{ operation::expression_or, 8, associativity::left },
+			{ operation::expression_and, 16, associativity::left },
 			{ operation::assignment, 4, associativity::left },
 			{ operation::ternary_expression, 4, associativity::left },
 			// Math operators
@@ -1,8 +1,10 @@
 #pragma once
 
 #include "expression.hpp"
+#include "macro_program.hpp"
 #include "../../range.hpp"
 #include "../../optional.hpp"
+#include "../../small_vector.hpp"
 
 namespace gld { namespace hlsl { namespace pp {
 
@@ -10,38 +12,43 @@ namespace gld { namespace hlsl { namespace pp {
 		string_literal name;
 		inclusion_style style;
 
-		inclusion( buffer_view<const token> seq, string_literal name, inclusion_style style ) : sequence( seq ), name( name ), style( style ) {
+		inclusion( token_span seq, string_literal name, inclusion_style style ) : sequence( seq ), name( name ), style( style ) {
 
 		}
 	};
 
 	struct text_line : sequence {
 
-		text_line( buffer_view<const token> seq ) : sequence( seq ) {
+		text_line( token_span seq ) : sequence( seq ) {
 
 		}
 
 	};
 
 	struct substitution_argument : symbol {
-		substitution_argument( buffer_view<const token> seq ) : symbol( seq ) {
+		substitution_argument( symbol name ) : symbol( name ) {
 
 		}
 	};
 
 	typedef variant<substitution_argument, text_line> substitution_text;
 
+	// Inline sizes fit the bundled shaders' macros: a macro seldom takes more than four parameters,
+	// and a body alternates arguments with the text between them, so three arguments make seven pieces
+	typedef small_vector<substitution_text, 8> substitution_text_list;
+	typedef small_vector<symbol, 4> parameter_list;
+
 	struct substitution : sequence {
-		std::vector<substitution_text> text;
+		substitution_text_list text;
 
-		substitution( buffer_view<const token> seq, std::vector<substitution_text> text ) : sequence( seq ), text( std::move( text ) ) {
+		substitution( token_span seq, substitution_text_list text ) : sequence( seq ), text( std::move( text ) ) {
 
 		}
 	};
 
 	struct undefinition : sequence {
 		symbol name;
-		undefinition( buffer_view<const token> seq, symbol name ) : sequence( seq ), name( std::move( name ) ) {
+		undefinition( token_span seq, symbol name ) : sequence( seq ), name( std::move( name ) ) {
 
 		}
 	};
@@ -49,53 +56,33 @@ namespace gld { namespace hlsl { namespace pp {
 	struct variable : sequence {
 		symbol name;
 		text_line substitution;
+		macro_program program;
 
 		template <typename... Tn>
-		variable( buffer_view<const token> seq, symbol name, Tn&&... argn ) : sequence( seq ), name( name ), substitution( std::forward<Tn>( argn )... ) {
+		variable( token_span seq, symbol name, macro_program program, Tn&&... argn ) : sequence( seq ), name( name ), substitution( std::forward<Tn>( argn )... ), program( program ) {
 
 		}
 	};
 
 	struct function : sequence {
 		symbol name;
-		std::vector<symbol> parameters;
+		parameter_list parameters;
 		substitution routine;
+		macro_program program;
 		bool variadic_argument;
 
+		// The last parameter is '...'
 		bool is_variadic_arguments() const {
-			struct visitor {
-				int last = 0;
-				int dot_dot_dot = 0;
-				void operator() ( const substitution_argument& arg ) {
-					++last;
-					if ( arg.tokens.empty() )
-						return;
-					if ( arg.tokens.back().id == token_id::dot_dot_dot )
-						dot_dot_dot = last;
-					++last;
-				}
-
-				void operator() ( const text_line& line ) {
-					++last;
-				}
-
-				bool is_variadic() const {
-					return dot_dot_dot == last;
-				}
-			};
-			visitor v{};
-			for ( auto& sub : routine.text ) {
-				sub.visit( v );
-			}
-			return v.is_variadic();
-		}
-
-		function( buffer_view<const token> seq, symbol name,
-			std::vector<symbol> params, substitution routine )
+			return program.variadic;
+		}
+
+		function( token_span seq, symbol name,
+			parameter_list params, substitution routine, macro_program program )
 			: sequence( seq ), name( name ),
 			parameters( std::move( params ) ),
 			routine( std::move( routine ) ),
-			variadic_argument( is_variadic_arguments() ) {
+			program( program ),
+			variadic_argument( program.variadic ) {
 
 		}
 	};
@@ -104,7 +91,7 @@ namespace gld { namespace hlsl { namespace pp {
 		integral_literal number;
 		optional<string_literal> filename;
 
-		force_line( buffer_view<const token> seq, integral_literal number, optional<string_literal> filename ) : sequence( seq ), number( std::move( number ) ), filename( std::move( filename ) ) {
+		force_line( token_span seq, integral_literal number, optional<string_literal> filename ) : sequence( seq ), number( std::move( number ) ), filename( std::move( filename ) ) {
 			
 		}
 
@@ -112,14 +99,14 @@ namespace gld { namespace hlsl { namespace pp {
 
 	struct error_construct : sequence {
 		string_literal text;
-		error_construct( buffer_view<const token> seq, string_literal text ) : sequence( seq ), text( text ) {
+		error_construct( token_span seq, string_literal text ) : sequence( seq ), text( text ) {
 
 		}
 	};
 
 	struct pragma_construct : sequence {
 
-		pragma_construct( buffer_view<const token> seq ) : sequence( seq ) {
+		pragma_construct( token_span seq ) : sequence( seq ) {
 
 		}
 
@@ -137,7 +124,8 @@ namespace gld { namespace hlsl { namespace pp {
 		text_line,
 		undefinition,
 		variable,
-		function,
+		// Out of line, as its parameter and substitution lists keep their first entries inline
+		index_ref<function>,
 		force_line,
 		// keyword constructs
 		inclusion,
@@ -151,7 +139,16 @@ namespace gld { namespace hlsl { namespace pp {
 	> statement;
 
 	struct block : sequence {
-		std::vector<statement> statements;
+		// Most #if branches hold a line or two
+		small_vector<statement, 2> statements;
+
+		block() {
+
+		}
+
+		explicit block( pmr::memory_resource* resource ) : statements( resource ) {
+
+		}
 	};
 
 	struct conditional_block {
@@ -164,12 +161,17 @@ namespace gld { namespace hlsl { namespace pp {
 	};
 
 	struct if_elseif_else : sequence {
-		std::vector<conditional_block> success_blocks;
+		// #if, one #elif and #else fill the inline room; longer chains spill to the tree's resource
+		small_vector<conditional_block, 3> success_blocks;
 		bool no_more_conditions;
 
 		if_elseif_else() : no_more_conditions( false ) {
 
 		}
+
+		explicit if_elseif_else( pmr::memory_resource* resource ) : success_blocks( resource ), no_more_conditions( false ) {
+
+		}
 	};
 
 }}}
@@ -1,7 +1,8 @@
 #pragma once
 
 #include "statement.hpp"
-#include <unordered_map>
+#include "../../memory_resource.hpp"
+#include <algorithm>
 
 namespace gld { namespace hlsl { namespace pp {
 
@@ -10,21 +11,48 @@ namespace gld { namespace hlsl { namespace pp {
 		// TODO: measure single-table with variant for items
 		// versus double-table with specifics
 		// immediate benefit of variant: adding more "Tables" is easier, backing allocator changes simpler
-		std::unordered_map<string_view, std::reference_wrapper<definition>> definitions;
+		// Indexed by interned id, which is dense: a lookup is one bounds check and one load, and defining allocates
+		// only when a name past the end turns up. A macro is remembered by its compiled program,
+		// whose hash settles whether a redefinition changes anything
+		struct entry {
+			macro_program program;
+			bool defined;
+		};
 
-		optional<definition&> operator[]( const string_view& name ) {
-			auto definesfind = definitions.find( name );
-			if ( definesfind != definitions.end() ) {
-				return definesfind->second;
+		pmr::vector<entry> definitions;
+
+		explicit symbol_table( pmr::memory_resource* resource = pmr::get_default_resource() )
+		: definitions( resource ) {
+
+		}
+
+		void define( identifier_id name, const macro_program& program ) {
+			if ( name.index >= definitions.size() ) {
+				definitions.resize( std::max<std::size_t>( name.index + 1, definitions.size() * 2 ), entry{ macro_program(), false } );
+			}
+			definitions[ name.index ] = entry{ program, true };
+		}
+
+		// false when name was not defined
+		bool undefine( identifier_id name ) {
+			if ( name.index >= definitions.size() || !definitions[ name.index ].defined ) {
+				return false;
+			}
+			definitions[ name.index ].defined = false;
+			return true;
+		}
+
+		optional<macro_program&> operator[]( identifier_id name ) {
+			if ( name.index < definitions.size() && definitions[ name.index ].defined ) {
+				return definitions[ name.index ].program;
 			}
 
 			return none;
 		}
 
-		optional<const definition&> operator[]( const string_view& name ) const {
-			auto definesfind = definitions.find( name );
-			if ( definesfind != definitions.end() ) {
-				return definesfind->second;
+		optional<const macro_program&> operator[]( identifier_id name ) const {
+			if ( name.index < definitions.size() && definitions[ name.index ].defined ) {
+				return definitions[ name.index ].program;
 			}
 
 			return none;
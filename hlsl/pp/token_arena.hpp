@@ -0,0 +1,162 @@
+#pragma once
+
+#include "../token.hpp"
+#include "../identifier.hpp"
+#include "../../numeric.hpp"
+#include "../../range.hpp"
+#include "../../string.hpp"
+#include "../../memory_resource.hpp"
+#include <cstring>
+
+namespace gld { namespace hlsl { namespace pp {
+
+	// Tokens no source buffer spells: what pasting and stringizing make while macros are expanded.
+	// Their text is bump-allocated and kept until the arena goes, and a spelling made twice is the same token both times,
+	// so a macro that pastes the same names on every use costs one hash probe after its first
+	class token_arena {
+	public:
+		static const uint32 none = 0xFFFFFFFF;
+
+	private:
+		pmr::monotonic_buffer_resource text;
+		pmr::vector<token> tokens;
+		pmr::vector<uint32> hashes;
+		// Token + 1 by hash of id and spelling, open addressed and never more than half full
+		pmr::vector<uint32> slots;
+		// Identifier token + 1 by hash of spelling, over the buffer names were last found in;
+		// only built when there is no string_pool at hand to ask
+		pmr::vector<uint32> nameslots;
+		const token* namebuffer;
+
+		// FNV-1a, 32-bit
+		static uint32 hash_of( token_id id, const char* first, const char* last ) {
+			uint32 h = ( 2166136261u ^ static_cast<uint32>( id ) ) * 16777619u;
+			for ( ; first != last; ++first ) {
+				h = ( h ^ static_cast<uint8>( *first ) ) * 16777619u;
+			}
+			return h;
+		}
+
+		static bool spelled( const token& t, const char* first, const char* last ) {
+			std::size_t size = static_cast<std::size_t>( last - first );
+			return static_cast<std::size_t>( t.lexeme.data_end() - t.lexeme.data() ) == size
+				&& std::memcmp( t.lexeme.data(), first, size ) == 0;
+		}
+
+		static void place( pmr::vector<uint32>& table, uint32 hash, uint32 value ) {
+			std::size_t mask = table.size() - 1;
+			std::size_t slot = hash & mask;
+			while ( table[ slot ] != 0 ) {
+				slot = ( slot + 1 ) & mask;
+			}
+			table[ slot ] = value + 1;
+		}
+
+		void grow() {
+			slots.assign( slots.empty() ? 64 : slots.size() * 2, 0 );
+			for ( uint32 i = 0; i < static_cast<uint32>( tokens.size() ); ++i ) {
+				place( slots, hashes[ i ], i );
+			}
+		}
+
+		void index_names( buffer_view<const token> buffer ) {
+			std::size_t count = 0;
+			for ( const token& t : buffer ) {
+				count += t.id == token_id::identifier ? 1 : 0;
+			}
+			std::size_t size = 64;
+			while ( size < count * 2 ) {
+				size *= 2;
+			}
+			nameslots.assign( size, 0 );
+			for ( uint32 i = 0; i < static_cast<uint32>( buffer.size() ); ++i ) {
+				const token& t = buffer[ i ];
+				if ( t.id != token_id::identifier ) {
+					continue;
+				}
+				// One slot per name: a spelling already there is not placed again
+				uint32 h = hash_of( token_id::identifier, t.lexeme.data(), t.lexeme.data_end() );
+				std::size_t mask = nameslots.size() - 1;
+				std::size_t slot = h & mask;
+				while ( nameslots[ slot ] != 0 && !spelled( buffer[ nameslots[ slot ] - 1 ], t.lexeme.data(), t.lexeme.data_end() ) ) {
+					slot = ( slot + 1 ) & mask;
+				}
+				if ( nameslots[ slot ] == 0 ) {
+					nameslots[ slot ] = i + 1;
+				}
+			}
+			namebuffer = buffer.data();
+		}
+
+	public:
+		explicit token_arena( pmr::memory_resource* resource = pmr::get_default_resource() )
+		: text( 4096, resource ), tokens( resource ), hashes( resource ), slots( resource ), nameslots( resource ), namebuffer( nullptr ) {
+
+		}
+
+		token_arena( const token_arena& ) = delete;
+		token_arena& operator=( const token_arena& ) = delete;
+
+		std::size_t size() const {
+			return tokens.size();
+		}
+
+		const token& operator[]( std::size_t i ) const {
+			return tokens[ i ];
+		}
+
+		// Bytes of text held, alignment padding included
+		std::size_t bytes_allocated() const {
+			return text.bytes_allocated();
+		}
+
+		// The token spelled [first, last) as id, or none
+		uint32 find( token_id id, const char* first, const char* last ) const {
+			if ( slots.empty() ) {
+				return none;
+			}
+			std::size_t mask = slots.size() - 1;
+			std::size_t slot = hash_of( id, first, last ) & mask;
+			for ( ; slots[ slot ] != 0; slot = ( slot + 1 ) & mask ) {
+				const token& t = tokens[ slots[ slot ] - 1 ];
+				if ( t.id == id && spelled( t, first, last ) ) {
+					return slots[ slot ] - 1;
+				}
+			}
+			return none;
+		}
+
+		// Copies [first, last) in; for a spelling find has not got
+		uint32 add( token_id id, source_location where, const char* first, const char* last, token_value value = unit() ) {
+			if ( ( tokens.size() + 1 ) * 2 > slots.size() ) {
+				grow();
+			}
+			std::size_t size = static_cast<std::size_t>( last - first );
+			char* spelling = static_cast<char*>( text.allocate( size == 0 ? 1 : size, 1 ) );
+			std::memcpy( spelling, first, size );
+			uint32 i = static_cast<uint32>( tokens.size() );
+			tokens.emplace_back( id, where, string_view( spelling, spelling + size ), std::move( value ) );
+			hashes.push_back( hash_of( id, first, last ) );
+			place( slots, hashes.back(), i );
+			return i;
+		}
+
+		// The interned name [first, last) has in buffer, found by spelling, or the invalid id if nothing there spells it.
+		// The first call for a buffer indexes its identifiers, once
+		identifier_id find_name( buffer_view<const token> buffer, const char* first, const char* last ) {
+			if ( namebuffer != buffer.data() || nameslots.empty() ) {
+				index_names( buffer );
+			}
+			std::size_t mask = nameslots.size() - 1;
+			std::size_t slot = hash_of( token_id::identifier, first, last ) & mask;
+			for ( ; nameslots[ slot ] != 0; slot = ( slot + 1 ) & mask ) {
+				const token& t = buffer[ nameslots[ slot ] - 1 ];
+				if ( spelled( t, first, last ) ) {
+					return identifier_of( t );
+				}
+			}
+			return identifier_id();
+		}
+	};
+
+}}}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "../token.hpp"
+#include "../../string.hpp"
+#include "../../numeric.hpp"
+
+namespace gld { namespace hlsl { namespace pp {
+
+	enum class trivia_mode {
+		// Whitespace and comments are ordinary tokens in the stream
+		tokens,
+		// Whitespace and comments go to a side table; newlines stay in the stream,
+		// since they end text lines and directives. The token after them is marked spaced
+		// in either mode, so the tree and every expansion come out the same
+		side_table,
+	};
+
+	// One whitespace or comment token lifted out of the stream
+	// Entries are in source order, and each sits right after the significant token it is attached to,
+	// so interleaving them back in by index reproduces the source text
+	struct trivia {
+		token_id id;
+		source_location where;
+		string_view text;
+		// Index of the preceding significant token in the stream
+		uint32 after;
+	};
+
+}}}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "../numeric.hpp"
+
+namespace gld { namespace hlsl {
+
+	// A position in one global offset space shared by every file a source_manager knows:
+	// each file owns a contiguous range, so the 32 bits encode both the file and the offset into it
+	// 0 is reserved as the invalid location
+	struct source_location {
+		uint32 raw;
+
+		source_location() : raw( 0 ) {
+
+		}
+
+		explicit source_location( uint32 raw ) : raw( raw ) {
+
+		}
+
+		bool valid() const {
+			return raw != 0;
+		}
+
+		source_location advanced( uint32 bytes ) const {
+			return source_location( raw + bytes );
+		}
+
+		bool operator==( const source_location& right ) const {
+			return raw == right.raw;
+		}
+
+		bool operator!=( const source_location& right ) const {
+			return raw != right.raw;
+		}
+
+		bool operator<( const source_location& right ) const {
+			return raw < right.raw;
+		}
+	};
+
+}}
@@ -0,0 +1,183 @@
+#pragma once
+
+#include "source_location.hpp"
+#include "occurrence.hpp"
+#include "../string.hpp"
+#include "../numeric.hpp"
+#include "../byte_scan.hpp"
+#include "../utf8.hpp"
+#include "../mapped_file.hpp"
+#include "../optional.hpp"
+#include "string_pool.hpp"
+#include "splice_map.hpp"
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <stdexcept>
+
+namespace gld { namespace hlsl {
+
+	typedef uint32 file_id;
+
+	// Owns the location space for every file lexed, the memory of every file it loaded itself,
+	// and the identifier pool for the session:
+	// tokens and parse trees hold views into that memory, so the manager must outlive them
+	class source_manager {
+	private:
+		struct file_entry {
+			string origin;
+			string_view text;
+			uint32 base;
+			// Offsets of the first byte of every line; built when the file is added,
+			// so resolving never writes and may run on several threads at once
+			std::vector<uint32> line_starts;
+			// Both empty for text handed in by the caller, who keeps it alive
+			mapped_file mapping;
+			std::unique_ptr<char[]> owned_storage;
+			splice_map splices;
+			// Copies of just the lines that hold a splice, with the splices cut out (see splice_map)
+			string_view spliced_lines;
+			std::unique_ptr<char[]> spliced_storage;
+			// Offset of the first byte that is not well-formed UTF-8; the text's size when there is none
+			uint32 invalid_offset;
+		};
+
+		std::vector<file_entry> files;
+		uint32 next;
+		string_pool identifiers;
+
+		const file_entry& entry_of( source_location location ) const {
+			auto found = std::upper_bound( files.begin(), files.end(), location.raw, []( uint32 raw, const file_entry& f ) {
+				return raw < f.base;
+			} );
+			return *--found;
+		}
+
+	public:
+		source_manager() : next( 1 ) {
+
+		}
+
+		// Text is checked to be well-formed UTF-8 once, here, so the lexers can walk it byte by byte.
+		// Ill-formed text is still added: the lexers report every bad byte where they reach it and go on after it
+		file_id add( string origin, string_view text ) {
+			const char* invalid = find_invalid_utf8( text.data(), text.data_end() );
+			uint64 size = static_cast<uint64>( std::distance( text.data(), text.data_end() ) );
+			// One extra location past the end of every file, for the stream end
+			if ( next + size + 1 > 0xFFFFFFFFull ) {
+				throw std::length_error( "source_manager: 32-bit location space exhausted" );
+			}
+			file_id id = static_cast<file_id>( files.size() );
+			files.push_back( file_entry{ std::move( origin ), text, next, {}, mapped_file(), nullptr, splice_map( text.data(), text.data_end() ), string_view(), nullptr, 0 } );
+			file_entry& f = files.back();
+			f.line_starts.push_back( 0 );
+			find_line_starts( text.data(), text.data_end(), f.line_starts );
+			if ( !f.splices.empty() ) {
+				f.spliced_storage.reset( new char[ f.splices.copied() ] );
+				f.splices.copy_lines( text.data(), f.spliced_storage.get() );
+				f.spliced_lines = string_view( f.spliced_storage.get(), f.spliced_storage.get() + f.splices.copied() );
+			}
+			f.invalid_offset = static_cast<uint32>( std::distance( text.data(), invalid ) );
+			next += static_cast<uint32>( size + 1 );
+			return id;
+		}
+
+		// Registers size bytes of text that the manager then owns, for sources built in memory
+		// that have to outlive their builder (a tree that holds on to its manager, say)
+		file_id add( string origin, std::unique_ptr<char[]> text, std::size_t size ) {
+			file_id id = add( std::move( origin ), string_view( text.get(), text.get() + size ) );
+			files.back().owned_storage = std::move( text );
+			return id;
+		}
+
+		// Maps the file at path read-only and registers it, with the path as its origin
+		// Only lines holding a backslash-newline are copied: every other lexeme points straight into the mapping,
+		// which lives as long as this manager
+		file_id load( string path ) {
+			mapped_file mapping( path );
+			file_id id = add( std::move( path ), mapping.view() );
+			files.back().mapping = std::move( mapping );
+			return id;
+		}
+
+		// Locations and offsets handed out by this manager count bytes of the original text, splices included
+
+		source_location location( file_id file, uint32 offset ) const {
+			return source_location( files[ file ].base + offset );
+		}
+
+		file_id file_of( source_location location ) const {
+			return static_cast<file_id>( &entry_of( location ) - files.data() );
+		}
+
+		uint32 offset_of( source_location location ) const {
+			return location.raw - entry_of( location ).base;
+		}
+
+		const string& origin_of( source_location location ) const {
+			return entry_of( location ).origin;
+		}
+
+		const string& origin_of( file_id file ) const {
+			return files[ file ].origin;
+		}
+
+		string_view text_of( file_id file ) const {
+			return files[ file ].text;
+		}
+
+		// The copies of the file's spliced lines, laid out as splices_of( file ).spliced_lines() says
+		string_view spliced_lines_of( file_id file ) const {
+			return files[ file ].spliced_lines;
+		}
+
+		const splice_map& splices_of( file_id file ) const {
+			return files[ file ].splices;
+		}
+
+		// The first byte of the file that is not well-formed UTF-8, if there is one
+		optional<uint32> invalid_utf8_of( file_id file ) const {
+			const file_entry& f = files[ file ];
+			if ( f.invalid_offset == static_cast<uint32>( std::distance( f.text.data(), f.text.data_end() ) ) ) {
+				return none;
+			}
+			return f.invalid_offset;
+		}
+
+		string_pool& names() {
+			return identifiers;
+		}
+
+		const string_pool& names() const {
+			return identifiers;
+		}
+
+		// Expands a location into line and column for diagnostics and dumps:
+		// a binary search over the line table, then counting code points from the line start
+		occurrence resolve( source_location location ) const {
+			occurrence o;
+			if ( !location.valid() ) {
+				return o;
+			}
+			const file_entry& f = entry_of( location );
+			uint32 offset = location.raw - f.base;
+			const std::vector<uint32>& lines = f.line_starts;
+			auto linefind = std::upper_bound( lines.begin(), lines.end(), offset );
+			intz line = std::distance( lines.begin(), linefind );
+			const char* linebegin = f.text.data() + *--linefind;
+			const char* at = f.text.data() + offset;
+			intz column = 1;
+			for ( ; linebegin < at; ++column ) {
+				// Count code points, not bytes, stepping as the lexers do: an ill-formed byte is one column
+				decode_utf8( linebegin, f.text.data_end() );
+			}
+			o.offset = offset;
+			o.offset_after = offset;
+			o.line = line;
+			o.processed_line = line;
+			o.column = column;
+			return o;
+		}
+	};
+
+}}
@@ -0,0 +1,205 @@
+#pragma once
+
+#include "../numeric.hpp"
+#include "../string.hpp"
+#include "../byte_scan.hpp"
+#include <vector>
+#include <algorithm>
+
+namespace gld { namespace hlsl {
+
+	struct line_splice {
+		// Offset of the '\' in the original text
+		uint32 physical;
+		// Bytes removed: the '\', any blanks after it and the line terminator
+		uint32 length;
+		// Offset in the spliced text of the first byte after the splice
+		uint32 logical;
+	};
+
+	// A run of physical lines joined by splices into one logical line
+	struct spliced_line {
+		// Offsets in the original text of the first byte of the run and of the byte after its last line
+		uint32 physical;
+		uint32 physical_end;
+		// Offset in the spliced text of the first byte of the run
+		uint32 logical;
+		// Where the run's copy, with its splices cut out, starts in the spliced line storage
+		uint32 copy;
+	};
+
+	// Every backslash-newline in a file, found once up front (translation phase 2):
+	// the lexers read the original text and step over the splices as they reach them,
+	// and only the logical lines holding a splice are copied, so a token broken across lines still has one spelling
+	class splice_map {
+	private:
+		std::vector<line_splice> splices;
+		std::vector<spliced_line> lines;
+		uint32 removedbytes;
+		uint32 copiedbytes;
+
+		static bool is_line_terminator( char c ) {
+			return static_cast<uint8>( c - 0x0A ) <= 3;
+		}
+
+	public:
+		splice_map() : removedbytes( 0 ), copiedbytes( 0 ) {
+
+		}
+
+		// Blanks between the '\' and the line terminator are tolerated, as the lexer always has
+		splice_map( const char* first, const char* last ) : removedbytes( 0 ), copiedbytes( 0 ) {
+			for ( const char* p = find_byte( first, last, '\\' ); p != last; p = find_byte( p, last, '\\' ) ) {
+				const char* terminator = find_blank_end( p + 1, last );
+				if ( terminator == last || !is_line_terminator( *terminator ) ) {
+					++p;
+					continue;
+				}
+				const char* after = terminator + 1;
+				if ( *terminator == '\r' && after != last && *after == '\n' ) {
+					++after;
+				}
+				uint32 physical = static_cast<uint32>( p - first );
+				uint32 length = static_cast<uint32>( after - p );
+				if ( lines.empty() || lines.back().physical_end <= physical ) {
+					// The splice starts a new run: back up to the start of its line
+					const char* linestart = p;
+					while ( linestart != first && !is_line_terminator( linestart[ -1 ] ) ) {
+						--linestart;
+					}
+					uint32 start = static_cast<uint32>( linestart - first );
+					lines.push_back( spliced_line{ start, 0, start - removedbytes, 0 } );
+				}
+				splices.push_back( line_splice{ physical, length, physical - removedbytes } );
+				removedbytes += length;
+				// The run goes on to the end of the line the splice joins on, terminator included
+				const char* lineend = after;
+				while ( lineend != last && !is_line_terminator( *lineend ) ) {
+					++lineend;
+				}
+				if ( lineend != last ) {
+					lineend += ( *lineend == '\r' && lineend + 1 != last && lineend[ 1 ] == '\n' ) ? 2 : 1;
+				}
+				lines.back().physical_end = static_cast<uint32>( lineend - first );
+				p = after;
+			}
+			for ( spliced_line& line : lines ) {
+				line.copy = copiedbytes;
+				copiedbytes += ( line.physical_end - line.physical ) - removed_between( line.physical, line.physical_end );
+			}
+		}
+
+		bool empty() const {
+			return splices.empty();
+		}
+
+		std::size_t size() const {
+			return splices.size();
+		}
+
+		uint32 removed() const {
+			return removedbytes;
+		}
+
+		const std::vector<line_splice>& entries() const {
+			return splices;
+		}
+
+		const std::vector<spliced_line>& spliced_lines() const {
+			return lines;
+		}
+
+		// Bytes needed to hold every spliced line's copy
+		uint32 copied() const {
+			return copiedbytes;
+		}
+
+		// Writes the copy of every spliced line of text into out, which must have room for copied() bytes
+		void copy_lines( const char* text, char* out ) const {
+			auto s = splices.begin();
+			for ( const spliced_line& line : lines ) {
+				const char* from = text + line.physical;
+				for ( ; s != splices.end() && s->physical < line.physical_end; ++s ) {
+					out = std::copy( from, text + s->physical, out );
+					from = text + s->physical + s->length;
+				}
+				out = std::copy( from, text + line.physical_end, out );
+			}
+		}
+
+		// Bytes removed by the splices that start in [first, last)
+		uint32 removed_between( uint32 first, uint32 last ) const {
+			return logical_offset( first ) - logical_offset( last ) + ( last - first );
+		}
+
+		// The line starting at physical carries on the one before it, so lexing cannot start there
+		bool continues( uint32 physical ) const {
+			auto found = std::lower_bound( splices.begin(), splices.end(), physical, []( const line_splice& s, uint32 offset ) {
+				return s.physical + s.length < offset;
+			} );
+			return found != splices.end() && found->physical + found->length == physical;
+		}
+
+		// How [first, last) of text reads once spliced: text itself when no splice falls inside,
+		// otherwise the stretch of its spliced line's copy. Only comments and runs of newlines run on past
+		// the end of a spliced line; those keep their splices and stay views of text
+		string_view spelling( const char* text, const char* copies, uint32 first, uint32 last ) const {
+			auto found = std::lower_bound( splices.begin(), splices.end(), first, []( const line_splice& s, uint32 offset ) {
+				return s.physical < offset;
+			} );
+			if ( found == splices.end() || found->physical >= last ) {
+				return string_view( text + first, text + last );
+			}
+			auto line = std::upper_bound( lines.begin(), lines.end(), first, []( uint32 offset, const spliced_line& l ) {
+				return offset < l.physical;
+			} );
+			if ( line == lines.begin() ) {
+				return string_view( text + first, text + last );
+			}
+			--line;
+			if ( last > line->physical_end ) {
+				return string_view( text + first, text + last );
+			}
+			const char* copy = copies + line->copy;
+			return string_view( copy + ( logical_offset( first ) - line->logical ), copy + ( logical_offset( last ) - line->logical ) );
+		}
+
+		// The rest of the spliced line holding physical, from there on, as it reads in the line's copy
+		string_view spliced_from( const char* copies, uint32 physical ) const {
+			auto line = std::upper_bound( lines.begin(), lines.end(), physical, []( uint32 offset, const spliced_line& l ) {
+				return offset < l.physical;
+			} );
+			--line;
+			const char* copy = copies + line->copy;
+			uint32 size = ( line->physical_end - line->physical ) - removed_between( line->physical, line->physical_end );
+			return string_view( copy + ( logical_offset( physical ) - line->logical ), copy + size );
+		}
+
+		uint32 physical_offset( uint32 logical ) const {
+			auto found = std::upper_bound( splices.begin(), splices.end(), logical, []( uint32 offset, const line_splice& s ) {
+				return offset < s.logical;
+			} );
+			if ( found == splices.begin() ) {
+				return logical;
+			}
+			--found;
+			return logical + ( found->physical - found->logical ) + found->length;
+		}
+
+		// Offsets inside a splice map to the byte that follows it
+		uint32 logical_offset( uint32 physical ) const {
+			auto found = std::upper_bound( splices.begin(), splices.end(), physical, []( uint32 offset, const line_splice& s ) {
+				return offset < s.physical;
+			} );
+			if ( found == splices.begin() ) {
+				return physical;
+			}
+			--found;
+			if ( physical < found->physical + found->length ) {
+				return found->logical;
+			}
+			return physical - ( found->physical - found->logical ) - found->length;
+		}
+	};
+
+}}
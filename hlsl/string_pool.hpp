@@ -0,0 +1,139 @@
+#pragma once
+
+#include "identifier.hpp"
+#include "../string.hpp"
+#include "../numeric.hpp"
+#include "../optional.hpp"
+#include <vector>
+#include <memory>
+#include <cstring>
+
+namespace gld { namespace hlsl {
+
+	// Interns identifier text into 32-bit ids for one compilation session
+	// The text is copied into blocks the pool owns, so names outlive the sources they came from
+	// Lookup is an open-addressed table of entry indices, probed linearly
+	class string_pool {
+	private:
+		struct entry {
+			string_view text;
+			uint32 hash;
+		};
+
+		static const std::size_t block_size = 16384;
+
+		std::vector<entry> entries;
+		std::vector<uint32> slots;
+		std::vector<std::unique_ptr<char[]>> blocks;
+		char* current;
+		std::size_t blockused;
+
+		static uint32 hash_of( const char* first, const char* last ) {
+			// FNV-1a: identifiers are short, so anything heavier costs more than it saves
+			uint32 h = 2166136261u;
+			for ( ; first != last; ++first ) {
+				h ^= static_cast<uint8>( *first );
+				h *= 16777619u;
+			}
+			return h;
+		}
+
+		std::size_t slot_of( const char* first, std::size_t size, uint32 hash ) const {
+			std::size_t mask = slots.size() - 1;
+			for ( std::size_t i = hash & mask; ; i = ( i + 1 ) & mask ) {
+				uint32 index = slots[ i ];
+				if ( index == 0 ) {
+					return i;
+				}
+				const entry& e = entries[ index ];
+				std::size_t esize = static_cast<std::size_t>( e.text.data_end() - e.text.data() );
+				if ( e.hash == hash && esize == size && std::memcmp( e.text.data(), first, size ) == 0 ) {
+					return i;
+				}
+			}
+		}
+
+		void grow() {
+			std::vector<uint32> old( slots.size() * 2, 0 );
+			old.swap( slots );
+			std::size_t mask = slots.size() - 1;
+			for ( uint32 index : old ) {
+				if ( index == 0 ) {
+					continue;
+				}
+				std::size_t i = entries[ index ].hash & mask;
+				while ( slots[ i ] != 0 ) {
+					i = ( i + 1 ) & mask;
+				}
+				slots[ i ] = index;
+			}
+		}
+
+		string_view store( const char* first, std::size_t size ) {
+			char* target;
+			if ( size > block_size / 4 ) {
+				// Oversized names get a block of their own rather than wasting the rest of the current one
+				blocks.emplace_back( new char[ size ] );
+				target = blocks.back().get();
+			}
+			else {
+				if ( current == nullptr || blockused + size > block_size ) {
+					blocks.emplace_back( new char[ block_size ] );
+					current = blocks.back().get();
+					blockused = 0;
+				}
+				target = current + blockused;
+				blockused += size;
+			}
+			std::memcpy( target, first, size );
+			return string_view( target, target + size );
+		}
+
+	public:
+		string_pool() : entries( 1 ), slots( 1024, 0 ), current( nullptr ), blockused( 0 ) {
+
+		}
+
+		string_pool( const string_pool& ) = delete;
+		string_pool& operator=( const string_pool& ) = delete;
+		string_pool( string_pool&& ) = default;
+		string_pool& operator=( string_pool&& ) = default;
+
+		identifier_id intern( const string_view& text ) {
+			const char* first = text.data();
+			std::size_t size = static_cast<std::size_t>( text.data_end() - first );
+			uint32 hash = hash_of( first, first + size );
+			std::size_t i = slot_of( first, size, hash );
+			if ( slots[ i ] != 0 ) {
+				return identifier_id( slots[ i ] );
+			}
+			uint32 index = static_cast<uint32>( entries.size() );
+			entries.push_back( entry{ store( first, size ), hash } );
+			slots[ i ] = index;
+			// Keep the table at most half full so probe runs stay short
+			if ( entries.size() * 2 > slots.size() ) {
+				grow();
+			}
+			return identifier_id( index );
+		}
+
+		optional<identifier_id> find( const string_view& text ) const {
+			const char* first = text.data();
+			std::size_t size = static_cast<std::size_t>( text.data_end() - first );
+			std::size_t i = slot_of( first, size, hash_of( first, first + size ) );
+			if ( slots[ i ] == 0 ) {
+				return none;
+			}
+			return identifier_id( slots[ i ] );
+		}
+
+		string_view name_of( identifier_id id ) const {
+			return entries[ id.index ].text;
+		}
+
+		std::size_t size() const {
+			return entries.size() - 1;
+		}
+	};
+
+}}
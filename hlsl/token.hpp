@@ -6,7 +6,8 @@
 #include "../variant.hpp"
 #include "../inclusion_style.hpp"
 #include "token_id.hpp"
-#include "occurrence.hpp"
+#include "source_location.hpp"
+#include "identifier.hpp"
 
 namespace gld { namespace hlsl {
 
@@ -17,24 +18,33 @@ namespace gld { namespace hlsl {
 		uint8, uint16, uint32, uint64,
 		int8, int16, int32, int64,
 		code_point,
-		half, float, double> token_value;
+		half, float, double,
+		identifier_id> token_value;
 
 	struct token {
 		token_id id;
-		occurrence where;
+		// Whitespace, a comment or a line break comes right before it. This is all the parser
+		// and expander look at, since in trivia_mode::side_table the blanks themselves are not in the stream
+		bool spaced;
+		source_location where;
 		string_view lexeme;
 		token_value value;
 
-		token( token_id id, occurrence where, string_view lexeme = {} )
+		token( token_id id, source_location where, string_view lexeme = {} )
 		: token( id, where, lexeme, unit() ) {
 
 		}
 		
 		template <typename T0, typename... Tn>
-		token( token_id id, occurrence where, string_view lexeme, T0&& arg0, Tn&&... argn )
-		: id( id ), lexeme( lexeme ), where( where ), value( std::forward<T0>( arg0 ), std::forward<Tn>( argn )... ) {
+		token( token_id id, source_location where, string_view lexeme, T0&& arg0, Tn&&... argn )
+		: id( id ), spaced( false ), lexeme( lexeme ), where( where ), value( std::forward<T0>( arg0 ), std::forward<Tn>( argn )... ) {
 
 		}
 	};
 
+	// The interned name of an identifier token, or the invalid id for any other token
+	inline identifier_id identifier_of( const token& t ) {
+		return t.value.is<identifier_id>() ? t.value.get<identifier_id>() : identifier_id();
+	}
+
 }}
@@ -1,11 +1,13 @@
 #pragma once
 
+#include "../numeric.hpp"
 #include "../optional.hpp"
 #include "../operation.hpp"
 
 namespace gld { namespace hlsl {
 
-	enum class token_id {
+	// 16 bits, so the spaced flag beside it in token costs no space
+	enum class token_id : uint16 {
 		// Markers
 		stream_begin,
 		stream_end,
@@ -177,6 +179,10 @@ namespace gld { namespace hlsl {
 		boolean_literal_true,
 		boolean_literal_false,
 		invalid_literal,
+		// Stand-ins for constructs the lexer could not make sense of (see pp::error_mode::recover)
+		invalid_directive,
+		invalid_include,
+		invalid_comment,
 
 
 		// Comments
@@ -684,6 +690,12 @@ namespace gld { namespace hlsl {
 			// Literals
 		case token_id::invalid_literal:
 			return "invalid_literal";
+		case token_id::invalid_directive:
+			return "invalid_directive";
+		case token_id::invalid_include:
+			return "invalid_include";
+		case token_id::invalid_comment:
+			return "invalid_comment";
 		case token_id::float_literal:
 			return "float_literal";
 		case token_id::integer_literal:
@@ -1169,8 +1181,10 @@ namespace gld { namespace hlsl {
 			return operation::assignment;
 			// Math operators
 		case token_id::add:
+		case token_id::plus:
 			return operation::add;
 		case token_id::subtract:
+		case token_id::minus:
 			return operation::subtract;
 		case token_id::multiply:
 			return operation::multiply;
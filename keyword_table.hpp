@@ -0,0 +1,71 @@
+#pragma once
+
+#include "string.hpp"
+#include "optional.hpp"
+#include <cstddef>
+#include <cstring>
+
+namespace gld {
+
+	template <typename Id>
+	struct keyword {
+		const char* name;
+		std::size_t size;
+		Id id;
+	};
+
+	template <typename Id, std::size_t N>
+	constexpr keyword<Id> make_keyword( const char( &name )[ N ], Id id ) {
+		return keyword<Id>{ name, N - 1, id };
+	}
+
+	// Keyword tables are ordered by length first, then bytewise,
+	// so a lookup mostly compares sizes and touches at most a couple of names
+	constexpr int keyword_compare( const char* left, std::size_t leftsize, const char* right, std::size_t rightsize, std::size_t i = 0 ) {
+		return leftsize != rightsize ? ( leftsize < rightsize ? -1 : 1 )
+			: i == leftsize ? 0
+			: left[ i ] != right[ i ] ? ( static_cast<unsigned char>( left[ i ] ) < static_cast<unsigned char>( right[ i ] ) ? -1 : 1 )
+			: keyword_compare( left, leftsize, right, rightsize, i + 1 );
+	}
+
+	template <typename Id>
+	constexpr bool is_keyword_table_sorted( const keyword<Id>* table, std::size_t size ) {
+		return size < 2 ? true
+			: keyword_compare( table[ 0 ].name, table[ 0 ].size, table[ 1 ].name, table[ 1 ].size ) < 0
+			&& is_keyword_table_sorted( table + 1, size - 1 );
+	}
+
+	template <typename Id, std::size_t N>
+	constexpr bool is_keyword_table_sorted( const keyword<Id>( &table )[ N ] ) {
+		return is_keyword_table_sorted( static_cast<const keyword<Id>*>( table ), N );
+	}
+
+	template <typename Id, std::size_t N>
+	inline optional<Id> find_keyword( const keyword<Id>( &table )[ N ], const char* first, const char* last ) {
+		std::size_t size = static_cast<std::size_t>( last - first );
+		std::size_t low = 0;
+		std::size_t high = N;
+		while ( low < high ) {
+			std::size_t middle = low + ( high - low ) / 2;
+			const keyword<Id>& k = table[ middle ];
+			int comparison = k.size != size ? ( k.size < size ? -1 : 1 )
+				: std::memcmp( k.name, first, size );
+			if ( comparison == 0 ) {
+				return k.id;
+			}
+			if ( comparison < 0 ) {
+				low = middle + 1;
+			}
+			else {
+				high = middle;
+			}
+		}
+		return none;
+	}
+
+	template <typename Id, std::size_t N>
+	inline optional<Id> find_keyword( const keyword<Id>( &table )[ N ], const string_view& name ) {
+		return find_keyword( table, name.data(), name.data_end() );
+	}
+
+}
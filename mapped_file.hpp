@@ -0,0 +1,164 @@
+#pragma once
+
+#include "string.hpp"
+#include "numeric.hpp"
+#include <system_error>
+#include <utility>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+namespace gld {
+
+	// A whole file mapped read-only into memory
+	// The view stays valid for as long as the mapped_file (or whatever it was moved into) lives,
+	// so lexemes can point straight at the page cache instead of at a copy
+	class mapped_file {
+	private:
+		const char* first;
+		uintz size;
+#ifdef _WIN32
+		HANDLE file;
+		HANDLE mapping;
+#endif
+
+		void release() {
+#ifdef _WIN32
+			if ( first != nullptr )
+				UnmapViewOfFile( first );
+			if ( mapping != nullptr )
+				CloseHandle( mapping );
+			if ( file != INVALID_HANDLE_VALUE )
+				CloseHandle( file );
+			file = INVALID_HANDLE_VALUE;
+			mapping = nullptr;
+#else
+			if ( first != nullptr )
+				munmap( const_cast<char*>( first ), size );
+#endif
+			first = nullptr;
+			size = 0;
+		}
+
+		[[noreturn]] void fail( const char* what ) {
+#ifdef _WIN32
+			int code = static_cast<int>( GetLastError() );
+#else
+			int code = errno;
+#endif
+			release();
+			throw std::system_error( code, std::system_category(), what );
+		}
+
+	public:
+		mapped_file() : first( nullptr ), size( 0 )
+#ifdef _WIN32
+			, file( INVALID_HANDLE_VALUE ), mapping( nullptr )
+#endif
+		{
+
+		}
+
+		explicit mapped_file( const string& path ) : mapped_file() {
+#ifdef _WIN32
+			// Sequential scan is the Windows spelling of madvise( MADV_SEQUENTIAL ):
+			// the cache manager reads ahead aggressively and drops pages behind
+			file = CreateFileA( path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr );
+			if ( file == INVALID_HANDLE_VALUE )
+				fail( "mapped_file: cannot open file" );
+			LARGE_INTEGER filesize;
+			if ( !GetFileSizeEx( file, &filesize ) )
+				fail( "mapped_file: cannot read file size" );
+			size = static_cast<uintz>( filesize.QuadPart );
+			if ( size == 0 )
+				return;
+			mapping = CreateFileMappingA( file, nullptr, PAGE_READONLY, 0, 0, nullptr );
+			if ( mapping == nullptr )
+				fail( "mapped_file: cannot create file mapping" );
+			first = static_cast<const char*>( MapViewOfFile( mapping, FILE_MAP_READ, 0, 0, 0 ) );
+			if ( first == nullptr )
+				fail( "mapped_file: cannot map file" );
+#else
+			int fd = ::open( path.c_str(), O_RDONLY );
+			if ( fd < 0 )
+				fail( "mapped_file: cannot open file" );
+			struct stat info;
+			if ( ::fstat( fd, &info ) != 0 ) {
+				int code = errno;
+				::close( fd );
+				errno = code;
+				fail( "mapped_file: cannot read file size" );
+			}
+			size = static_cast<uintz>( info.st_size );
+			if ( size == 0 ) {
+				::close( fd );
+				return;
+			}
+			void* view = ::mmap( nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0 );
+			// The mapping keeps its own reference to the file
+			::close( fd );
+			if ( view == MAP_FAILED )
+				fail( "mapped_file: cannot map file" );
+			first = static_cast<const char*>( view );
+			// Only a hint: lexing reads front to back exactly once
+			::madvise( view, size, MADV_SEQUENTIAL );
+#endif
+		}
+
+		mapped_file( const mapped_file& ) = delete;
+		mapped_file& operator=( const mapped_file& ) = delete;
+
+		mapped_file( mapped_file&& other ) noexcept : mapped_file() {
+			swap( other );
+		}
+
+		mapped_file& operator=( mapped_file&& other ) noexcept {
+			mapped_file moved( std::move( other ) );
+			swap( moved );
+			return *this;
+		}
+
+		~mapped_file() {
+			release();
+		}
+
+		void swap( mapped_file& other ) noexcept {
+			std::swap( first, other.first );
+			std::swap( size, other.size );
+#ifdef _WIN32
+			std::swap( file, other.file );
+			std::swap( mapping, other.mapping );
+#endif
+		}
+
+		const char* data() const {
+			return first;
+		}
+
+		const char* data_end() const {
+			return first + size;
+		}
+
+		bool empty() const {
+			return size == 0;
+		}
+
+		string_view view() const {
+			return string_view( first, first + size );
+		}
+	};
+
+}
@@ -0,0 +1,254 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <memory>
+#include <atomic>
+#include <vector>
+#include <unordered_map>
+#include <functional>
+#include <algorithm>
+
+namespace gld { namespace pmr {
+
+	// The shape of C++17's std::pmr for toolchains that predate it:
+	// containers hold a polymorphic_allocator, which forwards to whichever memory_resource it was built with,
+	// so one container type serves the global heap and a per-translation-unit arena alike
+	class memory_resource {
+	public:
+		virtual ~memory_resource() {
+
+		}
+
+		void* allocate( std::size_t bytes, std::size_t alignment = alignof( std::max_align_t ) ) {
+			return do_allocate( bytes, alignment );
+		}
+
+		void deallocate( void* p, std::size_t bytes, std::size_t alignment = alignof( std::max_align_t ) ) {
+			do_deallocate( p, bytes, alignment );
+		}
+
+		bool is_equal( const memory_resource& other ) const noexcept {
+			return do_is_equal( other );
+		}
+
+	private:
+		virtual void* do_allocate( std::size_t bytes, std::size_t alignment ) = 0;
+		virtual void do_deallocate( void* p, std::size_t bytes, std::size_t alignment ) = 0;
+		virtual bool do_is_equal( const memory_resource& other ) const noexcept = 0;
+	};
+
+	inline bool operator==( const memory_resource& left, const memory_resource& right ) noexcept {
+		return &left == &right || left.is_equal( right );
+	}
+
+	inline bool operator!=( const memory_resource& left, const memory_resource& right ) noexcept {
+		return !( left == right );
+	}
+
+	namespace detail {
+
+		class heap_resource : public memory_resource {
+		private:
+			void* do_allocate( std::size_t bytes, std::size_t ) override {
+				return ::operator new( bytes );
+			}
+
+			void do_deallocate( void* p, std::size_t, std::size_t ) override {
+				::operator delete( p );
+			}
+
+			bool do_is_equal( const memory_resource& other ) const noexcept override {
+				return this == &other;
+			}
+		};
+
+	}
+
+	inline memory_resource* new_delete_resource() noexcept {
+		static detail::heap_resource resource;
+		return &resource;
+	}
+
+	namespace detail {
+
+		inline std::atomic<memory_resource*>& default_resource_slot() {
+			static std::atomic<memory_resource*> slot( new_delete_resource() );
+			return slot;
+		}
+
+	}
+
+	inline memory_resource* get_default_resource() noexcept {
+		return detail::default_resource_slot().load();
+	}
+
+	// Returns the previous default; nullptr restores the global heap
+	inline memory_resource* set_default_resource( memory_resource* resource ) noexcept {
+		return detail::default_resource_slot().exchange( resource != nullptr ? resource : new_delete_resource() );
+	}
+
+	// Bump allocation out of chunks taken from upstream: deallocate does nothing,
+	// and everything is handed back at once by release() or the destructor.
+	// Not thread-safe; give each worker its own
+	class monotonic_buffer_resource : public memory_resource {
+	private:
+		struct chunk {
+			chunk* previous;
+			std::size_t size;
+		};
+
+		memory_resource* upstream;
+		chunk* chunks;
+		char* current;
+		char* last;
+		std::size_t initialsize;
+		std::size_t nextsize;
+		std::size_t allocatedbytes;
+		std::size_t reservedbytes;
+		std::size_t highwaterbytes;
+
+	public:
+		explicit monotonic_buffer_resource( std::size_t initialsize = 64 * 1024, memory_resource* upstream = get_default_resource() )
+		: upstream( upstream ), chunks( nullptr ), current( nullptr ), last( nullptr ),
+		initialsize( std::max<std::size_t>( initialsize, 256 ) ), nextsize( this->initialsize ),
+		allocatedbytes( 0 ), reservedbytes( 0 ), highwaterbytes( 0 ) {
+
+		}
+
+		monotonic_buffer_resource( const monotonic_buffer_resource& ) = delete;
+		monotonic_buffer_resource& operator=( const monotonic_buffer_resource& ) = delete;
+
+		~monotonic_buffer_resource() {
+			release();
+		}
+
+		// Hands every chunk back upstream; the high-water mark survives, so a reused arena can be sized from it
+		void release() {
+			while ( chunks != nullptr ) {
+				chunk* previous = chunks->previous;
+				upstream->deallocate( chunks, chunks->size );
+				chunks = previous;
+			}
+			current = nullptr;
+			last = nullptr;
+			nextsize = initialsize;
+			allocatedbytes = 0;
+			reservedbytes = 0;
+		}
+
+		memory_resource* upstream_resource() const {
+			return upstream;
+		}
+
+		// Bytes handed out since the last release, alignment padding included
+		std::size_t bytes_allocated() const {
+			return allocatedbytes;
+		}
+
+		// Bytes taken from upstream since the last release
+		std::size_t bytes_reserved() const {
+			return reservedbytes;
+		}
+
+		// The most bytes_allocated() has ever reached: the initial size that would have avoided growing
+		std::size_t high_water_mark() const {
+			return highwaterbytes;
+		}
+
+		void reset_high_water_mark() {
+			highwaterbytes = allocatedbytes;
+		}
+
+	private:
+		void grow( std::size_t minimum ) {
+			std::size_t size = std::max( nextsize, minimum + sizeof( chunk ) );
+			char* raw = static_cast<char*>( upstream->allocate( size ) );
+			chunks = new ( raw ) chunk{ chunks, size };
+			current = raw + sizeof( chunk );
+			last = raw + size;
+			reservedbytes += size;
+			nextsize = size * 2;
+		}
+
+		void* do_allocate( std::size_t bytes, std::size_t alignment ) override {
+			void* p = current;
+			std::size_t space = static_cast<std::size_t>( last - current );
+			if ( std::align( alignment, bytes, p, space ) == nullptr ) {
+				grow( bytes + alignment );
+				p = current;
+				space = static_cast<std::size_t>( last - current );
+				std::align( alignment, bytes, p, space );
+			}
+			char* end = static_cast<char*>( p ) + bytes;
+			allocatedbytes += static_cast<std::size_t>( end - current );
+			highwaterbytes = std::max( highwaterbytes, allocatedbytes );
+			current = end;
+			return p;
+		}
+
+		void do_deallocate( void*, std::size_t, std::size_t ) override {
+
+		}
+
+		bool do_is_equal( const memory_resource& other ) const noexcept override {
+			return this == &other;
+		}
+	};
+
+	template <typename T>
+	class polymorphic_allocator {
+	private:
+		memory_resource* res;
+
+	public:
+		typedef T value_type;
+
+		polymorphic_allocator() noexcept : res( get_default_resource() ) {
+
+		}
+
+		polymorphic_allocator( memory_resource* resource ) noexcept : res( resource ) {
+
+		}
+
+		template <typename U>
+		polymorphic_allocator( const polymorphic_allocator<U>& other ) noexcept : res( other.resource() ) {
+
+		}
+
+		T* allocate( std::size_t n ) {
+			return static_cast<T*>( res->allocate( n * sizeof( T ), alignof( T ) ) );
+		}
+
+		void deallocate( T* p, std::size_t n ) {
+			res->deallocate( p, n * sizeof( T ), alignof( T ) );
+		}
+
+		// As with std::pmr, copying a container does not drag its arena along
+		polymorphic_allocator select_on_container_copy_construction() const {
+			return polymorphic_allocator();
+		}
+
+		memory_resource* resource() const {
+			return res;
+		}
+	};
+
+	template <typename T, typename U>
+	inline bool operator==( const polymorphic_allocator<T>& left, const polymorphic_allocator<U>& right ) noexcept {
+		return *left.resource() == *right.resource();
+	}
+
+	template <typename T, typename U>
+	inline bool operator!=( const polymorphic_allocator<T>& left, const polymorphic_allocator<U>& right ) noexcept {
+		return !( left == right );
+	}
+
+	template <typename T>
+	using vector = std::vector<T, polymorphic_allocator<T>>;
+
+	template <typename Key, typename T, typename Hash = std::hash<Key>, typename Equals = std::equal_to<Key>>
+	using unordered_map = std::unordered_map<Key, T, Hash, Equals, polymorphic_allocator<std::pair<const Key, T>>>;
+
+}}
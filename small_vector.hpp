@@ -0,0 +1,281 @@
+#pragma once
+
+#include "memory_resource.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <memory>
+#include <iterator>
+#include <type_traits>
+#include <utility>
+#include <algorithm>
+#include <initializer_list>
+
+namespace gld {
+
+	// A vector whose first N elements live inside it, so the common short case never allocates;
+	// past N it moves everything out to memory_resource-backed storage, like pmr::vector would
+	template <typename T, std::size_t N>
+	class small_vector {
+	private:
+		T* first;
+		std::uint32_t count;
+		std::uint32_t capacityof;
+		pmr::memory_resource* resource;
+		typename std::aligned_storage<sizeof( T ) * N, alignof( T )>::type inlinestorage;
+
+		T* inline_data() {
+			return reinterpret_cast<T*>( &inlinestorage );
+		}
+
+		const T* inline_data() const {
+			return reinterpret_cast<const T*>( &inlinestorage );
+		}
+
+		bool is_inline() const {
+			return first == inline_data();
+		}
+
+		void release_storage() noexcept {
+			if ( !is_inline() ) {
+				resource->deallocate( first, sizeof( T ) * capacityof, alignof( T ) );
+			}
+		}
+
+		void destroy_all() noexcept {
+			for ( std::size_t i = 0; i < count; ++i ) {
+				first[ i ].~T();
+			}
+			count = 0;
+		}
+
+		std::size_t grown_capacity( std::size_t minimum ) const {
+			return std::max<std::size_t>( minimum, static_cast<std::size_t>( capacityof ) * 2 );
+		}
+
+		T* allocate_storage( std::size_t capacity ) {
+			return static_cast<T*>( resource->allocate( sizeof( T ) * capacity, alignof( T ) ) );
+		}
+
+		// Moves the elements into storage and frees what held them
+		void relocate( T* storage, std::size_t capacity ) {
+			for ( std::size_t i = 0; i < count; ++i ) {
+				::new ( static_cast<void*>( storage + i ) ) T( std::move_if_noexcept( first[ i ] ) );
+				first[ i ].~T();
+			}
+			release_storage();
+			first = storage;
+			capacityof = static_cast<std::uint32_t>( capacity );
+		}
+
+		void grow( std::size_t minimum ) {
+			std::size_t capacity = grown_capacity( minimum );
+			relocate( allocate_storage( capacity ), capacity );
+		}
+
+		void take( small_vector&& other ) noexcept( std::is_nothrow_move_constructible<T>::value ) {
+			if ( other.is_inline() ) {
+				for ( std::size_t i = 0; i < other.count; ++i ) {
+					::new ( static_cast<void*>( first + i ) ) T( std::move( other.first[ i ] ) );
+				}
+				count = other.count;
+				other.destroy_all();
+				return;
+			}
+			// Spilled storage changes hands whole, along with the resource it came from
+			first = other.first;
+			count = other.count;
+			capacityof = other.capacityof;
+			resource = other.resource;
+			other.first = other.inline_data();
+			other.count = 0;
+			other.capacityof = static_cast<std::uint32_t>( N );
+		}
+
+	public:
+		typedef T value_type;
+		typedef std::size_t size_type;
+		typedef std::ptrdiff_t difference_type;
+		typedef T& reference;
+		typedef const T& const_reference;
+		typedef T* pointer;
+		typedef const T* const_pointer;
+		typedef T* iterator;
+		typedef const T* const_iterator;
+
+		small_vector( pmr::memory_resource* resource = pmr::get_default_resource() ) noexcept
+		: first( inline_data() ), count( 0 ), capacityof( static_cast<std::uint32_t>( N ) ), resource( resource ) {
+
+		}
+
+		small_vector( std::initializer_list<T> items, pmr::memory_resource* resource = pmr::get_default_resource() ) : small_vector( resource ) {
+			reserve( items.size() );
+			for ( const T& item : items ) {
+				push_back( item );
+			}
+		}
+
+		// As with pmr containers, a copy does not drag the original's resource along
+		small_vector( const small_vector& other ) : small_vector() {
+			reserve( other.size() );
+			for ( const T& item : other ) {
+				push_back( item );
+			}
+		}
+
+		// noexcept whenever T's move is, so std::vector moves rather than copies nodes holding one when it grows
+		small_vector( small_vector&& other ) noexcept( std::is_nothrow_move_constructible<T>::value ) : small_vector( other.resource ) {
+			take( std::move( other ) );
+		}
+
+		small_vector& operator=( const small_vector& other ) {
+			if ( this != &other ) {
+				clear();
+				reserve( other.size() );
+				for ( const T& item : other ) {
+					push_back( item );
+				}
+			}
+			return *this;
+		}
+
+		small_vector& operator=( small_vector&& other ) noexcept( std::is_nothrow_move_constructible<T>::value ) {
+			if ( this != &other ) {
+				destroy_all();
+				release_storage();
+				first = inline_data();
+				capacityof = static_cast<std::uint32_t>( N );
+				take( std::move( other ) );
+			}
+			return *this;
+		}
+
+		~small_vector() {
+			destroy_all();
+			release_storage();
+		}
+
+		template <typename... Tn>
+		T& emplace_back( Tn&&... argn ) {
+			if ( count != capacityof ) {
+				T* p = ::new ( static_cast<void*>( first + count ) ) T( std::forward<Tn>( argn )... );
+				++count;
+				return *p;
+			}
+			// The arguments may be, or point into, one of the elements,
+			// so the new element is built in the new storage before the old storage is released
+			std::size_t capacity = grown_capacity( static_cast<std::size_t>( count ) + 1 );
+			T* storage = allocate_storage( capacity );
+			T* p;
+			try {
+				p = ::new ( static_cast<void*>( storage + count ) ) T( std::forward<Tn>( argn )... );
+			}
+			catch ( ... ) {
+				resource->deallocate( storage, sizeof( T ) * capacity, alignof( T ) );
+				throw;
+			}
+			relocate( storage, capacity );
+			++count;
+			return *p;
+		}
+
+		void push_back( const T& item ) {
+			emplace_back( item );
+		}
+
+		void push_back( T&& item ) {
+			emplace_back( std::move( item ) );
+		}
+
+		void pop_back() {
+			first[ --count ].~T();
+		}
+
+		void clear() {
+			destroy_all();
+		}
+
+		void reserve( std::size_t capacity ) {
+			if ( capacity > capacityof ) {
+				grow( capacity );
+			}
+		}
+
+		T& operator[]( std::size_t i ) {
+			return first[ i ];
+		}
+
+		const T& operator[]( std::size_t i ) const {
+			return first[ i ];
+		}
+
+		T& front() {
+			return first[ 0 ];
+		}
+
+		const T& front() const {
+			return first[ 0 ];
+		}
+
+		T& back() {
+			return first[ count - 1 ];
+		}
+
+		const T& back() const {
+			return first[ count - 1 ];
+		}
+
+		T* data() {
+			return first;
+		}
+
+		const T* data() const {
+			return first;
+		}
+
+		iterator begin() {
+			return first;
+		}
+
+		iterator end() {
+			return first + count;
+		}
+
+		const_iterator begin() const {
+			return first;
+		}
+
+		const_iterator end() const {
+			return first + count;
+		}
+
+		const_iterator cbegin() const {
+			return first;
+		}
+
+		const_iterator cend() const {
+			return first + count;
+		}
+
+		std::size_t size() const {
+			return count;
+		}
+
+		std::size_t capacity() const {
+			return capacityof;
+		}
+
+		bool empty() const {
+			return count == 0;
+		}
+
+		static std::size_t inline_capacity() {
+			return N;
+		}
+
+		pmr::memory_resource* get_resource() const {
+			return resource;
+		}
+	};
+
+}
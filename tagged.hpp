@@ -1,6 +1,7 @@
 #pragma once
 
 #include <Furrovine++/ebco.hpp>
+#include <type_traits>
 
 namespace gld {
 
@@ -16,9 +17,9 @@ namespace gld {
 		tagged( T0&& arg0, Tn&&... argn ) : base( std::forward<T0>( arg0 ), std::forward<Tn>( argn )... ) { }
 		tagged( ) : base( ) { };
 		tagged( const tagged& item ) : base( item ) { };
-		tagged( tagged&& item ) : base( std::move( item ) ) { };
-		tagged& operator=( const tagged& item ) { base::operator=( item ) };
-		tagged& operator=( tagged&& item ) { base::operator=( std::move( item ) ) };
+		tagged( tagged&& item ) noexcept( std::is_nothrow_move_constructible<base>::value ) : base( std::move( item ) ) { };
+		tagged& operator=( const tagged& item ) { base::operator=( item ); return *this; };
+		tagged& operator=( tagged&& item ) noexcept( std::is_nothrow_move_assignable<base>::value ) { base::operator=( std::move( item ) ); return *this; };
 
 		operator T& ( ) {
 			return base::get( );
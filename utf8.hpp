@@ -0,0 +1,268 @@
+#pragma once
+
+#include "numeric.hpp"
+#include "string.hpp"
+#include "byte_scan.hpp"
+#include <iterator>
+#include <cstring>
+
+namespace gld {
+
+	struct non_ascii_matcher {
+		static const intz lookahead = 0;
+
+		bool operator()( const char* p ) const {
+			return static_cast<uint8>( *p ) >= 0x80;
+		}
+
+#if GLD_SSE2
+		uint32 operator()( __m128i v ) const {
+			return static_cast<uint32>( _mm_movemask_epi8( v ) );
+		}
+#endif // SSE2
+
+#if GLD_AVX2
+		uint32 operator()( __m256i v ) const {
+			return static_cast<uint32>( _mm256_movemask_epi8( v ) );
+		}
+#endif // AVX2
+	};
+
+	namespace detail {
+
+		// One code point at a time, skipping ASCII runs in bulk (see decode_utf8_sequence)
+		inline const char* find_invalid_utf8_sequence( const char* first, const char* last ) {
+			for ( ; ; ) {
+				first = find_first( first, last, non_ascii_matcher() );
+				if ( first == last ) {
+					return last;
+				}
+				code_point c;
+				intz length = decode_utf8_sequence( first, last, c );
+				if ( length == 0 ) {
+					return first;
+				}
+				first += length;
+			}
+		}
+
+#if GLD_AVX2
+		// Keiser and Lemire's lookup validator, 32 bytes at a time:
+		// three nibble-indexed tables classify every pair of adjacent bytes against the ways
+		// UTF-8 can be ill-formed, and the results are and-ed so only real errors stay set.
+		// It only says whether there is an error, not where
+		class utf8_block_validator {
+		private:
+			enum : uint8 {
+				too_short = 1 << 0,
+				too_long = 1 << 1,
+				overlong_3 = 1 << 2,
+				too_large = 1 << 3,
+				surrogate = 1 << 4,
+				overlong_2 = 1 << 5,
+				too_large_1000 = 1 << 6,
+				overlong_4 = 1 << 6,
+				two_continuations = 1 << 7,
+				carry = too_short | too_long | two_continuations
+			};
+
+			__m256i error;
+			__m256i previous;
+			__m256i previousincomplete;
+
+			static __m256i table( uint8 a0, uint8 a1, uint8 a2, uint8 a3, uint8 a4, uint8 a5, uint8 a6, uint8 a7,
+				uint8 a8, uint8 a9, uint8 a10, uint8 a11, uint8 a12, uint8 a13, uint8 a14, uint8 a15 ) {
+				return _mm256_setr_epi8(
+					static_cast<char>( a0 ), static_cast<char>( a1 ), static_cast<char>( a2 ), static_cast<char>( a3 ),
+					static_cast<char>( a4 ), static_cast<char>( a5 ), static_cast<char>( a6 ), static_cast<char>( a7 ),
+					static_cast<char>( a8 ), static_cast<char>( a9 ), static_cast<char>( a10 ), static_cast<char>( a11 ),
+					static_cast<char>( a12 ), static_cast<char>( a13 ), static_cast<char>( a14 ), static_cast<char>( a15 ),
+					static_cast<char>( a0 ), static_cast<char>( a1 ), static_cast<char>( a2 ), static_cast<char>( a3 ),
+					static_cast<char>( a4 ), static_cast<char>( a5 ), static_cast<char>( a6 ), static_cast<char>( a7 ),
+					static_cast<char>( a8 ), static_cast<char>( a9 ), static_cast<char>( a10 ), static_cast<char>( a11 ),
+					static_cast<char>( a12 ), static_cast<char>( a13 ), static_cast<char>( a14 ), static_cast<char>( a15 ) );
+			}
+
+			static __m256i high_nibbles( __m256i v ) {
+				return _mm256_and_si256( _mm256_srli_epi16( v, 4 ), _mm256_set1_epi8( 0x0F ) );
+			}
+
+			// The input shifted back by N bytes, with the last N bytes of the previous block shifted in
+			template <int N>
+			static __m256i shifted( __m256i input, __m256i previous ) {
+				return _mm256_alignr_epi8( input, _mm256_permute2x128_si256( previous, input, 0x21 ), 16 - N );
+			}
+
+			static __m256i special_cases( __m256i input, __m256i previous1 ) {
+				const __m256i byte1high = table(
+					// 0___ ____
+					too_long, too_long, too_long, too_long, too_long, too_long, too_long, too_long,
+					// 10__ ____
+					two_continuations, two_continuations, two_continuations, two_continuations,
+					// 1100 ____, 1101 ____, 1110 ____, 1111 ____
+					too_short | overlong_2,
+					too_short,
+					too_short | overlong_3 | surrogate,
+					too_short | too_large | too_large_1000 | overlong_4 );
+				const __m256i byte1low = table(
+					carry | overlong_3 | overlong_2 | overlong_4,
+					carry | overlong_2,
+					carry,
+					carry,
+					carry | too_large,
+					carry | too_large | too_large_1000,
+					carry | too_large | too_large_1000,
+					carry | too_large | too_large_1000,
+					carry | too_large | too_large_1000,
+					carry | too_large | too_large_1000,
+					carry | too_large | too_large_1000,
+					carry | too_large | too_large_1000,
+					carry | too_large | too_large_1000,
+					carry | too_large | too_large_1000 | surrogate,
+					carry | too_large | too_large_1000,
+					carry | too_large | too_large_1000 );
+				const __m256i byte2high = table(
+					// 0___ ____
+					too_short, too_short, too_short, too_short, too_short, too_short, too_short, too_short,
+					// 1000 ____, 1001 ____, 1010 ____, 1011 ____
+					too_long | overlong_2 | two_continuations | overlong_3 | too_large_1000 | overlong_4,
+					too_long | overlong_2 | two_continuations | overlong_3 | too_large,
+					too_long | overlong_2 | two_continuations | surrogate | too_large,
+					too_long | overlong_2 | two_continuations | surrogate | too_large,
+					// 11__ ____
+					too_short, too_short, too_short, too_short );
+				__m256i b1h = _mm256_shuffle_epi8( byte1high, high_nibbles( previous1 ) );
+				__m256i b1l = _mm256_shuffle_epi8( byte1low, _mm256_and_si256( previous1, _mm256_set1_epi8( 0x0F ) ) );
+				__m256i b2h = _mm256_shuffle_epi8( byte2high, high_nibbles( input ) );
+				return _mm256_and_si256( _mm256_and_si256( b1h, b1l ), b2h );
+			}
+
+			// Third and fourth bytes of a sequence must be continuations;
+			// the special cases flag every continuation as two_continuations, and the xor
+			// cancels exactly those that were expected
+			static __m256i multibyte_lengths( __m256i input, __m256i previous, __m256i special ) {
+				__m256i third = _mm256_subs_epu8( shifted<2>( input, previous ), _mm256_set1_epi8( static_cast<char>( 0xE0 - 0x80 ) ) );
+				__m256i fourth = _mm256_subs_epu8( shifted<3>( input, previous ), _mm256_set1_epi8( static_cast<char>( 0xF0 - 0x80 ) ) );
+				__m256i expected = _mm256_and_si256( _mm256_or_si256( third, fourth ), _mm256_set1_epi8( static_cast<char>( 0x80 ) ) );
+				return _mm256_xor_si256( expected, special );
+			}
+
+			void check( __m256i input ) {
+				if ( _mm256_movemask_epi8( input ) == 0 ) {
+					// ASCII only, so the only possible error is a sequence cut off by the last block
+					error = _mm256_or_si256( error, previousincomplete );
+				}
+				else {
+					__m256i special = special_cases( input, shifted<1>( input, previous ) );
+					error = _mm256_or_si256( error, multibyte_lengths( input, previous, special ) );
+					// Leads in the last three bytes that need more bytes than the block has left
+					const __m256i maximums = _mm256_setr_epi8( -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+						-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+						static_cast<char>( 0xF0 - 1 ), static_cast<char>( 0xE0 - 1 ), static_cast<char>( 0xC0 - 1 ) );
+					previousincomplete = _mm256_subs_epu8( input, maximums );
+				}
+				previous = input;
+			}
+
+		public:
+			utf8_block_validator() : error( _mm256_setzero_si256() ), previous( _mm256_setzero_si256() ), previousincomplete( _mm256_setzero_si256() ) {
+
+			}
+
+			bool operator()( const char* first, const char* last ) {
+				for ( ; last - first >= 32; first += 32 ) {
+					check( _mm256_loadu_si256( reinterpret_cast<const __m256i*>( first ) ) );
+				}
+				if ( first != last ) {
+					// Pad the tail with NULs, which are ASCII and so change nothing
+					char tail[ 32 ] = {};
+					std::memcpy( tail, first, static_cast<std::size_t>( last - first ) );
+					check( _mm256_loadu_si256( reinterpret_cast<const __m256i*>( tail ) ) );
+				}
+				error = _mm256_or_si256( error, previousincomplete );
+				return _mm256_testz_si256( error, error ) != 0;
+			}
+		};
+#endif // AVX2
+
+	}
+
+	// Returns the start of the first ill-formed sequence in [first, last), or last when it is all well-formed UTF-8
+	inline const char* find_invalid_utf8( const char* first, const char* last ) {
+#if GLD_AVX2
+		// Well-formed input, the usual case, never leaves the vector path;
+		// only input with an error is walked again to find where it is
+		if ( detail::utf8_block_validator()( first, last ) ) {
+			return last;
+		}
+#endif // AVX2
+		return detail::find_invalid_utf8_sequence( first, last );
+	}
+
+	inline bool is_valid_utf8( const char* first, const char* last ) {
+		return find_invalid_utf8( first, last ) == last;
+	}
+
+	// Steps over text one code point at a time:
+	// ASCII costs one compare, only multi-byte sequences are decoded,
+	// and base() is the byte position itself.
+	// A byte that starts no well-formed sequence is one step and reads as U+FFFD (see decode_utf8)
+	class utf8_iterator {
+	private:
+		const char* at;
+		const char* last;
+
+	public:
+		typedef std::forward_iterator_tag iterator_category;
+		typedef code_point value_type;
+		typedef std::ptrdiff_t difference_type;
+		typedef const code_point* pointer;
+		typedef code_point reference;
+
+		utf8_iterator() : at( nullptr ), last( nullptr ) {
+
+		}
+
+		utf8_iterator( const char* at, const char* last ) : at( at ), last( last ) {
+
+		}
+
+		code_point operator*() const {
+			uint8 lead = static_cast<uint8>( *at );
+			if ( lead < 0x80 ) {
+				return lead;
+			}
+			const char* p = at;
+			return decode_utf8( p, last );
+		}
+
+		utf8_iterator& operator++() {
+			if ( static_cast<uint8>( *at ) < 0x80 ) {
+				++at;
+			}
+			else {
+				decode_utf8( at, last );
+			}
+			return *this;
+		}
+
+		utf8_iterator operator++( int ) {
+			utf8_iterator previous = *this;
+			++*this;
+			return previous;
+		}
+
+		const char* base() const {
+			return at;
+		}
+
+		friend bool operator==( const utf8_iterator& left, const utf8_iterator& right ) {
+			return left.at == right.at;
+		}
+
+		friend bool operator!=( const utf8_iterator& left, const utf8_iterator& right ) {
+			return left.at != right.at;
+		}
+	};
+
+}